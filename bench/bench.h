@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string.h>
+#include <time.h>
+
+/* helpers shared by the benchmarks */
+
+static inline double now(void) /* seconds, monotonic */
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline char* put(char* p, char c, int count) /* `count` copies of `c` at p; returns the end */
+{
+    memset(p, c, (size_t)count);
+    return p + count;
+}
@@ -0,0 +1,121 @@
+/* JIT cache benchmark; for straight-line programs of growing size, times a cold start (hash, parse,
+ * -O2, codegen, store and map) against a warm one (hash and map the cached file), up to the first
+ * instruction. The cache lives in a fresh directory under /tmp for the run */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/bfc.h"
+#include "../src/bfrt.h"
+#include "bench.h"
+
+#define RUNS 5
+
+/* `blocks` copies of a small block with a short loop in it; nothing is printed */
+static char* make_program(int blocks)
+{
+    static const char block[] = "+>++>-<<[->+<]>>>+++>--<<<<";
+    char* src = malloc((size_t)blocks * (sizeof(block) - 1) + 1);
+    if (!src)
+        return NULL;
+
+    for (int i = 0; i < blocks; i++)
+        memcpy(src + (size_t)i * (sizeof(block) - 1), block, sizeof(block) - 1);
+    src[(size_t)blocks * (sizeof(block) - 1)] = '\0';
+    return src;
+}
+
+static JITContext* cold_start(const char* source, const CodegenOptions* options)
+{
+    JitCacheKey key;
+    jit_cache_key(&key, source, strlen(source), 2, options, NULL, 0);
+
+    IRProgram* program = parse_source(source, strlen(source));
+    if (!program)
+        return NULL;
+    program = optimize2(optimize1(program));
+    CodeBuffer* code = codegen(program, options);
+    JITContext* ctx = NULL;
+    if (code && jit_cache_store(&key, options->target, code) == 0)
+        ctx = init_jit(code);
+    free_code_buffer(code);
+    free_ir_program(program);
+    return ctx;
+}
+
+static JITContext* warm_start(const char* source, const CodegenOptions* options)
+{
+    JitCacheKey key;
+    jit_cache_key(&key, source, strlen(source), 2, options, NULL, 0);
+    return jit_cache_load(&key, options->target);
+}
+
+/* best of RUNS; the context is run once so both starts are known to work */
+static double measure(JITContext* (*start)(const char*, const CodegenOptions*), const char* source,
+                      const CodegenOptions* options)
+{
+    double best = -1;
+    for (int i = 0; i < RUNS; i++)
+    {
+        double t0 = now();
+        JITContext* ctx = start(source, options);
+        double t = now() - t0;
+        if (!ctx)
+            return -1;
+        int result = exec_jit(ctx);
+        free_jit(ctx);
+        if (result != 0)
+            return -1;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(void)
+{
+    static const int sizes[] = { 100, 10000, 100000 };
+
+    char dir[] = "/tmp/cachebench.XXXXXX";
+    if (!mkdtemp(dir) || setenv("BFC_CACHE_DIR", dir, 1) != 0)
+    {
+        perror("Error creating cache directory");
+        return 1;
+    }
+
+    CodegenOptions options;
+    default_codegen_options(&options);
+
+    printf("%-16s %10s %10s   (ms)\n", "program", "cold", "warm");
+    int status = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        char* src = make_program(sizes[i]);
+        if (!src)
+        {
+            perror("Memory allocation error");
+            status = 1;
+            break;
+        }
+
+        double cold = measure(cold_start, src, &options);
+        double warm = cold >= 0 ? measure(warm_start, src, &options) : -1;
+        free(src);
+        if (cold < 0 || warm < 0)
+        {
+            fprintf(stderr, "failed to compile, cache or run the benchmark program\n");
+            status = 1;
+            break;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "straight x%d", sizes[i]);
+        printf("%-16s %10.3f %10.3f\n", name, cold * 1e3, warm * 1e3);
+    }
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+        fprintf(stderr, "could not remove %s\n", dir);
+    return status;
+}
@@ -0,0 +1,146 @@
+/* interpreter benchmark; runs the same optimized programs through codegen plus the JIT and through
+ * the interpreter, and reports the time from IR to the first instruction, the run time and the
+ * total for each. The programs range from large straight-line sources, where compiling dominates,
+ * to a short source that loops for a long time */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/bfc.h"
+#include "../src/bfrt.h"
+#include "bench.h"
+
+/* `blocks` copies of a small loop-free block that walks right and back, touching 16 cells. The
+ * leading ',' reads end of input, but stops the whole program from being run at compile time */
+static char* make_straight(int blocks)
+{
+    static const char block[] = "+>++>-<<[->+<]>>>+++>--<<<<";
+    char* src = malloc((size_t)blocks * (sizeof(block) - 1) + 2);
+    if (!src)
+        return NULL;
+
+    char* p = src;
+    *p++ = ',';
+    for (int i = 0; i < blocks; i++)
+    {
+        memcpy(p, block, sizeof(block) - 1);
+        p += sizeof(block) - 1;
+    }
+    *p = '\0';
+    return src;
+}
+
+/* 255 * 255 * 8 rounds of moving and multiplying a few cells */
+static char* make_loop(void)
+{
+    const char* src = ",-[>-[>++++++++[>++++++++[>+>++<<-]>>[-<+>]<<<-]<-]<-]";
+    return strdup(src);
+}
+
+typedef struct
+{
+    double ready; /* codegen and map, or translate to bytecode */
+    double run;
+} Timing;
+
+static IRProgram* front_end(const char* source)
+{
+    IRProgram* program = parse_source(source, strlen(source));
+    return program ? optimize2(optimize1(program)) : NULL;
+}
+
+static bool run_jit(const char* source, Timing* t)
+{
+    IRProgram* program = front_end(source);
+    if (!program)
+        return false;
+
+    double t0 = now();
+    CodegenOptions options;
+    default_codegen_options(&options);
+    CodeBuffer* code = codegen(program, &options);
+    JITContext* ctx = code ? init_jit(code) : NULL;
+    if (!ctx)
+    {
+        free_code_buffer(code);
+        free_ir_program(program);
+        return false;
+    }
+    double t1 = now();
+    exec_jit(ctx);
+    double t2 = now();
+
+    t->ready = t1 - t0;
+    t->run = t2 - t1;
+    free_jit(ctx);
+    free_code_buffer(code);
+    free_ir_program(program);
+    return true;
+}
+
+static bool run_interp(const char* source, Timing* t)
+{
+    IRProgram* program = front_end(source);
+    if (!program)
+        return false;
+
+    double t0 = now();
+    InterpCode* code = interp_compile(program);
+    double t1 = now();
+    free_ir_program(program);
+    if (!code)
+        return false;
+    int result = interp_exec(code, BF_EOF_UNCHANGED);
+    double t2 = now();
+
+    t->ready = t1 - t0;
+    t->run = t2 - t1;
+    free_interp(code);
+    return result == 0;
+}
+
+int main(void)
+{
+    static const int sizes[] = { 100, 10000, 100000 };
+
+    int devnull = open("/dev/null", O_RDONLY); /* for the leading ',' */
+    if (devnull >= 0)
+    {
+        dup2(devnull, STDIN_FILENO);
+        close(devnull);
+    }
+
+    printf("%-16s %10s %10s %10s %10s %10s %10s   (ms)\n", "program", "jit ready", "jit run", "jit total",
+           "int ready", "int run", "int total");
+    for (size_t i = 0; i <= sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bool loop = i == sizeof(sizes) / sizeof(sizes[0]);
+        char* src = loop ? make_loop() : make_straight(sizes[i]);
+        if (!src)
+        {
+            perror("Memory allocation error");
+            return 1;
+        }
+
+        Timing jit, interp;
+        bool ok = run_jit(src, &jit) && run_interp(src, &interp);
+        free(src);
+        if (!ok)
+        {
+            fprintf(stderr, "failed to compile or run the benchmark program\n");
+            return 1;
+        }
+
+        char name[32];
+        if (loop)
+            snprintf(name, sizeof(name), "nested loop");
+        else
+            snprintf(name, sizeof(name), "straight x%d", sizes[i]);
+        printf("%-16s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", name, jit.ready * 1e3, jit.run * 1e3,
+               (jit.ready + jit.run) * 1e3, interp.ready * 1e3, interp.run * 1e3,
+               (interp.ready + interp.run) * 1e3);
+    }
+
+    return 0;
+}
@@ -0,0 +1,198 @@
+/* I/O benchmark; JIT-runs a program that prints 10^6 bytes to /dev/null and one that reads 10^6
+ * bytes of stdin, and counts the write and read syscalls they make with and without the runtime
+ * buffers. Input comes from a regular file (which buffered input maps) and from a pipe. The counts
+ * come from syscw/syscr in /proc/self/io, so they are Linux only; elsewhere only the time is shown */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/bfc.h"
+#include "../src/bfrt.h"
+#include "bench.h"
+
+#define IO_BYTES 1000000
+
+/* syscalls counted under `key` ("syscw: " or "syscr: ") so far; -1 when the kernel does not tell */
+static long long io_syscalls(const char* key)
+{
+    FILE* f = fopen("/proc/self/io", "r");
+    if (!f)
+        return -1;
+
+    char line[128];
+    long long count = -1;
+    size_t key_len = strlen(key);
+    while (fgets(line, sizeof(line), f))
+    {
+        if (strncmp(line, key, key_len) == 0)
+        {
+            count = atoll(line + key_len);
+            break;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+/* 'A', then three nested 100-iteration loops around a single '.' */
+static const char output_source[] =
+    "++++++++[>++++++++<-]>+"
+    ">++++++++++[>++++++++++<-]>"
+    "[>++++++++++[>++++++++++<-]>"
+    "[>++++++++++[>++++++++++<-]>"
+    "[<<<<<<.>>>>>>-]<<-]<<-]";
+
+/* read until a zero byte, which ends the input, so every EOF mode stops in the same place */
+static const char input_source[] = ",[,]";
+
+typedef enum
+{
+    FEED_NONE,
+    FEED_FILE, /* IO_BYTES - 1 'A's and a 0 in a regular file */
+    FEED_PIPE, /* the same through a pipe from a child process */
+} Feed;
+
+static void fill_input(char* data)
+{
+    memset(data, 'A', IO_BYTES - 1);
+    data[IO_BYTES - 1] = '\0';
+}
+
+/* stdin for the run, or -1; *child is the writer process for a pipe */
+static int open_feed(Feed feed, pid_t* child)
+{
+    static char data[IO_BYTES];
+    fill_input(data);
+    *child = -1;
+
+    if (feed == FEED_FILE)
+    {
+        FILE* f = tmpfile();
+        if (!f || fwrite(data, 1, IO_BYTES, f) != IO_BYTES || fflush(f) != 0)
+            return -1;
+        int fd = dup(fileno(f));
+        fclose(f);
+        lseek(fd, 0, SEEK_SET);
+        return fd;
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+
+    *child = fork();
+    if (*child == 0)
+    {
+        close(fds[0]);
+        for (size_t done = 0; done < IO_BYTES;)
+        {
+            ssize_t n = write(fds[1], data + done, IO_BYTES - done);
+            if (n <= 0)
+                _exit(1);
+            done += (size_t)n;
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    return fds[0];
+}
+
+/* run `source` once with stdout on /dev/null and stdin fed as asked; returns seconds, or -1 */
+static double run(const char* source, const CodegenOptions* options, Feed feed, const char* key,
+                  long long* syscalls)
+{
+    IRProgram* program = parse_source(source, strlen(source));
+    if (!program)
+        return -1;
+    program = optimize1(program);
+
+    CodeBuffer* code = codegen(program, options);
+    JITContext* ctx = code ? init_jit(code) : NULL;
+    if (!ctx)
+    {
+        free_code_buffer(code);
+        free_ir_program(program);
+        return -1;
+    }
+
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stdin = dup(STDIN_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    pid_t child = -1;
+    if (feed != FEED_NONE)
+    {
+        int in = open_feed(feed, &child);
+        if (in < 0)
+        {
+            perror("failed to set up stdin");
+            exit(1);
+        }
+        dup2(in, STDIN_FILENO);
+        close(in);
+    }
+
+    long long overhead = io_syscalls(key);
+    long long before = io_syscalls(key); /* reading the counters takes syscalls too */
+    double t0 = now();
+    exec_jit(ctx);
+    double t1 = now();
+    long long after = io_syscalls(key);
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stdin, STDIN_FILENO);
+    close(saved_stdout);
+    close(saved_stdin);
+    if (child > 0)
+        waitpid(child, NULL, 0);
+
+    *syscalls = overhead < 0 || before < 0 || after < 0 ? -1 : (after - before) - (before - overhead);
+    free_jit(ctx);
+    free_code_buffer(code);
+    free_ir_program(program);
+    return t1 - t0;
+}
+
+static void report(const char* name, const char* source, const CodegenOptions* options, Feed feed, const char* key)
+{
+    long long syscalls;
+    double seconds = run(source, options, feed, key, &syscalls);
+    if (seconds < 0)
+    {
+        fprintf(stderr, "failed to compile or run the benchmark program\n");
+        exit(1);
+    }
+
+    if (syscalls < 0)
+        printf("%-18s %12s %16s %12.2f\n", name, "n/a", "n/a", seconds * 1e3);
+    else
+        printf("%-18s %12lld %16.6f %12.2f\n", name, syscalls, (double)syscalls / IO_BYTES, seconds * 1e3);
+}
+
+int main(void)
+{
+    CodegenOptions options;
+    default_codegen_options(&options);
+
+    printf("%-18s %12s %16s %12s   (%d bytes of output)\n", "output", "writes", "writes per byte", "ms", IO_BYTES);
+    options.buffered_output = false;
+    report("unbuffered", output_source, &options, FEED_NONE, "syscw: ");
+    options.buffered_output = true;
+    report("buffered", output_source, &options, FEED_NONE, "syscw: ");
+
+    printf("\n%-18s %12s %16s %12s   (%d bytes of input)\n", "input", "reads", "reads per byte", "ms", IO_BYTES);
+    options.buffered_input = false;
+    report("unbuffered, file", input_source, &options, FEED_FILE, "syscr: ");
+    report("unbuffered, pipe", input_source, &options, FEED_PIPE, "syscr: ");
+    options.buffered_input = true;
+    report("buffered, file", input_source, &options, FEED_FILE, "syscr: ");
+    report("buffered, pipe", input_source, &options, FEED_PIPE, "syscr: ");
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+/* lexer microbenchmark; compares the streaming run-length lexer (parse_source)
+ * against the preproc + tokenize + parse path on a few synthetic inputs */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/bfc.h"
+#include "bench.h"
+
+#define INPUT_SIZE (32 * 1024 * 1024)
+#define ROUNDS 5
+
+/* fill buf by repeating pattern; the result is always a balanced program */
+static char* make_input(const char* pattern)
+{
+    size_t plen = strlen(pattern);
+    size_t reps = INPUT_SIZE / plen;
+    char* buf = malloc(reps * plen + 1);
+    if (!buf)
+        return NULL;
+
+    for (size_t i = 0; i < reps; i++)
+        memcpy(buf + i * plen, pattern, plen);
+
+    buf[reps * plen] = '\0';
+    return buf;
+}
+
+static double bench_legacy(const char* src)
+{
+    double best = 1e9;
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        double t = now();
+        char* proc = preproc(src);
+        TokenArray* tokens = tokenize(proc);
+        IRProgram* program = parse(tokens);
+        t = now() - t;
+
+        free_ir_program(program);
+        free_tkarr(tokens);
+        free(proc);
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+static double bench_stream(const char* src, size_t len)
+{
+    double best = 1e9;
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        double t = now();
+        IRProgram* program = parse_source(src, len);
+        t = now() - t;
+
+        free_ir_program(program);
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(void)
+{
+    static const struct
+    {
+        const char* name;
+        const char* pattern;
+    } inputs[] = {
+        { "comment-heavy", "This loop copies the counter into the next two cells and restores it\n"
+                           "[->+>+<<]>>[-<<+>>]<<\n" },
+        { "repetitive", "++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++"
+                        "++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++"
+                        ">>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>"
+                        "[-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<" },
+        { "dense", "+>+>++[<+>-]<.>,[->+<]>>-<<[[-]>]" },
+    };
+
+    printf("%-14s %14s %14s %8s\n", "input", "legacy MB/s", "stream MB/s", "speedup");
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        char* src = make_input(inputs[i].pattern);
+        if (!src)
+        {
+            perror("Memory allocation error");
+            return 1;
+        }
+
+        size_t len = strlen(src);
+        double legacy = bench_legacy(src);
+        double stream = bench_stream(src, len);
+        double mb = len / (1024.0 * 1024.0);
+
+        printf("%-14s %14.1f %14.1f %7.1fx\n", inputs[i].name,
+               mb / legacy, mb / stream, legacy / stream);
+        free(src);
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/* libbfc benchmark; serves a stream of requests with a program that echoes its input reversed,
+ * first compiling the program for every request, then compiling it once and running one instance
+ * per request from the same compiled code. Input and output are buffers of the caller's, as a
+ * host embedding the library would pass them. Reports the time per request */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/libbfc.h"
+#include "bench.h"
+
+#define REQUESTS 2000
+
+static const char reverse[] = ">,[>,]<[.<]";
+
+/* runs one request on `instance` and checks the answer */
+static int serve(BfcInstance* instance, const uint8_t* request, size_t size, uint8_t* response)
+{
+    BfcIO io = { .input = request, .input_size = size, .output = response, .output_size = size };
+    if (bfc_run(instance, &io) != 0 || io.truncated || io.output_length != size)
+        return -1;
+    return response[0] == request[size - 1] && response[size - 1] == request[0] ? 0 : -1;
+}
+
+static double compile_each(const BfcOptions* options, const uint8_t* request, size_t size, uint8_t* response)
+{
+    double t0 = now();
+    for (int i = 0; i < REQUESTS; i++)
+    {
+        BfcProgram* program = bfc_compile(reverse, strlen(reverse), options);
+        BfcInstance* instance = bfc_create_instance(program);
+        int result = instance ? serve(instance, request, size, response) : -1;
+        bfc_free_instance(instance);
+        bfc_free_program(program);
+        if (result != 0)
+            return -1;
+    }
+    return (now() - t0) / REQUESTS;
+}
+
+static double compile_once(const BfcOptions* options, const uint8_t* request, size_t size, uint8_t* response)
+{
+    double t0 = now();
+    BfcProgram* program = bfc_compile(reverse, strlen(reverse), options);
+    BfcInstance* instance = bfc_create_instance(program);
+    int result = instance ? 0 : -1;
+    for (int i = 0; i < REQUESTS && result == 0; i++)
+        result = serve(instance, request, size, response);
+    bfc_free_instance(instance);
+    bfc_free_program(program);
+    return result == 0 ? (now() - t0) / REQUESTS : -1;
+}
+
+int main(void)
+{
+    static const size_t sizes[] = { 64, 1024, 16384 }; /* the tape holds the whole request */
+
+    BfcOptions options;
+    bfc_default_options(&options);
+    options.eof_mode = BFC_EOF_ZERO; /* the ',' loop ends at end of input */
+
+    printf("%-10s %14s %14s   (us per request)\n", "request", "compile each", "compile once");
+    int status = 0;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        uint8_t* request = malloc(sizes[s]);
+        uint8_t* response = malloc(sizes[s]);
+        if (!request || !response)
+        {
+            perror("Memory allocation error");
+            free(request);
+            free(response);
+            status = 1;
+            break;
+        }
+        for (size_t i = 0; i < sizes[s]; i++)
+            request[i] = (uint8_t)('a' + i % 26);
+
+        double each = compile_each(&options, request, sizes[s], response);
+        double once = each >= 0 ? compile_once(&options, request, sizes[s], response) : -1;
+        free(request);
+        free(response);
+        if (each < 0 || once < 0)
+        {
+            fprintf(stderr, "failed to compile or run the benchmark program\n");
+            status = 1;
+            break;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "%zu B", sizes[s]);
+        printf("%-10s %14.2f %14.2f\n", name, each * 1e6, once * 1e6);
+    }
+    return status;
+}
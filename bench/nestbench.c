@@ -0,0 +1,77 @@
+/* nesting stress benchmark; builds programs with 10^4..10^6 nested loops and
+ * times each compiler stage in ns per loop. A linear stage stays level, apart from
+ * the step up once the IR no longer fits in the caches */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/bfc.h"
+#include "bench.h"
+
+/* ,[[[...[+>-<]...]]] with depth loops; the leading ',' keeps any pass from knowing the cell
+ * values, so nothing is folded and every stage sees all the loops */
+static char* make_nested(size_t depth, size_t* len)
+{
+    static const char body[] = "+>-<";
+    *len = 1 + depth * 2 + sizeof(body) - 1;
+    char* src = malloc(*len + 1);
+    if (!src)
+        return NULL;
+
+    char* p = src;
+    *p++ = ',';
+    memset(p, '[', depth);
+    p += depth;
+    memcpy(p, body, sizeof(body) - 1);
+    p += sizeof(body) - 1;
+    memset(p, ']', depth);
+    p += depth;
+    *p = '\0';
+    return src;
+}
+
+int main(void)
+{
+    static const size_t depths[] = { 10000, 100000, 1000000 };
+
+    printf("%-10s %12s %12s %12s %12s   (ns per loop)\n", "depth", "tokenize", "stream", "optimize", "codegen");
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++)
+    {
+        size_t depth = depths[i];
+        size_t len;
+        char* src = make_nested(depth, &len);
+        if (!src)
+        {
+            perror("Memory allocation error");
+            return 1;
+        }
+
+        double t0 = now();
+        TokenArray* tokens = tokenize(src);
+        IRProgram* legacy = tokens ? parse(tokens) : NULL;
+        double t1 = now();
+        IRProgram* program = parse_source(src, len);
+        double t2 = now();
+        if (!legacy || !program)
+        {
+            fprintf(stderr, "failed to parse depth %zu\n", depth);
+            return 1;
+        }
+
+        program = optimize3(optimize2(optimize1(program)));
+        double t3 = now();
+        CodeBuffer* code = codegen(program, NULL);
+        double t4 = now();
+
+        double scale = 1e9 / depth;
+        printf("%-10zu %12.1f %12.1f %12.1f %12.1f\n", depth, (t1 - t0) * scale,
+               (t2 - t1) * scale, (t3 - t2) * scale, (t4 - t3) * scale);
+
+        free_code_buffer(code);
+        free_ir_program(program);
+        free_ir_program(legacy);
+        free_tkarr(tokens);
+        free(src);
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+/* profile-guided layout benchmark; runs a program with one long loop nest and a few loops behind a
+ * branch that is never taken, first as a plain -O2 JIT build, then instrumented to write a profile,
+ * then rebuilt with that profile applied. Reports the run time of each, best of a few runs */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/bfc.h"
+#include "../src/bfrt.h"
+#include "bench.h"
+
+#define RUNS 5
+
+/* the leading ',' reads end of input, so the cell stays 0 and the loops behind it are never
+ * reached; the optimizer cannot tell. Then 255 * 255 * `rounds` turns of moving a few cells */
+static char* make_program(int rounds)
+{
+    static const char cold[] = ",[[>>>>]>+>++>+++>++++>+++++<<<<<[<]>>[-]<<]";
+    static const char nest[] = "[>-[>-[>++++++++[>+>++<<-]>>[-<+>]<<<-]<-]<-]";
+    char* src = malloc(sizeof(cold) + rounds + sizeof(nest) + 8);
+    if (!src)
+        return NULL;
+
+    char* p = src;
+    p += sprintf(p, "%s>", cold);
+    memset(p, '+', (size_t)rounds);
+    p += rounds;
+    memcpy(p, nest, sizeof(nest));
+    return src;
+}
+
+/* best time of RUNS runs of `program` built with `options`; counters, if any, collect a profile */
+static double run(IRProgram* program, const CodegenOptions* options, uint64_t* counters)
+{
+    CodeBuffer* code = codegen(program, options);
+    if (!code)
+        return -1;
+
+    double best = -1;
+    for (int i = 0; i < RUNS; i++)
+    {
+        JITContext* ctx = init_jit(code);
+        if (!ctx)
+            break;
+        if (counters)
+            jit_set_profile(ctx, counters);
+        double t0 = now();
+        int result = exec_jit(ctx);
+        double t = now() - t0;
+        free_jit(ctx);
+        if (result != 0)
+            break;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    free_code_buffer(code);
+    return best;
+}
+
+int main(void)
+{
+    static const int rounds[] = { 4, 16, 64 };
+
+    int devnull = open("/dev/null", O_RDONLY); /* for the leading ',' */
+    if (devnull >= 0)
+    {
+        dup2(devnull, STDIN_FILENO);
+        close(devnull);
+    }
+
+    char profile[] = "/tmp/profilebench.XXXXXX";
+    int fd = mkstemp(profile);
+    if (fd < 0)
+    {
+        perror("Error creating profile file");
+        return 1;
+    }
+    close(fd);
+
+    printf("%7s %12s %14s %12s   (ms)\n", "rounds", "plain", "instrumented", "profiled");
+    int status = 0;
+    for (size_t r = 0; r < sizeof(rounds) / sizeof(rounds[0]) && status == 0; r++)
+    {
+        char* src = make_program(rounds[r]);
+        IRProgram* program = src ? parse_source(src, strlen(src)) : NULL;
+        free(src);
+        if (!program)
+        {
+            fprintf(stderr, "failed to build the benchmark program\n");
+            status = 1;
+            break;
+        }
+        program = optimize2(optimize1(program));
+
+        CodegenOptions options;
+        default_codegen_options(&options);
+        double plain = run(program, &options, NULL);
+
+        uint64_t* counters = calloc(2 * program->loop_count + 1, sizeof(uint64_t));
+        options.profile = true;
+        double instrumented = counters ? run(program, &options, counters) : -1;
+        options.profile = false;
+
+        double profiled = -1;
+        if (instrumented >= 0 && profile_write(profile, program, counters) == 0 &&
+            profile_apply(profile, program) == 0)
+            profiled = run(program, &options, NULL);
+        free(counters);
+        free_ir_program(program);
+
+        if (plain < 0 || instrumented < 0 || profiled < 0)
+        {
+            fprintf(stderr, "failed to compile or run the benchmark program\n");
+            status = 1;
+            break;
+        }
+        printf("%7d %12.2f %14.2f %12.2f\n", rounds[r], plain * 1e3, instrumented * 1e3, profiled * 1e3);
+    }
+
+    remove(profile);
+    return status;
+}
@@ -0,0 +1,139 @@
+/* scan benchmark; JIT-runs programs that bounce a [>]/[<] scan (and the strided [>>], [>>>>] and
+ * [>>>>>>>>] forms) across a run of non-zero cells, with the scalar and the vector scan, and reports
+ * scanned cells per microsecond for run lengths from 1 to 3000 */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/bfc.h"
+#include "../src/bfrt.h"
+#include "bench.h"
+
+#define TARGET_STEPS 200000000.0 /* scan steps per measurement, roughly */
+
+/* cell 0 counts `outer` rounds of cells 1 and 2 counting 255 * 255 rounds of a forward and a
+ * backward scan over `run` ones placed `stride` cells apart, with the zero cell 3 as the sentinel
+ * on the left. The leading ',' reads end of input, but stops the prefix from being run at compile
+ * time */
+static char* make_scan(int stride, int run, int outer)
+{
+    char* src = malloc((size_t)(run + 8) * (stride + 1) + outer + 2 * 255 + 64);
+    if (!src)
+        return NULL;
+
+    char* p = src;
+    *p++ = ',';
+    p = put(p, '+', outer);
+    p = put(p, '>', 3);
+    for (int i = 0; i < run; i++)
+    {
+        p = put(p, '>', stride);
+        *p++ = '+';
+    }
+    *p++ = '[';
+    p = put(p, '<', stride);
+    *p++ = ']';
+    p = put(p, '<', 3);
+
+    for (int level = 0; level < 2; level++)
+    {
+        *p++ = '[';
+        *p++ = '>';
+        p = put(p, '+', 255);
+    }
+    *p++ = '[';
+    p = put(p, '>', 1 + stride);
+    *p++ = '[';
+    p = put(p, '>', stride);
+    *p++ = ']';
+    p = put(p, '<', stride);
+    *p++ = '[';
+    p = put(p, '<', stride);
+    *p++ = ']';
+    for (int level = 0; level < 3; level++)
+    {
+        p = put(p, '<', 1);
+        *p++ = '-';
+        *p++ = ']';
+    }
+    *p = '\0';
+    return src;
+}
+
+/* seconds for one run, or -1 */
+static double run(const char* source, bool vector)
+{
+    IRProgram* program = parse_source(source, strlen(source));
+    if (!program)
+        return -1;
+    program = optimize2(optimize1(program));
+
+    CodegenOptions options;
+    default_codegen_options(&options);
+    options.vector_scans = vector;
+    CodeBuffer* code = codegen(program, &options);
+    JITContext* ctx = code ? init_jit(code) : NULL;
+    if (!ctx)
+    {
+        free_code_buffer(code);
+        free_ir_program(program);
+        return -1;
+    }
+
+    double t0 = now();
+    exec_jit(ctx);
+    double t1 = now();
+
+    free_jit(ctx);
+    free_code_buffer(code);
+    free_ir_program(program);
+    return t1 - t0;
+}
+
+int main(void)
+{
+    static const int strides[] = { 1, 2, 4, 8 };
+    static const int runs[] = { 1, 4, 16, 64, 256, 1024, 3000 };
+
+    int devnull = open("/dev/null", O_RDONLY); /* for the leading ',' */
+    if (devnull >= 0)
+    {
+        dup2(devnull, STDIN_FILENO);
+        close(devnull);
+    }
+
+    printf("%-8s %8s %16s %16s %10s   (scanned cells per us)\n", "stride", "run", "scalar", "vector", "speedup");
+    for (size_t s = 0; s < sizeof(strides) / sizeof(strides[0]); s++)
+    {
+        for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++)
+        {
+            int stride = strides[s];
+            int length = runs[r];
+            double rounds = TARGET_STEPS / (2.0 * length * 255 * 255);
+            int outer = rounds < 1 ? 1 : rounds > 255 ? 255 : (int)rounds;
+
+            char* src = make_scan(stride, length, outer);
+            if (!src)
+            {
+                perror("Memory allocation error");
+                return 1;
+            }
+
+            double scalar = run(src, false);
+            double vector = run(src, true);
+            free(src);
+            if (scalar < 0 || vector < 0)
+            {
+                fprintf(stderr, "failed to compile or run the benchmark program\n");
+                return 1;
+            }
+
+            double cells = 2.0 * length * 255 * 255 * outer;
+            printf("%-8d %8d %16.1f %16.1f %9.2fx\n", stride, length, cells / scalar * 1e-6,
+                   cells / vector * 1e-6, scalar / vector);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/* tiered execution benchmark; runs programs that print more than an output buffer at once, then get
+ * through a large straight-line section and a long loop nest, with the full JIT (-O2, then codegen)
+ * and tiered. Each run is a child process writing into a pipe, and the time to the first byte and
+ * to the end of the output are taken from the parent, parse included */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/bfc.h"
+#include "../src/bfrt.h"
+#include "bench.h"
+
+/* the leading ',' reads end of input, but keeps the rest from being run at compile time; then
+ * 2 * 255 * 255 bytes of output, so the first write happens as soon as the program is running.
+ * Then `blocks` copies of a small block with a short loop in it, and 255 * 255 * `rounds` turns of
+ * a loop body, which the tiered run has to move to native code */
+static char* make_program(int blocks, int rounds)
+{
+    static const char block[] = "+>++>-<<[->+<]>>>+++>--<<<<";
+    static const char nest[] = "[>-[>-[>++++++++[>+>++<<-]>>[-<+>]<<<-]<-]<-]>>>>.";
+    char* src = malloc((size_t)blocks * (sizeof(block) - 1) + rounds + sizeof(nest) + 64);
+    if (!src)
+        return NULL;
+
+    char* p = src;
+    p += sprintf(p, ",>++[>-[>-[.-]<-]<-]<");
+    for (int i = 0; i < blocks; i++)
+    {
+        memcpy(p, block, sizeof(block) - 1);
+        p += sizeof(block) - 1;
+    }
+    p += sprintf(p, "[-]>[-]>[-]>[-]>[-]<<<<");
+    memset(p, '+', (size_t)rounds);
+    p += rounds;
+    memcpy(p, nest, sizeof(nest));
+    return src;
+}
+
+static int run_jit(const char* source)
+{
+    IRProgram* program = parse_source(source, strlen(source));
+    if (!program)
+        return -1;
+    program = optimize2(optimize1(program));
+
+    CodegenOptions options;
+    default_codegen_options(&options);
+    CodeBuffer* code = codegen(program, &options);
+    JITContext* ctx = code ? init_jit(code) : NULL;
+    int result = ctx ? exec_jit(ctx) : -1;
+    free_jit(ctx);
+    free_code_buffer(code);
+    free_ir_program(program);
+    return result;
+}
+
+static int run_tiered(const char* source)
+{
+    IRProgram* program = parse_source(source, strlen(source));
+    if (!program)
+        return -1;
+
+    CodegenOptions options;
+    default_codegen_options(&options);
+    return tier_run(program, 2, &options);
+}
+
+/* runs `run` in a child with stdout on a pipe; false if it failed */
+static bool measure(int (*run)(const char*), const char* source, double* first, double* total)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+
+    fflush(stdout); /* or the child would inherit what is buffered */
+    double t0 = now();
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0)
+    {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        _exit(run(source) != 0);
+    }
+
+    close(fds[1]);
+    char chunk[4096];
+    ssize_t n;
+    bool seen = false;
+    while ((n = read(fds[0], chunk, sizeof(chunk))) > 0)
+    {
+        if (!seen)
+            *first = now() - t0;
+        seen = true;
+    }
+    *total = now() - t0;
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    return seen && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(void)
+{
+    static const int blocks[] = { 100, 10000, 100000 };
+    static const int rounds[] = { 1, 16, 64 };
+
+    int devnull = open("/dev/null", O_RDONLY); /* for the leading ',' */
+    if (devnull >= 0)
+    {
+        dup2(devnull, STDIN_FILENO);
+        close(devnull);
+    }
+
+    printf("%8s %7s %14s %14s %14s %14s   (ms)\n", "blocks", "rounds", "jit first", "jit total", "tiered first",
+           "tiered total");
+    for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++)
+    {
+        for (size_t r = 0; r < sizeof(rounds) / sizeof(rounds[0]); r++)
+        {
+            char* src = make_program(blocks[b], rounds[r]);
+            if (!src)
+            {
+                perror("Memory allocation error");
+                return 1;
+            }
+
+            double jit_first, jit_total, tiered_first, tiered_total;
+            bool ok = measure(run_jit, src, &jit_first, &jit_total) &&
+                      measure(run_tiered, src, &tiered_first, &tiered_total);
+            free(src);
+            if (!ok)
+            {
+                fprintf(stderr, "failed to compile or run the benchmark program\n");
+                return 1;
+            }
+
+            printf("%8d %7d %14.2f %14.2f %14.2f %14.2f\n", blocks[b], rounds[r], jit_first * 1e3,
+                   jit_total * 1e3, tiered_first * 1e3, tiered_total * 1e3);
+        }
+    }
+
+    return 0;
+}
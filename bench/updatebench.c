@@ -0,0 +1,135 @@
+/* cell update benchmark; JIT-runs loops whose body adds constants to, sets, or clears and then
+ * adds to a row of 64 neighbouring cells, with and without grouping those updates into vector
+ * ops, and reports the code size and the time per row */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/bfc.h"
+#include "../src/bfrt.h"
+#include "bench.h"
+
+#define ROW_CELLS 64
+#define OUTER_ROUNDS 40 /* times 255 * 255 rows */
+
+typedef enum
+{
+    ROW_ADD,   /* cell += 1..7 */
+    ROW_SET,   /* cell = 0..4, as [-] then +s */
+    ROW_MIXED, /* every other cell of each */
+} RowKind;
+
+/* cells 0, 1 and 2 count OUTER_ROUNDS * 255 * 255 rows of updates to cells 3 on. The leading ','
+ * reads end of input, but keeps the cells from being known at compile time */
+static char* make_rows(RowKind kind)
+{
+    char* src = malloc(ROW_CELLS * 16 + 1024);
+    if (!src)
+        return NULL;
+
+    char* p = src;
+    *p++ = ',';
+    p = put(p, '+', OUTER_ROUNDS);
+    for (int level = 0; level < 2; level++)
+    {
+        *p++ = '[';
+        *p++ = '>';
+        p = put(p, '+', 255);
+    }
+    *p++ = '[';
+    for (int k = 0; k < ROW_CELLS; k++)
+    {
+        *p++ = '>';
+        bool set = kind == ROW_SET || (kind == ROW_MIXED && k % 2 == 1);
+        if (set)
+        {
+            memcpy(p, "[-]", 3);
+            p = put(p + 3, '+', k % 5);
+        }
+        else
+            p = put(p, '+', k % 7 + 1);
+    }
+    p = put(p, '<', ROW_CELLS);
+    *p++ = '-';
+    *p++ = ']';
+    for (int level = 0; level < 2; level++)
+    {
+        *p++ = '<';
+        *p++ = '-';
+        *p++ = ']';
+    }
+    *p = '\0';
+    return src;
+}
+
+/* seconds for one run, or -1; *code_size gets the size of the machine code */
+static double run(const char* source, bool vector, size_t* code_size)
+{
+    IRProgram* program = parse_source(source, strlen(source));
+    if (!program)
+        return -1;
+    program = optimize1(program);
+
+    CodegenOptions options;
+    default_codegen_options(&options);
+    options.vector_updates = vector;
+    CodeBuffer* code = codegen(program, &options);
+    JITContext* ctx = code ? init_jit(code) : NULL;
+    if (!ctx)
+    {
+        free_code_buffer(code);
+        free_ir_program(program);
+        return -1;
+    }
+    *code_size = code->size;
+
+    double t0 = now();
+    exec_jit(ctx);
+    double t1 = now();
+
+    free_jit(ctx);
+    free_code_buffer(code);
+    free_ir_program(program);
+    return t1 - t0;
+}
+
+int main(void)
+{
+    static const char* names[] = { "add", "set", "mixed" };
+
+    int devnull = open("/dev/null", O_RDONLY); /* for the leading ',' */
+    if (devnull >= 0)
+    {
+        dup2(devnull, STDIN_FILENO);
+        close(devnull);
+    }
+
+    printf("%-8s %12s %12s %14s %14s %10s   (%d cells per row)\n", "row", "scalar B", "vector B", "scalar ns/row",
+           "vector ns/row", "speedup", ROW_CELLS);
+    for (int kind = ROW_ADD; kind <= ROW_MIXED; kind++)
+    {
+        char* src = make_rows((RowKind)kind);
+        if (!src)
+        {
+            perror("Memory allocation error");
+            return 1;
+        }
+
+        size_t scalar_size, vector_size;
+        double scalar = run(src, false, &scalar_size);
+        double vector = run(src, true, &vector_size);
+        free(src);
+        if (scalar < 0 || vector < 0)
+        {
+            fprintf(stderr, "failed to compile or run the benchmark program\n");
+            return 1;
+        }
+
+        double rows = (double)OUTER_ROUNDS * 255 * 255;
+        printf("%-8s %12zu %12zu %14.2f %14.2f %9.2fx\n", names[kind], scalar_size, vector_size,
+               scalar / rows * 1e9, vector / rows * 1e9, scalar / vector);
+    }
+
+    return 0;
+}
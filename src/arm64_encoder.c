@@ -22,6 +22,16 @@ uint32_t encode_sub_imm(int rd, int rn, int imm)
             rd;                     /* destination register */
 }
 
+uint32_t encode_add_imm_lsl12(int rd, int rn, int imm) 
+{
+    return encode_add_imm(rd, rn, imm) | (1u << 22); /* sh = 1: immediate is shifted left by 12 */
+}
+
+uint32_t encode_sub_imm_lsl12(int rd, int rn, int imm) 
+{
+    return encode_sub_imm(rd, rn, imm) | (1u << 22);
+}
+
 /* MOVZ variant for simplicity */
 uint32_t encode_mov_imm(int rd, uint16_t imm) 
 {
@@ -65,13 +75,146 @@ uint32_t encode_strb(int rt, int rn)
 uint32_t encode_strb_offset(int rt, int rn, int offset) 
 {
     return (0x00u << 30) |            /* size=8-bit */
-            (0x7u << 27) |             /* Load/Store opcode */
+            (0x39u << 24) |            /* Load/Store unsigned offset opcode */
             (0x0u << 22) |             /* store (not load) */
             ((offset & 0xFFF) << 10) | /* 12-bit immediate offset */
             (rn << 5) |                /* base register */
             rt;                        /* target register */
 }
 
+uint32_t encode_ldr_x(int rt, int rn, int offset)
+{
+    return (0x3u << 30) |                  /* size=64-bit */
+            (0x39u << 24) |                /* Load/Store unsigned offset opcode */
+            (0x1u << 22) |                 /* load (not store) */
+            (((offset / 8) & 0xFFF) << 10) | /* 12-bit immediate, scaled by 8 */
+            (rn << 5) |                    /* base register */
+            rt;                            /* target register */
+}
+
+uint32_t encode_str_x(int rt, int rn, int offset)
+{
+    return (0x3u << 30) |                  /* size=64-bit */
+            (0x39u << 24) |                /* Load/Store unsigned offset opcode */
+            (((offset / 8) & 0xFFF) << 10) | /* 12-bit immediate, scaled by 8 */
+            (rn << 5) |                    /* base register */
+            rt;                            /* source register */
+}
+
+uint32_t encode_ldrb_offset(int rt, int rn, int offset) 
+{
+    return (0x00u << 30) |            /* size=8-bit */
+            (0x39u << 24) |            /* Load/Store unsigned offset opcode */
+            (0x1u << 22) |             /* load (not store) */
+            ((offset & 0xFFF) << 10) | /* 12-bit immediate offset */
+            (rn << 5) |                /* base register */
+            rt;                        /* target register */
+}
+
+uint32_t encode_ldurb(int rt, int rn, int offset) 
+{
+    return (0x00u << 30) |            /* size=8-bit */
+            (0x7u << 27) |             /* Load/Store opcode */
+            (0x1u << 22) |             /* load (not store) */
+            ((offset & 0x1FF) << 12) | /* 9-bit signed immediate offset */
+            (rn << 5) |                /* base register */
+            rt;                        /* target register */
+}
+
+uint32_t encode_sturb(int rt, int rn, int offset) 
+{
+    return (0x00u << 30) |            /* size=8-bit */
+            (0x7u << 27) |             /* Load/Store opcode */
+            (0x0u << 22) |             /* store (not load) */
+            ((offset & 0x1FF) << 12) | /* 9-bit signed immediate offset */
+            (rn << 5) |                /* base register */
+            rt;                        /* target register */
+}
+
+uint32_t encode_add_reg(int rd, int rn, int rm) 
+{
+    return (1u << 31) |    /* 64-bit */
+            (0u << 30) |    /* ADD opcode */
+            (0x0Bu << 24) | /* shifted register form, LSL #0 */
+            (rm << 16) |    /* second source register */
+            (rn << 5) |     /* first source register */
+            rd;             /* destination register */
+}
+
+uint32_t encode_sub_reg(int rd, int rn, int rm) 
+{
+    return (1u << 31) |    /* 64-bit */
+            (1u << 30) |    /* SUB opcode */
+            (0x0Bu << 24) | /* shifted register form, LSL #0 */
+            (rm << 16) |    /* second source register */
+            (rn << 5) |     /* first source register */
+            rd;             /* destination register */
+}
+
+uint32_t encode_add_shift(int rd, int rn, int rm, int shift) 
+{
+    return (1u << 31) |            /* 64-bit */
+            (0u << 30) |            /* ADD opcode */
+            (0x0Bu << 24) |         /* shifted register form */
+            (0u << 22) |            /* LSL */
+            (rm << 16) |            /* shifted source register */
+            ((shift & 0x3F) << 10) | /* 6-bit shift amount */
+            (rn << 5) |             /* first source register */
+            rd;                     /* destination register */
+}
+
+uint32_t encode_sub_shift(int rd, int rn, int rm, int shift) 
+{
+    return (1u << 31) |            /* 64-bit */
+            (1u << 30) |            /* SUB opcode */
+            (0x0Bu << 24) |         /* shifted register form */
+            (0u << 22) |            /* LSL */
+            (rm << 16) |            /* shifted source register */
+            ((shift & 0x3F) << 10) | /* 6-bit shift amount */
+            (rn << 5) |             /* first source register */
+            rd;                     /* destination register */
+}
+
+/* LSL is an alias of UBFM Xd, Xn, #(-shift mod 64), #(63 - shift) */
+uint32_t encode_lsl(int rd, int rn, int shift) 
+{
+    return (1u << 31) |                    /* 64-bit */
+            (0x2u << 29) |                  /* UBFM opcode */
+            (0x26u << 23) |                 /* bitfield fixed bits */
+            (1u << 22) |                    /* N=1 for 64-bit */
+            (((64 - shift) & 0x3F) << 16) | /* immr */
+            ((63 - shift) << 10) |          /* imms */
+            (rn << 5) |                     /* source register */
+            rd;                             /* destination register */
+}
+
+uint32_t encode_madd(int rd, int rn, int rm, int ra) 
+{
+    return (1u << 31) |    /* 64-bit */
+            (0x1Bu << 24) | /* data processing 3 source */
+            (rm << 16) |    /* multiplier */
+            (0u << 15) |    /* o0=0 for MADD */
+            (ra << 10) |    /* addend */
+            (rn << 5) |     /* multiplicand */
+            rd;             /* destination register */
+}
+
+uint32_t encode_msub(int rd, int rn, int rm, int ra) 
+{
+    return (1u << 31) |    /* 64-bit */
+            (0x1Bu << 24) | /* data processing 3 source */
+            (rm << 16) |    /* multiplier */
+            (1u << 15) |    /* o0=1 for MSUB */
+            (ra << 10) |    /* minuend */
+            (rn << 5) |     /* multiplicand */
+            rd;             /* destination register */
+}
+
+uint32_t encode_mul(int rd, int rn, int rm) 
+{
+    return encode_madd(rd, rn, rm, 31); /* MUL is MADD with XZR as the addend */
+}
+
 uint32_t encode_cbz(int rt, int32_t offset) 
 {
     /* offset is in bytes * needs to be word aligned */
@@ -99,6 +242,18 @@ uint32_t encode_b(int32_t offset)
             imm26;         /* 26-bit offset */
 }
 
+uint32_t encode_bl(int32_t offset) 
+{
+    int32_t imm26 = (offset / 4) & 0x3FFFFFF;
+    return  (0x25u << 26) | /* BL opcode; like B but links x30 */
+            imm26;          /* 26-bit offset */
+}
+
+uint32_t encode_nop()
+{
+    return 0xD503201F; /* HINT #0 */
+}
+
 uint32_t encode_svc(uint16_t imm) 
 {
     return (0xD4u << 24) |         /* SVC opcode */
@@ -106,6 +261,25 @@ uint32_t encode_svc(uint16_t imm)
             0x1;                    /* fixed bits */
 }
 
+uint32_t encode_uxtb(int rd, int rn)
+{
+    return  (0x2u << 29) |  /* 32-bit UBFM; writing Wd zeroes the upper half */
+            (0x26u << 23) | /* bitfield fixed bits */
+            (7u << 10) |    /* imms = 7, immr = 0: keep bits 0-7 */
+            (rn << 5) |     /* source register */
+            rd;             /* destination register */
+}
+
+uint32_t encode_movz(int rd, uint16_t imm, int shift) 
+{
+    return  (1u << 31) |    /* 64-bit */
+            (0x2u << 29) |  /* MOVZ opcode */
+            (0x25u << 23) | /* fixed bits */
+            (shift << 21) | /* shift amount in 16-bit steps */
+            (imm << 5) |    /* 16-bit immediate */
+            rd;             /* destination register */
+}
+
 uint32_t encode_movk(int rd, uint16_t imm, int shift) 
 {
     return  (1u << 31) |    /* 64-bit */
@@ -121,6 +295,11 @@ uint32_t encode_ret()
     return 0xD65F03C0; /* RET instruction */ 
 }
 
+uint32_t encode_blr(int rn)
+{
+    return 0xD63F0000 | (rn << 5); /* BLR; call the address in rn, linking x30 */
+}
+
 uint32_t encode_stur(int rt, int rn, int offset) 
 {
     return (0x3u << 30) |             /* size=64-bit */
@@ -174,14 +353,13 @@ uint32_t encode_ldp(int rt, int rt2, int rn, int imm)
 uint32_t encode_stp_pre(int rt, int rt2, int rn, int imm) 
 {
     int opc = 2;
-    int op2 = 3;
     int L = 0;
     int imm7 = (imm / 8) & 0x7F;
 
     return (opc << 30) |        /* opc=2 for 64-bit */
-           (0xA << 24) |        /* fixed pattern */
-           (op2 << 22) |        /* op2=3 for pre-indexed */
-           (L << 21) |          /* L=0 for store */
+           (0x5 << 27) |        /* fixed pattern */
+           (0x3 << 23) |        /* 3 = pre-indexed */
+           (L << 22) |          /* L=0 for store */
            ((imm7 & 0x7F) << 15) | /* 7-bit immediate */
            (rt2 << 10) |        /* second register */
            (rn << 5) |          /* base register */
@@ -191,16 +369,197 @@ uint32_t encode_stp_pre(int rt, int rt2, int rn, int imm)
 uint32_t encode_ldp_post(int rt, int rt2, int rn, int imm) 
 {
     int opc = 2;
-    int op2 = 1;
     int L = 1;
     int imm7 = (imm / 8) & 0x7F;
     
     return (opc << 30) |        /* opc=2 for 64-bit */
-           (0xA << 24) |        /* fixed pattern */
-           (op2 << 22) |        /* op2=1 for post-indexed */
-           (L << 21) |          /* L=1 for load */
+           (0x5 << 27) |        /* fixed pattern */
+           (0x1 << 23) |        /* 1 = post-indexed */
+           (L << 22) |          /* L=1 for load */
            ((imm7 & 0x7F) << 15) | /* 7-bit immediate */
            (rt2 << 10) |        /* second register */
            (rn << 5) |          /* base register */
            rt;                  /* first register */
-}
\ No newline at end of file
+}
+
+uint32_t encode_strb_post(int rt, int rn, int offset) 
+{
+    return (0x38u << 24) |            /* STRB (immediate), size=00 */
+            ((offset & 0x1FF) << 12) | /* 9-bit signed offset */
+            (0x1u << 10) |             /* post-indexed: rn += offset after the store */
+            (rn << 5) |                /* base register */
+            rt;                        /* source register */
+}
+
+uint32_t encode_ldrb_post(int rt, int rn, int offset) 
+{
+    return (0x38u << 24) |            /* LDRB (immediate), size=00 */
+            (0x1u << 22) |             /* load */
+            ((offset & 0x1FF) << 12) | /* 9-bit signed offset */
+            (0x1u << 10) |             /* post-indexed: rn += offset after the load */
+            (rn << 5) |                /* base register */
+            rt;                        /* target register */
+}
+
+uint32_t encode_cmp_reg(int rn, int rm) 
+{
+    return (0xEBu << 24) | /* SUBS 64-bit, shifted register */
+            (rm << 16) |    /* second operand */
+            (rn << 5) |     /* first operand */
+            31;             /* discard the result (XZR) */
+}
+
+uint32_t encode_cmp_imm(int rn, int imm) 
+{
+    return (0xF1u << 24) |          /* SUBS 64-bit, immediate */
+            ((imm & 0xFFF) << 10) |  /* 12-bit immediate */
+            (rn << 5) |              /* first operand */
+            31;                      /* discard the result (XZR) */
+}
+
+uint32_t encode_b_cond(int cond, int32_t offset) 
+{
+    int32_t imm19 = (offset / 4) & 0x7FFFF;
+    return (0x54u << 24) | /* B.cond */
+            (imm19 << 5) |  /* 19-bit offset */
+            (cond & 0xF);   /* condition */
+}
+
+uint32_t encode_adr(int rd, int32_t offset) 
+{
+    return ((offset & 0x3u) << 29) |           /* immlo: low 2 bits of the offset */
+            (0x10u << 24) |                    /* ADR */
+            (((offset >> 2) & 0x7FFFF) << 5) | /* immhi: the rest */
+            rd;                                /* destination register */
+}
+
+uint32_t encode_lsr(int rd, int rn, int shift) 
+{
+    return (1u << 31) |             /* 64-bit */
+            (0x2u << 29) |           /* UBFM opcode */
+            (0x26u << 23) |          /* bitfield fixed bits */
+            (1u << 22) |             /* N=1 for 64-bit */
+            ((shift & 0x3F) << 16) | /* immr */
+            (63u << 10) |            /* imms */
+            (rn << 5) |              /* source register */
+            rd;                      /* destination register */
+}
+
+uint32_t encode_and_reg(int rd, int rn, int rm) 
+{
+    return (0x8Au << 24) | /* AND 64-bit, shifted register */
+            (rm << 16) |    /* second operand */
+            (rn << 5) |     /* first operand */
+            rd;             /* destination register */
+}
+
+uint32_t encode_bic_reg(int rd, int rn, int rm) 
+{
+    return (0x8Au << 24) | /* AND 64-bit, shifted register */
+            (1u << 21) |    /* N: invert the second operand */
+            (rm << 16) |    /* second operand */
+            (rn << 5) |     /* first operand */
+            rd;             /* destination register */
+}
+
+uint32_t encode_rbit(int rd, int rn) 
+{
+    return 0xDAC00000u | /* RBIT 64-bit */
+            (rn << 5) |
+            rd;
+}
+
+uint32_t encode_clz(int rd, int rn) 
+{
+    return 0xDAC01000u | /* CLZ 64-bit */
+            (rn << 5) |
+            rd;
+}
+
+uint32_t encode_ldr_q(int qt, int rn, int offset) 
+{
+    return 0x3DC00000u |                     /* LDR (immediate, SIMD&FP), 128-bit */
+            (((offset / 16) & 0xFFF) << 10) | /* 12-bit offset, scaled by 16 */
+            (rn << 5) |                       /* base register */
+            qt;                               /* target register */
+}
+
+uint32_t encode_ldur_q(int qt, int rn, int offset) 
+{
+    return 0x3CC00000u |              /* LDUR (SIMD&FP), 128-bit */
+            ((offset & 0x1FF) << 12) | /* 9-bit signed offset */
+            (rn << 5) |                /* base register */
+            qt;                        /* target register */
+}
+
+uint32_t encode_cmeq_zero_16b(int vd, int vn) 
+{
+    return 0x4E209800u | /* CMEQ (zero), Q=1, size=00 */
+            (vn << 5) |
+            vd;
+}
+
+uint32_t encode_shrn_8b(int vd, int vn, int shift) 
+{
+    return 0x0F008400u |          /* SHRN, Q=0 */
+            ((16 - shift) << 16) | /* immh:immb; immh = 0001 picks 16-bit source lanes */
+            (vn << 5) |
+            vd;
+}
+
+uint32_t encode_umov_d0(int rd, int vn) 
+{
+    return 0x4E083C00u | /* UMOV Xd, Vn.D[0] */
+            (vn << 5) |
+            rd;
+}
+
+uint32_t encode_ldr_vec(int vt, int rn, int offset, int size) 
+{
+    return (size == 16 ? 0x3DC00000u : 0xFD400000u) | /* LDR (immediate, SIMD&FP), Q or D */
+            (((offset / size) & 0xFFF) << 10) |        /* 12-bit offset, scaled by the size */
+            (rn << 5) |                                /* base register */
+            vt;                                        /* target register */
+}
+
+uint32_t encode_str_vec(int vt, int rn, int offset, int size) 
+{
+    return (size == 16 ? 0x3D800000u : 0xFD000000u) | /* STR (immediate, SIMD&FP), Q or D */
+            (((offset / size) & 0xFFF) << 10) |        /* 12-bit offset, scaled by the size */
+            (rn << 5) |                                /* base register */
+            vt;                                        /* source register */
+}
+
+uint32_t encode_ldur_vec(int vt, int rn, int offset, int size) 
+{
+    return (size == 16 ? 0x3CC00000u : 0xFC400000u) | /* LDUR (SIMD&FP), Q or D */
+            ((offset & 0x1FF) << 12) |                 /* 9-bit signed offset */
+            (rn << 5) |                                /* base register */
+            vt;                                        /* target register */
+}
+
+uint32_t encode_stur_vec(int vt, int rn, int offset, int size) 
+{
+    return (size == 16 ? 0x3C800000u : 0xFC000000u) | /* STUR (SIMD&FP), Q or D */
+            ((offset & 0x1FF) << 12) |                 /* 9-bit signed offset */
+            (rn << 5) |                                /* base register */
+            vt;                                        /* source register */
+}
+
+uint32_t encode_add_vec(int vd, int vn, int vm, int size) 
+{
+    return 0x0E208400u |                     /* ADD (vector), size=00: byte lanes */
+            ((size == 16 ? 1u : 0u) << 30) | /* Q: 16 lanes rather than 8 */
+            (vm << 16) |
+            (vn << 5) |
+            vd;
+}
+
+uint32_t encode_and_vec(int vd, int vn, int vm, int size) 
+{
+    return 0x0E201C00u |                     /* AND (vector) */
+            ((size == 16 ? 1u : 0u) << 30) | /* Q: all 128 bits rather than 64 */
+            (vm << 16) |
+            (vn << 5) |
+            vd;
+}
@@ -7,6 +7,10 @@ uint32_t encode_add_imm(int rd, int rn, int imm); /* ADD immediate 64-bit */
 
 uint32_t encode_sub_imm(int rd, int rn, int imm); /* SUB immediate */
 
+uint32_t encode_add_imm_lsl12(int rd, int rn, int imm); /* ADD Xd, Xn, #imm, LSL #12 */
+
+uint32_t encode_sub_imm_lsl12(int rd, int rn, int imm); /* SUB Xd, Xn, #imm, LSL #12 */
+
 uint32_t encode_mov_imm(int rd, uint16_t imm); /* MOV immediate */
 
 uint32_t encode_mov_reg(int rd, int rn); /* MOV register */
@@ -17,18 +21,54 @@ uint32_t encode_strb(int rt, int rn); /* store byte */
 
 uint32_t encode_strb_offset(int rt, int rn, int offset); /* store byte with 12-bit unsigned offset */
 
+uint32_t encode_ldrb_offset(int rt, int rn, int offset); /* load byte with 12-bit unsigned offset */
+
+uint32_t encode_ldr_x(int rt, int rn, int offset); /* load 64 bits, unsigned offset (multiple of 8) */
+
+uint32_t encode_str_x(int rt, int rn, int offset); /* store 64 bits, unsigned offset (multiple of 8) */
+
+uint32_t encode_ldurb(int rt, int rn, int offset); /* load byte with 9-bit signed offset */
+
+uint32_t encode_sturb(int rt, int rn, int offset); /* store byte with 9-bit signed offset */
+
+uint32_t encode_add_reg(int rd, int rn, int rm); /* ADD register 64-bit */
+
+uint32_t encode_sub_reg(int rd, int rn, int rm); /* SUB register 64-bit */
+
+uint32_t encode_add_shift(int rd, int rn, int rm, int shift); /* ADD Xd, Xn, Xm, LSL #shift */
+
+uint32_t encode_sub_shift(int rd, int rn, int rm, int shift); /* SUB Xd, Xn, Xm, LSL #shift */
+
+uint32_t encode_lsl(int rd, int rn, int shift); /* LSL immediate */
+
+uint32_t encode_uxtb(int rd, int rn); /* zero-extend the low byte: Xd = Xn & 0xFF */
+
+uint32_t encode_mul(int rd, int rn, int rm); /* Xd = Xn * Xm */
+
+uint32_t encode_madd(int rd, int rn, int rm, int ra); /* Xd = Xa + Xn * Xm */
+
+uint32_t encode_msub(int rd, int rn, int rm, int ra); /* Xd = Xa - Xn * Xm */
+
 uint32_t encode_cbz(int rt, int32_t offset); /* compare and branch if zero */
 
 uint32_t encode_cbnz(int rt, int32_t offset); /* compare and branch if not zero */
 
 uint32_t encode_b(int32_t offset); /* unconditional branch */
 
+uint32_t encode_bl(int32_t offset); /* branch with link */
+
 uint32_t encode_svc(uint16_t imm); /* supervisor call */
 
+uint32_t encode_nop(); /* no operation; used for alignment padding */
+
+uint32_t encode_movz(int rd, uint16_t imm, int shift); /* imm 16-bit mov to register, zeroing the rest */
+
 uint32_t encode_movk(int rd, uint16_t imm, int shift); /* imm 16-bit mov to register with keep */
 
 uint32_t encode_ret(); /* return from subroutine */
 
+uint32_t encode_blr(int rn); /* call through a register */
+
 uint32_t encode_stur(int rt, int rn, int offset); /* stor register (unscaled offset) */
 
 uint32_t encode_ldur(int rt, int rn, int offset);
@@ -39,4 +79,57 @@ uint32_t encode_ldp(int rt, int rt2, int rn, int imm);
 
 uint32_t encode_stp_pre(int rt, int rt2, int rn, int imm); /* pre-indexed */
 
-uint32_t encode_ldp_post(int rt, int rt2, int rn, int imm); /* post-indexed */
\ No newline at end of file
+uint32_t encode_ldp_post(int rt, int rt2, int rn, int imm); /* post-indexed */
+
+uint32_t encode_strb_post(int rt, int rn, int offset); /* store byte, then rn += offset */
+
+uint32_t encode_ldrb_post(int rt, int rn, int offset); /* load byte, then rn += offset */
+
+uint32_t encode_cmp_reg(int rn, int rm); /* CMP Xn, Xm */
+
+uint32_t encode_cmp_imm(int rn, int imm); /* CMP Xn, #imm */
+
+uint32_t encode_b_cond(int cond, int32_t offset); /* conditional branch */
+
+uint32_t encode_adr(int rd, int32_t offset); /* Xd = pc + offset, within +/-1 MB */
+
+uint32_t encode_lsr(int rd, int rn, int shift); /* LSR immediate */
+
+uint32_t encode_and_reg(int rd, int rn, int rm); /* Xd = Xn & Xm */
+
+uint32_t encode_bic_reg(int rd, int rn, int rm); /* Xd = Xn & ~Xm */
+
+uint32_t encode_rbit(int rd, int rn); /* reverse the bits of Xn */
+
+uint32_t encode_clz(int rd, int rn); /* count leading zeros of Xn */
+
+/* AdvSIMD; vector registers are numbered like the general ones */
+uint32_t encode_ldr_q(int qt, int rn, int offset); /* 128-bit load, unsigned offset (multiple of 16) */
+
+uint32_t encode_ldur_q(int qt, int rn, int offset); /* 128-bit load, 9-bit signed offset */
+
+uint32_t encode_cmeq_zero_16b(int vd, int vn); /* Vd.16B = (Vn.16B == 0) ? 0xFF : 0 */
+
+uint32_t encode_shrn_8b(int vd, int vn, int shift); /* Vd.8B = Vn.8H >> shift, narrowed */
+
+uint32_t encode_umov_d0(int rd, int vn); /* Xd = Vn.D[0] */
+
+/* 8-byte (D) or 16-byte (Q) forms, picked by `size` */
+uint32_t encode_ldr_vec(int vt, int rn, int offset, int size); /* load, unsigned offset (multiple of size) */
+
+uint32_t encode_str_vec(int vt, int rn, int offset, int size); /* store, unsigned offset (multiple of size) */
+
+uint32_t encode_ldur_vec(int vt, int rn, int offset, int size); /* load, 9-bit signed offset */
+
+uint32_t encode_stur_vec(int vt, int rn, int offset, int size); /* store, 9-bit signed offset */
+
+uint32_t encode_add_vec(int vd, int vn, int vm, int size); /* Vd.B = Vn.B + Vm.B, per byte */
+
+uint32_t encode_and_vec(int vd, int vn, int vm, int size); /* Vd.B = Vn.B & Vm.B */
+
+/* condition codes for encode_b_cond */
+#define ARM64_COND_EQ 0x0
+#define ARM64_COND_NE 0x1
+#define ARM64_COND_CS 0x2 /* carry set; XNU flags a failed syscall this way */
+#define ARM64_COND_LT 0xB
+#define ARM64_COND_LE 0xD
\ No newline at end of file
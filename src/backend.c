@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bfc.h"
+
+/* every backend consumes the same IR; --target picks one by name */
+static const Backend backends[] = {
+    { "arm64-darwin", TARGET_ARM64_DARWIN, codegen_arm64 },
+    { "arm64-linux", TARGET_ARM64_LINUX, codegen_arm64 },
+    { "x86_64-linux", TARGET_X86_64_LINUX, codegen_x86_64 },
+};
+
+#define BACKEND_COUNT (sizeof(backends) / sizeof(backends[0]))
+
+const Backend* find_backend(const char* name)
+{
+    for (size_t i = 0; i < BACKEND_COUNT; i++)
+    {
+        if (strcmp(backends[i].name, name) == 0)
+            return &backends[i];
+    }
+    return NULL;
+}
+
+const Backend* get_backend(Target target)
+{
+    for (size_t i = 0; i < BACKEND_COUNT; i++)
+    {
+        if (backends[i].target == target)
+            return &backends[i];
+    }
+    return NULL;
+}
+
+Target host_target()
+{
+#if defined(__x86_64__)
+    return TARGET_X86_64_LINUX;
+#elif defined(__APPLE__)
+    return TARGET_ARM64_DARWIN;
+#else
+    return TARGET_ARM64_LINUX;
+#endif
+}
+
+void default_codegen_options(CodegenOptions* options)
+{
+    options->target = host_target();
+    options->rotate_loops = true;
+    options->loop_align = 0;
+    options->buffered_output = true;
+    options->buffered_input = true;
+    options->eof_mode = BF_EOF_UNCHANGED;
+    options->vector_scans = true;
+    options->vector_updates = true;
+    options->return_ptr = false;
+    options->profile = false;
+    options->hosted_io = false;
+}
+
+#define PROFILE_HOT_ALIGN 16 /* loop head alignment for hot loops when --align-loops is not given */
+
+int loop_align_for(const IRProgram* program, int loop_id, const CodegenOptions* options)
+{
+    if (loop_id < 0)
+        return options->loop_align;
+
+    switch (program->loops[loop_id].heat)
+    {
+        case LOOP_HOT:
+            return options->loop_align ? options->loop_align : PROFILE_HOT_ALIGN;
+        case LOOP_COLD:
+            return 0;
+        default:
+            return options->loop_align;
+    }
+}
+
+bool loop_is_cold(const IRProgram* program, int loop_id)
+{
+    return loop_id >= 0 && program->loops[loop_id].heat == LOOP_COLD;
+}
+
+#define GROUP_MIN_CELLS 4 /* cells an IR_UPDATE_VEC has to cover to pay for its constants */
+
+/* one constant update of one cell; `index` keeps program order among updates of the same cell */
+typedef struct
+{
+    int offset;
+    size_t index;
+} CellUpdate;
+
+/* the net effect of a block on one cell: cell = (set ? 0 : cell) + value */
+typedef struct
+{
+    int offset;
+    bool set;
+    uint8_t value;
+} CellEffect;
+
+static bool is_cell_update(IROptype type)
+{
+    return type == IR_VAL_ADD || type == IR_VAL_SUB || type == IR_SET_ZERO || type == IR_SET_VAL;
+}
+
+static int compare_updates(const void* a, const void* b)
+{
+    const CellUpdate* x = a;
+    const CellUpdate* y = b;
+    if (x->offset != y->offset)
+        return x->offset < y->offset ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* write the next op of a rebuilt block into `*slot` */
+static void emit_block_op(IRProgram* program, size_t* slot, IROptype type, int value, int offset, int src)
+{
+    IROperation* op = &program->ops[(*slot)++];
+    ir_set_op(op, type, value, offset, -1);
+    op->src = src;
+    program->count++;
+}
+
+/* a block of constant updates, ops [first, end); cells whose offsets fall within 8 or 16 bytes of
+ * each other, at least GROUP_MIN_CELLS of them, become one IR_UPDATE_VEC. The updates commute
+ * across cells, so the block is rebuilt in offset order, with one op per vector or leftover cell */
+static void group_block(IRProgram* program, size_t first, size_t end, CellUpdate* updates, CellEffect* effects)
+{
+    size_t n = 0;
+    for (size_t i = first; i < end; i++)
+    {
+        if (program->ops[i].type != IR_NOP)
+            updates[n++] = (CellUpdate){ program->ops[i].offset, i };
+    }
+    if (n < GROUP_MIN_CELLS)
+        return;
+    qsort(updates, n, sizeof(CellUpdate), compare_updates);
+
+    size_t cells = 0;
+    for (size_t u = 0; u < n; u++)
+    {
+        if (cells == 0 || effects[cells - 1].offset != updates[u].offset)
+            effects[cells++] = (CellEffect){ updates[u].offset, false, 0 };
+
+        CellEffect* effect = &effects[cells - 1];
+        IROperation* op = &program->ops[updates[u].index];
+        if (op->type == IR_VAL_ADD)
+            effect->value += (uint8_t)op->value;
+        else if (op->type == IR_VAL_SUB)
+            effect->value -= (uint8_t)op->value;
+        else
+        {
+            effect->set = true;
+            effect->value = op->type == IR_SET_VAL ? (uint8_t)op->value : 0;
+        }
+    }
+
+    /* leave blocks that would not get a vector alone, rather than reorder them for nothing */
+    bool grouped = false;
+    for (size_t c = 0; c + GROUP_MIN_CELLS <= cells && !grouped; c++)
+        grouped = effects[c + GROUP_MIN_CELLS - 1].offset - effects[c].offset < 16;
+    if (!grouped)
+        return;
+
+    for (size_t i = first; i < end; i++)
+        ir_remove(program, i);
+
+    size_t slot = first;
+    for (size_t c = 0; c < cells;)
+    {
+        int low = effects[c].offset;
+        size_t in8 = 0, in16 = 0;
+        while (c + in16 < cells && effects[c + in16].offset - low < 16)
+        {
+            in8 += effects[c + in16].offset - low < 8;
+            in16++;
+        }
+
+        if (in16 >= GROUP_MIN_CELLS)
+        {
+            int width = in8 == in16 ? 8 : 16;
+            uint8_t lanes[32]; /* add bytes, then keep bytes */
+            memset(lanes, 0, (size_t)width);
+            memset(lanes + width, 0xFF, (size_t)width);
+            for (size_t k = 0; k < in16; k++)
+            {
+                int lane = effects[c + k].offset - low;
+                lanes[lane] = effects[c + k].value;
+                lanes[width + lane] = effects[c + k].set ? 0 : 0xFF;
+            }
+
+            int src = ir_add_string(program, lanes, (size_t)(2 * width));
+            if (src >= 0)
+            {
+                emit_block_op(program, &slot, IR_UPDATE_VEC, width, low, src);
+                c += in16;
+                continue;
+            }
+        }
+
+        CellEffect* effect = &effects[c++];
+        if (effect->set)
+            emit_block_op(program, &slot, effect->value ? IR_SET_VAL : IR_SET_ZERO, effect->value, effect->offset, 0);
+        else if (effect->value != 0)
+            emit_block_op(program, &slot, IR_VAL_ADD, effect->value, effect->offset, 0);
+    }
+}
+
+/* lowering for the vector backends: runs of constant adds and sets on nearby cells, like a table
+ * initializer, turn into IR_UPDATE_VEC ops that load, update and store 8 or 16 cells at once */
+static void group_cell_updates(IRProgram* program)
+{
+    CellUpdate* updates = malloc((program->size + 1) * sizeof(CellUpdate));
+    CellEffect* effects = malloc((program->size + 1) * sizeof(CellEffect));
+    if (!updates || !effects) /* the updates just stay scalar */
+    {
+        free(updates);
+        free(effects);
+        return;
+    }
+
+    int loop_id = -1; /* innermost loop around op i */
+    for (size_t i = 0; i < program->size;)
+    {
+        const IROperation* op = &program->ops[i];
+        if (!is_cell_update(op->type))
+        {
+            if (op->type == IR_LOOP_START)
+                loop_id = op->loop_id;
+            else if (op->type == IR_LOOP_END)
+                loop_id = program->loops[op->loop_id].parent;
+            i++;
+            continue;
+        }
+
+        size_t end = i;
+        while (end < program->size && (is_cell_update(program->ops[end].type) || program->ops[end].type == IR_NOP))
+            end++;
+        if (!loop_is_cold(program, loop_id)) /* the constants cost more bytes than the scalar code */
+            group_block(program, i, end, updates, effects);
+        i = end;
+    }
+
+    free(updates);
+    free(effects);
+    ir_compact(program);
+}
+
+CodeBuffer* codegen(IRProgram* program, const CodegenOptions* options)
+{
+    CodegenOptions defaults;
+    if (!options)
+    {
+        default_codegen_options(&defaults);
+        options = &defaults;
+    }
+
+    const Backend* backend = get_backend(options->target);
+    if (!backend)
+    {
+        fprintf(stderr, "No backend for target %d\n", (int)options->target);
+        return NULL;
+    }
+    if (options->hosted_io && (!options->buffered_output || !options->buffered_input))
+    {
+        fprintf(stderr, "Hosted I/O needs buffered input and output\n");
+        return NULL;
+    }
+    if (!program || !options->vector_updates)
+        return backend->codegen(program, options);
+
+    /* the caller's IR may be generated again or reused (the tier, the cache, -v statistics), so the
+     * grouping rewrites a copy */
+    IRProgram* lowered = copy_ir_program(program);
+    if (!lowered)
+        return NULL;
+    group_cell_updates(lowered);
+    CodeBuffer* code = backend->codegen(lowered, options);
+    free_ir_program(lowered);
+    return code;
+}
+
+CodeBuffer* create_code_buffer(size_t capacity)
+{
+    CodeBuffer* buf = malloc(sizeof(CodeBuffer));
+    if (!buf)
+        return NULL;
+
+    buf->code = malloc(capacity);
+    if (!buf->code)
+    {
+        free(buf);
+        return NULL;
+    }
+
+    buf->capacity = capacity;
+    buf->size = 0;
+    buf->text_size = 0;
+    return buf;
+}
+
+void finish_code_buffer(CodeBuffer* buf)
+{
+    buf->text_size = buf->size;
+}
+
+void free_code_buffer(CodeBuffer* buf)
+{
+    if (buf)
+    {
+        if (buf->code)
+            free(buf->code);
+        free(buf);
+    }
+}
+
+void emit_bytes(CodeBuffer* buf, const void* bytes, size_t count)
+{
+    if (buf->size + count > buf->capacity) /* resize if bigger */
+    {
+        size_t new_capacity = buf->capacity * 2;
+        while (new_capacity < buf->size + count)
+            new_capacity *= 2;
+
+        uint8_t* new_code = realloc(buf->code, new_capacity);
+        if (!new_code)
+        {
+            fprintf(stderr, "Failed to expand code buffer\n");
+            exit(1);
+        }
+
+        buf->code = new_code;
+        buf->capacity = new_capacity;
+    }
+
+    memcpy(buf->code + buf->size, bytes, count);
+    buf->size += count;
+}
+
+void emit_byte(CodeBuffer* buf, uint8_t byte)
+{
+    emit_bytes(buf, &byte, 1);
+}
+
+/* little-endian, like both of our targets */
+void emit_u32(CodeBuffer* buf, uint32_t value)
+{
+    uint8_t bytes[4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24 };
+    emit_bytes(buf, bytes, sizeof(bytes));
+}
+
+uint32_t read_u32(const CodeBuffer* buf, size_t pos)
+{
+    const uint8_t* p = buf->code + pos;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void write_u32(CodeBuffer* buf, size_t pos, uint32_t value)
+{
+    uint8_t* p = buf->code + pos;
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = value >> 24;
+}
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+#define BFC_VERSION "0.9" /* part of the JIT cache key, next to a hash of the sources (see jitcache.c) */
+
 typedef enum
 {
     TOK_PTR_INC, /* > */
@@ -46,37 +49,152 @@ typedef enum
      * we will get these from doing the first pass */
     IR_SET_ZERO, /* set current cell to zero*/
     IR_SET_VAL, /* set current cell to constant value */
-    IR_ADD_MUL, /* add multiple cell[pt r +offset] += cell[ptr] * factor */
-    IR_MOVE_VAL, /* move value; cell[ptr + offset] += cell[ptr], cell[ptr] = 0 */
+    IR_ADD_MUL, /* add multiple cell[ptr + offset] += cell[ptr + src] * factor */
+    IR_MOVE_VAL, /* move value; cell[ptr + offset] += cell[ptr + src] * factor, cell[ptr + src] = 0 */
     IR_SCAN_ZERO, /* scan for zero; ptr += offset until cell[ptr] == 0 */
     IR_SCAN_NONZERO, /* scan for non-zero; ptr += offset until cell[ptr] != 0 */
-    IR_CONDITIONAL /* conditional operation based on current cell */
+    IR_CONDITIONAL, /* conditional operation based on current cell */
+    IR_OUTPUT_STR, /* output `value` bytes of the string pool, starting at `src` */
+    IR_UPDATE_VEC, /* cells [offset, offset + value) = (cell & keep) + add, per byte; `value` is 8 or 16 and
+                    * the add bytes, then the keep bytes, sit in the string pool at `src`. Made by codegen, in its own copy of the IR */
+    IR_NOP /* tombstone left behind by a rewrite; dropped by ir_compact */
 } IROptype;
 
+/* every op that touches memory addresses its cell as ptr + offset, where ptr is the
+ * pointer as of the last pointer op; optimize_offsets folds pointer moves into these */
 typedef struct IROperation
 {
     IROptype type;
     int value; /* value for operations; +/- amount, etc. */
-    int offset; /* memory offset for operations that reference other cells */
+    int offset; /* cell offset from the pointer; the written cell for ADD_MUL/MOVE_VAL */
+    int src; /* offset of the cell read by ADD_MUL/MOVE_VAL; string pool offset for OUTPUT_STR/UPDATE_VEC */
     int loop_id; /* for loop start/end matching */
-    struct IROperation* next; /* linked list; not the most efficient solution but this should do */
 } IROperation;
 
+/* how often a loop ran in the --profile-use profile */
+typedef enum
+{
+    LOOP_UNPROFILED, /* no profile, or the loop is not in it */
+    LOOP_HOT,        /* a large share of all loop iterations */
+    LOOP_COLD,       /* never reached */
+} LoopHeat;
+
+/* one node of the loop tree; indexed by the loop_id of its IR_LOOP_START/IR_LOOP_END pair.
+ * the body of a loop is ops (start, end), so passes can look at a loop without rescanning */
 typedef struct
 {
-    IROperation* first;
-    IROperation* last;
-    size_t count;
+    size_t start; /* index of the IR_LOOP_START op */
+    size_t end; /* index of the matching IR_LOOP_END op */
+    int parent; /* loop_id of the enclosing loop; -1 at top level */
+    int depth; /* nesting depth; 0 at top level */
+    int children; /* number of live loops directly inside this one */
+    size_t pos; /* source position of the opening bracket */
+    bool live; /* false once a pass has rewritten the loop away */
+    LoopHeat heat; /* set by profile_apply */
+} IRLoop;
+
+/* the IR lives in one contiguous array; passes delete by turning ops into
+ * IR_NOP tombstones (O(1)) and squeeze them out with ir_compact once they are done */
+typedef struct
+{
+    IROperation* ops; /* op storage; slots [0, size) are in use */
+    size_t size; /* used slots, tombstones included */
+    size_t capacity; /* allocated slots */
+    size_t count; /* live (non-tombstone) operations */
+
+    IRLoop* loops; /* loop tree, indexed by loop_id */
+    size_t loop_count;
+    size_t loop_capacity;
+    int max_depth; /* deepest nesting seen; an upper bound once loops are rewritten away */
+
+    uint8_t* strings; /* read-only data: constant output for IR_OUTPUT_STR, lane constants for IR_UPDATE_VEC */
+    size_t string_size;
 } IRProgram;
 
+#define BF_TAPE_SIZE 30000 /* cells; shared by the JIT and the ELF .bss */
+#define BF_TAPE_PAD 4096   /* zeroed slack on each side, for programs that stray just past either end */
+#define BF_OUT_BUFFER 65536 /* bytes of output gathered before a write syscall */
+#define BF_IN_BUFFER 65536  /* bytes asked for per read syscall when stdin cannot be mapped */
+
+typedef struct BFIO BFIO;
+
+/* CodegenOptions.hosted_io: I/O goes through the embedder instead of syscalls. The code loads both
+ * ranges on entry, writes output straight into [out_ptr, out_end) and reads input straight from
+ * [in_ptr, in_end). When the output range is full, before input and at exit it stores out_ptr and
+ * calls flush; when the input range is empty it calls refill. Either may move both ranges */
 typedef struct
 {
-    uint32_t* code;
+    uint8_t* out_ptr;
+    uint8_t* out_end;
+    const uint8_t* in_ptr;
+    const uint8_t* in_end;
+    void (*flush)(BFIO* io);
+    void (*refill)(BFIO* io); /* at end of input, point the range at eof_cell */
+    void* user;
+} BFHost;
+
+/* runtime I/O state; generated code gets a pointer to it as its second argument, next to the
+ * tape. The JIT context owns one, and ELF executables keep theirs in .bss behind the tape;
+ * either way it starts out zeroed */
+struct BFIO
+{
+    uint8_t out[BF_OUT_BUFFER]; /* pending output; flushed when full, before blocking on input and at exit */
+    uint8_t in[BF_IN_BUFFER];   /* read buffer for stdin that is not a regular file */
+    uint8_t in_probed;          /* stdin has been checked for mmap */
+    uint8_t eof_cell;           /* what ',' reads once stdin is exhausted */
+    uint64_t* profile;          /* --profile-generate: two counters per loop_id, see CodegenOptions.profile */
+    BFHost host;                /* hosted_io only */
+};
+
+/* what ',' leaves in the cell at end of input */
+typedef enum
+{
+    BF_EOF_UNCHANGED, /* the cell keeps its value */
+    BF_EOF_ZERO,
+    BF_EOF_MINUS_ONE, /* 255 */
+} EofMode;
+
+typedef struct
+{
+    uint8_t* code;    /* machine code; arm64 words are stored little-endian */
     size_t capacity;
-    size_t size;
+    size_t size;      /* in bytes: the instructions, then any read-only data */
+    size_t text_size; /* bytes of instructions; set by finish_code_buffer */
 } CodeBuffer;
 
-/* in frontend.c */
+typedef enum
+{
+    TARGET_ARM64_DARWIN, /* XNU syscalls through svc #0x80 */
+    TARGET_ARM64_LINUX,
+    TARGET_X86_64_LINUX,
+} Target;
+
+typedef struct
+{
+    Target target;
+    bool rotate_loops; /* one guard, then a body closed by a single bottom test */
+    int loop_align;    /* pad hot loop heads to this many bytes with nops; 0 = off */
+    bool buffered_output; /* '.' appends to BFIO.out; otherwise one write syscall per byte */
+    bool buffered_input;  /* ',' reads from mapped or buffered stdin; otherwise one read syscall per byte */
+    EofMode eof_mode;     /* buffered input only; unbuffered input always leaves the cell unchanged */
+    bool vector_scans;    /* scans with a stride of 1, 2, 4 or 8 test 16 cells per step with NEON/SSE2 */
+    bool vector_updates;  /* constant adds and sets on nearby cells become one 8 or 16 byte NEON/SSE2 update */
+    bool return_ptr;      /* return the final tape pointer instead of 0; for code the interpreter calls into */
+    bool profile;         /* count into BFIO.profile: [2 * loop_id] when a loop is reached, [2 * loop_id + 1]
+                           * per iteration. JIT only; executables have no counters to point at */
+    bool hosted_io;       /* I/O through BFIO.host instead of syscalls; needs both buffered modes. For libbfc */
+} CodegenOptions;
+
+typedef struct
+{
+    const char* name; /* as spelled for --target */
+    Target target;
+    CodeBuffer* (*codegen)(IRProgram* program, const CodegenOptions* options);
+} Backend;
+
+/* in frontend.c; preproc, tokenize and parse are the original whole-file frontend. bfc itself only
+ * uses parse_file and parse_source, and they are kept as the baseline the lexer and nesting
+ * benchmarks measure against */
 char* preproc(const char* src);
 
 TokenArray* tokenize(const char* proc_src);
@@ -85,29 +203,114 @@ void free_tkarr(TokenArray* arr);
 
 IRProgram* parse(TokenArray* tokens);
 
+IRProgram* parse_file(const char* filename); /* streaming read + preproc + tokenize + parse in one pass */
+
+IRProgram* parse_source(const char* src, size_t len); /* same, for source already in memory */
+
 /* optimize1.c; this function performs IR level optimizations */
 IRProgram* optimize1(IRProgram* program);
 
 void optimize_combinable(IRProgram* program); /* utils; used in every optimization */
 
+void optimize_offsets(IRProgram* program); /* utils; sinks pointer moves into cell offsets */
+
+void optimize_known_values(IRProgram* program); /* utils; folds what is known about cell values */
+
 /* optimize2.c; this function performs IR level */
 IRProgram* optimize2(IRProgram* program);
 
 /* optimize3.c; because this can break your program */
 IRProgram* optimize3(IRProgram* program);
 
-/* codegen.c */
-CodeBuffer* codegen(IRProgram* program);
+/* backend.c; code buffers and the per-target backends */
+/* NULL options = defaults for the host. The program is left as it was; vector_updates lowers a copy */
+CodeBuffer* codegen(IRProgram* program, const CodegenOptions* options);
+
+const Backend* find_backend(const char* name);
+
+const Backend* get_backend(Target target);
+
+Target host_target();
+
+void default_codegen_options(CodegenOptions* options);
+
+/* per-loop choices from --profile-use; loop_id -1 is the top level. Hot loops are aligned even
+ * without --align-loops, and cold ones are built for size: no padding and no vector code */
+int loop_align_for(const IRProgram* program, int loop_id, const CodegenOptions* options);
+
+bool loop_is_cold(const IRProgram* program, int loop_id);
+
+CodeBuffer* create_code_buffer(size_t capacity); /* capacity in bytes */
 
 void free_code_buffer(CodeBuffer* buf);
 
+void finish_code_buffer(CodeBuffer* buf); /* marks the end of the instructions */
+
+void emit_bytes(CodeBuffer* buf, const void* bytes, size_t count);
+
+void emit_byte(CodeBuffer* buf, uint8_t byte);
+
+void emit_u32(CodeBuffer* buf, uint32_t value);
+
+uint32_t read_u32(const CodeBuffer* buf, size_t pos);
+
+void write_u32(CodeBuffer* buf, size_t pos, uint32_t value);
+
+/* codegen.c; the arm64 backend */
+CodeBuffer* codegen_arm64(IRProgram* program, const CodegenOptions* options);
+
+/* x86_codegen.c; the x86-64 backend */
+CodeBuffer* codegen_x86_64(IRProgram* program, const CodegenOptions* options);
+
+/* interp.c; runs the IR directly through a threaded-code interpreter, on any host */
+typedef struct InterpCode InterpCode;
+
+InterpCode* interp_compile(const IRProgram* program); /* translate to bytecode; the IR can go afterwards */
+
+int interp_exec(InterpCode* code, EofMode eof_mode); /* run on a fresh tape; 0, or -1 if it could not start */
+
+void free_interp(InterpCode* code);
+
+int interp_run(const IRProgram* program, EofMode eof_mode); /* compile, run and free in one go */
+
+/* tier.c; tiered execution: the interpreter starts at once, and hot loops are compiled for the host
+ * on a background thread and run natively from then on */
+int tier_run(IRProgram* program, int opt_level, const CodegenOptions* options); /* takes over the unoptimized IR */
+
+/* profile.c; --profile-generate and --profile-use. Profiles are text, one loop per line, keyed
+ * by the source position of its opening bracket */
+int profile_write(const char* filename, const IRProgram* program, const uint64_t* counters);
+
+int profile_apply(const char* filename, IRProgram* program); /* set the heat of every live loop */
+
+/* elf.c; static ELF64 executables for the Linux targets, no linker involved */
+int write_elf(const char* filename, const CodeBuffer* buf, Target target);
+
 /* ir.c; this is IR utils */
 IRProgram* create_ir_program();
 
+IRProgram* copy_ir_program(const IRProgram* program); /* deep copy; ops, loop tree and string pool */
+
 void free_ir_program(IRProgram* program);
 
-IROperation* create_ir_op(IROptype type, int value, int offset, int loop_id);
+int ir_reserve(IRProgram* program, size_t capacity); /* pre-size the op array */
 
 void add_ir_op(IRProgram* program, IROptype type, int value, int offset, int loop_id);
 
+void ir_set_op(IROperation* op, IROptype type, int value, int offset, int loop_id); /* overwrite a slot in place; src = 0 */
+
+void ir_remove(IRProgram* program, size_t index); /* tombstone a slot */
+
+void ir_compact(IRProgram* program); /* drop all tombstones, keeping order */
+
+void ir_move_op(IRProgram* program, size_t from, size_t to); /* move a slot, keeping the loop tree in sync */
+
+int ir_begin_loop(IRProgram* program, int loop_id, int parent, size_t pos); /* append IR_LOOP_START and its tree node; -1 on error */
+
+void ir_end_loop(IRProgram* program, int loop_id); /* append the matching IR_LOOP_END */
+
+void ir_remove_loop(IRProgram* program, int loop_id); /* unlink a loop a pass has rewritten */
+
+int ir_add_string(IRProgram* program, const uint8_t* bytes, size_t length); /* append to the string pool; its offset, or -1 */
+
 void ir_dump(IRProgram* program);
\ No newline at end of file
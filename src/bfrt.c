@@ -1,25 +1,47 @@
+#if defined(__linux__)
+#define _GNU_SOURCE /* memfd_create */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <unistd.h>
+#include "bfrt.h"
+
+#if defined(__APPLE__)
 #include <pthread.h>
 #include <libkern/OSCacheControl.h>
-#include "bfc.h"
-
-#define BF_TAPE_SIZE 30000
+#endif
 
+/* executable memory, behind a small platform layer:
+ *  - macOS: one MAP_JIT mapping, written through pthread_jit_write_with_callback_np
+ *  - Linux: a memfd mapped twice, RW for writing and RX for running, so code can be patched
+ *    or appended at any time without touching page permissions; where memfd is unavailable
+ *    it falls back to a private mapping that is written RW and then flipped to RX (W^X) */
 typedef struct
 {
-    void* jit_region;      /* executable memory for code */
-    size_t code_size;      /* size of compiled code */
-    void* tape_memory;     /* memory for BF tape */
+    void* rx;    /* executable view */
+    void* rw;    /* writable view; equal to rx when there is no second mapping */
+    size_t size; /* page-aligned */
+    bool sealed; /* single-mapping fallback only: rx has been made executable */
+} JitRegion;
+
+struct JITContext
+{
+    JitRegion code;        /* executable memory for code */
+    size_t code_size;      /* bytes of code written */
+    void* tape_memory;     /* memory for BF tape, padding included */
     size_t tape_size;      /* size of BF tape memory */
-} JITContext;
+    BFIO* io;              /* output buffer and other runtime I/O state */
+};
+
+#if defined(__APPLE__)
 
 typedef struct JitWriteData
 {
     void* dest;
-    void* src;
+    const void* src;
     size_t size;
 } JitWriteData;
 
@@ -36,7 +58,137 @@ static int jit_writing_callback(void* context)
 /* Tell macOS that we want to use our custom writing callback */
 PTHREAD_JIT_WRITE_ALLOW_CALLBACKS_NP(jit_writing_callback);
 
-JITContext* init_jit(CodeBuffer *compiled)
+static int jit_region_alloc(JitRegion* region, size_t size)
+{
+    void* code_region = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_JIT, -1, 0);
+    if (code_region == MAP_FAILED)
+    {
+        perror("JIT code memory allocation failed");
+        return -1;
+    }
+
+    region->rx = region->rw = code_region;
+    region->size = size;
+    region->sealed = false;
+    return 0;
+}
+
+static int jit_region_write(JitRegion* region, size_t offset, const void* src, size_t len)
+{
+    /* use pthread's secure writing mechanism to write to executable memory */
+    JitWriteData write_data = {
+        .dest = (char*)region->rw + offset,
+        .src = src,
+        .size = len
+    };
+
+    if (pthread_jit_write_with_callback_np(jit_writing_callback, &write_data) != 0)
+    {
+        perror("JIT code writing failed");
+        return -1;
+    }
+
+    /* invalidate instruction cache to ensure coherency on ARM64 */
+    sys_icache_invalidate((char*)region->rx + offset, len);
+    return 0;
+}
+
+static int jit_region_seal(JitRegion* region)
+{
+    region->sealed = true; /* MAP_JIT memory is already executable */
+    return 0;
+}
+
+static void jit_region_free(JitRegion* region)
+{
+    munmap(region->rx, region->size);
+}
+
+#else /* Linux and other POSIX systems */
+
+static int jit_region_alloc(JitRegion* region, size_t size)
+{
+    region->size = size;
+    region->sealed = false;
+
+#if defined(__linux__)
+    int fd = memfd_create("bfc-jit", MFD_CLOEXEC);
+    if (fd >= 0)
+    {
+        if (ftruncate(fd, (off_t)size) == 0)
+        {
+            void* rw = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            void* rx = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+            if (rw != MAP_FAILED && rx != MAP_FAILED)
+            {
+                close(fd); /* the mappings keep the memory alive */
+                region->rw = rw;
+                region->rx = rx;
+                return 0;
+            }
+
+            if (rw != MAP_FAILED)
+                munmap(rw, size);
+            if (rx != MAP_FAILED)
+                munmap(rx, size);
+        }
+        close(fd);
+    }
+#endif
+
+    /* no dual mapping; write first, then flip the pages to RX in jit_region_seal */
+    void* code_region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code_region == MAP_FAILED)
+    {
+        perror("JIT code memory allocation failed");
+        return -1;
+    }
+
+    region->rw = region->rx = code_region;
+    return 0;
+}
+
+static int jit_region_write(JitRegion* region, size_t offset, const void* src, size_t len)
+{
+    if (region->sealed) /* single mapping that is already RX; never writable and executable at once */
+    {
+        fprintf(stderr, "JIT region is sealed and has no writable view\n");
+        return -1;
+    }
+
+    memcpy((char*)region->rw + offset, src, len);
+
+    /* x86 keeps the instruction cache coherent; arm64 needs the range cleaned and invalidated */
+    __builtin___clear_cache((char*)region->rx + offset, (char*)region->rx + offset + len);
+    return 0;
+}
+
+static int jit_region_seal(JitRegion* region)
+{
+    if (region->rw != region->rx || region->sealed)
+        return 0; /* the RX view of a dual mapping is executable from the start */
+
+    if (mprotect(region->rx, region->size, PROT_READ | PROT_EXEC) != 0)
+    {
+        perror("JIT mprotect failed");
+        return -1;
+    }
+
+    region->sealed = true;
+    return 0;
+}
+
+static void jit_region_free(JitRegion* region)
+{
+    if (region->rw != region->rx)
+        munmap(region->rw, region->size);
+    munmap(region->rx, region->size);
+}
+
+#endif
+
+JITContext* init_jit_code(CodeBuffer* compiled)
 {
     if (!compiled)
     {
@@ -44,100 +196,146 @@ JITContext* init_jit(CodeBuffer *compiled)
         return NULL;
     }
 
-    JITContext *ctx = malloc(sizeof(JITContext));
-    if (!ctx) 
+    JITContext *ctx = calloc(1, sizeof(JITContext));
+    if (!ctx)
     {
         perror("JIT context allocation failed");
         return NULL;
     }
 
     /* calculate size needed for code, page-aligned */
-    size_t code_size = compiled->size * sizeof(uint32_t);
-    size_t page_size = 4096; /* Standard page size */
+    size_t code_size = compiled->size;
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
     size_t aligned_code_size = ((code_size + page_size - 1) / page_size) * page_size;
-    
-    /* allocate executable memory for code only */
-    void *code_region = mmap(NULL, aligned_code_size,  
-                           PROT_READ | PROT_WRITE | PROT_EXEC,
-                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_JIT, -1, 0);
-    
-    if (code_region == MAP_FAILED) 
+
+    if (jit_region_alloc(&ctx->code, aligned_code_size) != 0)
     {
-        perror("JIT code memory allocation failed");
         free(ctx);
         return NULL;
     }
-    
+    ctx->code_size = code_size;
+
+    if (jit_region_write(&ctx->code, 0, compiled->code, code_size) != 0 ||
+        jit_region_seal(&ctx->code) != 0)
+    {
+        free_jit(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* the tape and the I/O block for a context whose code is in place */
+static JITContext* add_tape(JITContext* ctx)
+{
     /* allocate separate memory for BF tape (non-executable) */
-    void *tape_memory = mmap(NULL, BF_TAPE_SIZE,
+    size_t tape_size = BF_TAPE_SIZE + 2 * BF_TAPE_PAD;
+    void *tape_memory = mmap(NULL, tape_size,
                             PROT_READ | PROT_WRITE,
                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-                            
-    if (tape_memory == MAP_FAILED) 
+
+    if (tape_memory == MAP_FAILED)
     {
         perror("BF tape memory allocation failed");
-        munmap(code_region, aligned_code_size);
-        free(ctx);
+        free_jit(ctx);
         return NULL;
     }
-    
-    ctx->jit_region = code_region;
-    ctx->code_size = aligned_code_size;
+
     ctx->tape_memory = tape_memory;
-    ctx->tape_size = BF_TAPE_SIZE;
-    
-    /* Zero out the tape memory */
-    memset(ctx->tape_memory, 0, BF_TAPE_SIZE);
-    
-    /* Use pthread's secure writing mechanism to write to executable memory */
-    JitWriteData write_data = {
-        .dest = ctx->jit_region,
-        .src = compiled->code,
-        .size = code_size
-    };
-    
-    int result = pthread_jit_write_with_callback_np(jit_writing_callback, &write_data);
-    if (result != 0) 
+    ctx->tape_size = tape_size;
+    ctx->io = calloc(1, sizeof(BFIO)); /* the runtime expects it zeroed, like .bss */
+    if (!ctx->io)
     {
-        perror("JIT code writing failed");
-        munmap(tape_memory, BF_TAPE_SIZE);
-        munmap(code_region, aligned_code_size);
-        free(ctx);
+        perror("JIT I/O buffer allocation failed");
+        free_jit(ctx);
         return NULL;
     }
-    
-    /* invalidate instruction cache to ensure coherency on ARM64 */
-    sys_icache_invalidate(ctx->jit_region, code_size);
+
+    /* Zero out the tape memory */
+    memset(ctx->tape_memory, 0, tape_size);
     return ctx;
 }
 
+JITContext* init_jit(CodeBuffer *compiled)
+{
+    JITContext *ctx = init_jit_code(compiled);
+    if (!ctx)
+        return NULL;
+    return add_tape(ctx);
+}
+
+JITContext* init_jit_file(int fd, size_t code_size)
+{
+    JITContext *ctx = calloc(1, sizeof(JITContext));
+    if (!ctx)
+    {
+        perror("JIT context allocation failed");
+        return NULL;
+    }
+
+    /* the file's pages are the code; nothing is copied, and they are never writable here */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t aligned_code_size = ((code_size + page_size - 1) / page_size) * page_size;
+    void* code = mmap(NULL, aligned_code_size, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+    if (code == MAP_FAILED)
+    {
+        free(ctx); /* noexec mounts and hardened runtimes refuse this; the caller copies instead */
+        return NULL;
+    }
+
+    ctx->code = (JitRegion){ code, code, aligned_code_size, true };
+    ctx->code_size = code_size;
+    return add_tape(ctx);
+}
+
+void* jit_entry(JITContext* ctx)
+{
+    return ctx ? ctx->code.rx : NULL;
+}
+
+int jit_patch(JITContext* ctx, size_t offset, const void* code, size_t len)
+{
+    if (!ctx || offset > ctx->code.size || len > ctx->code.size - offset)
+    {
+        fprintf(stderr, "JIT patch out of range\n");
+        return -1;
+    }
+    return jit_region_write(&ctx->code, offset, code, len);
+}
+
+void jit_set_profile(JITContext* ctx, uint64_t* counters)
+{
+    if (ctx && ctx->io)
+        ctx->io->profile = counters;
+}
+
 int exec_jit(JITContext* ctx)
 {
-    if (!ctx || !ctx->jit_region) 
+    if (!ctx || !ctx->code.rx || !ctx->tape_memory)
     {
         fprintf(stderr, "Invalid JIT context\n");
         return -1;
     }
-    
-    /* the codegen produces a function that takes pointer to tape memory */
-    typedef int (*jit_func_t)(void *);
-    jit_func_t jit_func = (jit_func_t)ctx->jit_region;
-    
-    return jit_func(ctx->tape_memory); /* execute */
+
+    /* the codegen produces a function that takes pointer to tape memory and the I/O block */
+    typedef int (*jit_func_t)(void *, BFIO *);
+    jit_func_t jit_func = (jit_func_t)ctx->code.rx;
+
+    return jit_func((char*)ctx->tape_memory + BF_TAPE_PAD, ctx->io); /* execute */
 }
 
-void free_jit(JITContext *ctx) 
+void free_jit(JITContext *ctx)
 {
-    if (ctx) 
+    if (ctx)
     {
         /* Free code memory */
-        if (ctx->jit_region != MAP_FAILED && ctx->jit_region != NULL)
-            munmap(ctx->jit_region, ctx->code_size);
-            
+        if (ctx->code.rx)
+            jit_region_free(&ctx->code);
+
         /* Free tape memory */
         if (ctx->tape_memory != MAP_FAILED && ctx->tape_memory != NULL)
             munmap(ctx->tape_memory, ctx->tape_size);
-            
+
+        free(ctx->io);
         free(ctx);
     }
 }
@@ -145,22 +343,17 @@ void free_jit(JITContext *ctx)
 int jit_exec(CodeBuffer *compiled)
 {
     JITContext *jit_ctx = init_jit(compiled);
-    if (!jit_ctx) 
+    if (!jit_ctx)
     {
         fprintf(stderr, "Failed to initialize JIT environment\n");
         return -1;
     }
-    
-    printf("Executing JIT compiled code...\n");
-    
+    return jit_exec_context(jit_ctx);
+}
+
+int jit_exec_context(JITContext* jit_ctx)
+{
     int result = exec_jit(jit_ctx);
-    
     free_jit(jit_ctx);
-    
-    if (result != 0) 
-        fprintf(stderr, "JIT execution completed with non-zero code: %d\n", result);
-    else
-        printf("JIT execution completed successfully\n");
-    
     return result;
-}
\ No newline at end of file
+}
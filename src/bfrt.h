@@ -2,4 +2,39 @@
 
 #include "bfc.h"
 
-int jit_exec(CodeBuffer *compiled);
\ No newline at end of file
+typedef struct JITContext JITContext;
+
+JITContext* init_jit(CodeBuffer *compiled); /* copy the code into executable memory and set up a tape */
+
+JITContext* init_jit_code(CodeBuffer* compiled); /* the code alone; the caller brings the tape and BFIO */
+
+JITContext* init_jit_file(int fd, size_t code_size); /* map the first code_size bytes of fd as the code; NULL if it cannot be executable */
+
+void* jit_entry(JITContext* ctx); /* where the code starts; called as fn(tape, io) */
+
+int exec_jit(JITContext* ctx);
+
+void jit_set_profile(JITContext* ctx, uint64_t* counters); /* where code built with CodegenOptions.profile counts */
+
+int jit_patch(JITContext* ctx, size_t offset, const void* code, size_t len); /* rewrite code in place; free on Linux with a dual mapping */
+
+void free_jit(JITContext *ctx);
+
+int jit_exec(CodeBuffer *compiled); /* init, run and free in one go; prints nothing, like the rest of the runtime */
+
+int jit_exec_context(JITContext* ctx); /* run and free */
+
+/* jitcache.c; finished code kept on disk between runs, see the README */
+typedef struct
+{
+    uint64_t hash[2];
+} JitCacheKey;
+
+/* everything the code depends on: the source, -O level, codegen options, the applied profile if
+ * any, BFC_VERSION and the build of bfc itself */
+void jit_cache_key(JitCacheKey* key, const char* source, size_t length, int opt_level,
+                   const CodegenOptions* options, const void* profile, size_t profile_length);
+
+JITContext* jit_cache_load(const JitCacheKey* key, Target target); /* ready to run; NULL on a miss */
+
+int jit_cache_store(const JitCacheKey* key, Target target, const CodeBuffer* compiled); /* evicts as needed */
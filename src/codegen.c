@@ -7,329 +7,1244 @@
 
 #define REG_TAPE_PTR 0 /* X0 = ptr to current cell */
 #define REG_TEMP 1     /* X1 = temp register for operations */
-#define REG_SYSCALL 16  /* X8 = syscall number */
+#define REG_SYSCALL 16  /* X16 = syscall number on XNU */
+#define REG_SYSCALL_LINUX 8 /* X8 = syscall number on Linux; a cache register, but I/O flushes the cache first */
 #define REG_STDOUT 1   /* X0 = stdout file descriptor */
 #define REG_BUF_PTR 1  /* X1 = buffer pointer for I/O */
 #define REG_BUF_SIZE 2 /* X2 = buffer size for I/O */
+#define REG_ADDR 9     /* X9 = cell address when an offset is out of immediate range */
+#define REG_FACTOR 17  /* X17 = multiplier for IR_ADD_MUL and scratch for wide immediates; IP1 is free since we never call through veneers */
+#define REG_OUT_PTR 19 /* X19 = next free byte of BFIO.out; callee-saved, so syscalls leave it alone */
+#define REG_OUT_END 20 /* X20 = end of BFIO.out */
+#define REG_IO 21      /* X21 = the BFIO block, which starts with the output buffer */
+#define REG_IN_PTR 22  /* X22 = next unread byte of stdin */
+#define REG_IN_END 23  /* X23 = end of the bytes of stdin we have */
+#define REG_LINK 30    /* X30 = return address; saved since we bl to the flush helper */
+#define REG_SP 31      /* SP as a load/store base */
 
-CodeBuffer* create_code_buffer(size_t capacity) 
+void emit_instr(CodeBuffer* buf, uint32_t instr) 
 {
-    CodeBuffer* buf = malloc(sizeof(CodeBuffer));
-    if (!buf)
-        return NULL;
+    emit_u32(buf, instr);
+}
 
-    buf->code = (uint32_t*)malloc(capacity * sizeof(uint32_t));
-    if (!buf->code) 
-    {
-        free(buf);
-        return NULL;
-    }
+/* index of the next instruction; branch bookkeeping counts in instructions, not bytes */
+static int arm_pc(CodeBuffer* buf)
+{
+    return (int)(buf->size / sizeof(uint32_t));
+}
 
-    buf->capacity = capacity;
-    buf->size = 0;
-    return buf;
+int32_t compute_br_offset(CodeBuffer* buf, int src_offset, int dest_offset) 
+{
+    /* ARM64 branch offsets are relative to the branch instruction's position
+     * and measured in 4-byte units since instructions are 4 bytes */
+    return (dest_offset - src_offset) * 4;
 }
 
-void free_code_buffer(CodeBuffer* buf) 
+void patch_br(CodeBuffer* buf, int offset, int32_t branch_offset) 
 {
-    if (buf) 
+    if (offset < 0 || offset >= arm_pc(buf)) /* buffer overflow check */
+    {
+        fprintf(stderr, "Error: Attempt to patch branch at invalid offset %d (buffer size: %d)\n", 
+                offset, arm_pc(buf));
+        return;
+    }
+
+    size_t pos = (size_t)offset * sizeof(uint32_t);
+    uint32_t instr = read_u32(buf, pos);
+    if ((instr & 0x7E000000) == 0x34000000 || /* CBZ/CBNZ */
+        (instr & 0xFF000010) == 0x54000000)   /* B.cond */
     {
-        if (buf->code)
-            free(buf->code);
-        free(buf);
+        /* offset is encoded in bits 5-23 for both */
+        int imm19 = (branch_offset / 4) & 0x7FFFF;
+        instr &= ~(0x7FFFF << 5); /* clear old offset */
+        instr |= (imm19 << 5);  /* set new offset */
+    } 
+    else 
+    {
+        /* for unconditional B/BL instruction, offset is encoded in bits 0-25 */
+        int imm26 = (branch_offset / 4) & 0x3FFFFFF;
+        instr &= ~0x3FFFFFF; /* Clear old offset */
+        instr |= imm26; /* Set new offset */
     }
+    write_u32(buf, pos, instr);
 }
 
-void emit_instr(CodeBuffer* buf, uint32_t instr) 
+/* point the branch at `from` to the current position */
+static void patch_br_here(CodeBuffer* buf, int from)
 {
-    if (buf->size >= buf->capacity) /* resize if bigger */
+    patch_br(buf, from, compute_br_offset(buf, from, arm_pc(buf)));
+}
+
+/* rd = value, with movz and as many movk as the value needs */
+void emit_mov_const(CodeBuffer* buf, int rd, uint64_t value)
+{
+    emit_instr(buf, encode_movz(rd, value & 0xFFFF, 0));
+    for (int shift = 1; shift < 4 && (value >> (16 * shift)) != 0; shift++)
+        emit_instr(buf, encode_movk(rd, (value >> (16 * shift)) & 0xFFFF, shift));
+}
+
+/* rd = rn + imm for any 32-bit imm; add/sub take only a 12-bit immediate, so bigger ones are
+ * split into a shifted high half and a low half, or built in REG_FACTOR with movz/movk */
+void emit_add_const(CodeBuffer* buf, int rd, int rn, int64_t imm)
+{
+    uint64_t magnitude = imm < 0 ? -(uint64_t)imm : (uint64_t)imm;
+    if (magnitude == 0)
     {
-        size_t new_capacity = buf->capacity * 2;
-        uint32_t* new_code = (uint32_t*)realloc(buf->code, new_capacity * sizeof(uint32_t));
-        if (!new_code) 
+        if (rd != rn)
+            emit_instr(buf, encode_mov_reg(rd, rn));
+        return;
+    }
+
+    if (magnitude < (1u << 24)) /* at most two instructions */
+    {
+        int high = (int)(magnitude >> 12);
+        int low = (int)(magnitude & 0xFFF);
+        if (high)
         {
-            fprintf(stderr, "Failed to expand code buffer\n");
-            exit(1);
+            emit_instr(buf, imm > 0 ? encode_add_imm_lsl12(rd, rn, high) : encode_sub_imm_lsl12(rd, rn, high));
+            rn = rd;
         }
-
-        buf->code = new_code;
-        buf->capacity = new_capacity;
+        if (low)
+            emit_instr(buf, imm > 0 ? encode_add_imm(rd, rn, low) : encode_sub_imm(rd, rn, low));
+        return;
     }
 
-    buf->code[buf->size++] = instr;
+    emit_mov_const(buf, REG_FACTOR, magnitude);
+    emit_instr(buf, imm > 0 ? encode_add_reg(rd, rn, REG_FACTOR) : encode_sub_reg(rd, rn, REG_FACTOR));
 }
 
-int32_t compute_br_offset(CodeBuffer* buf, int src_offset, int dest_offset) 
+/* address of tape[ptr + offset] in REG_ADDR, for offsets no load/store immediate can reach */
+void emit_cell_addr(CodeBuffer* buf, int rd, int offset)
 {
-    /* ARM64 branch offsets are relative to the branch instruction's position
-     * and measured in 4-byte units since instructions are 4 bytes */
-    return (dest_offset - src_offset) * 4;
+    emit_add_const(buf, rd, REG_TAPE_PTR, offset);
 }
 
-void patch_br(CodeBuffer* buf, int offset, int32_t branch_offset) 
+/* rt = tape[ptr + offset]; picks the unsigned 12-bit or signed 9-bit immediate form */
+void emit_load_cell(CodeBuffer* buf, int rt, int offset)
 {
-    if (offset < 0 || (size_t)offset >= buf->size) /* buffer overflow check */
+    if (offset >= 0 && offset <= 4095)
     {
-        fprintf(stderr, "Error: Attempt to patch branch at invalid offset %d (buffer size: %zu)\n", 
-                offset, buf->size);
-        return;
+        emit_instr(buf, encode_ldrb_offset(rt, REG_TAPE_PTR, offset));
     }
+    else if (offset >= -256 && offset < 0)
+    {
+        emit_instr(buf, encode_ldurb(rt, REG_TAPE_PTR, offset));
+    }
+    else
+    {
+        emit_cell_addr(buf, REG_ADDR, offset);
+        emit_instr(buf, encode_ldrb(rt, REG_ADDR));
+    }
+}
 
-    if (buf->code[offset] & (1u << 31)) /* 64-bit conditional branch (CBZ/CBNZ) */
+/* tape[ptr + offset] = rt */
+void emit_store_cell(CodeBuffer* buf, int rt, int offset)
+{
+    if (offset >= 0 && offset <= 4095)
     {
-        /* offset is encoded in bits 5-23 for CCBZ/CBNZ */
-        int imm19 = (branch_offset / 4) & 0x7FFFF;
-        buf->code[offset] &= ~(0x7FFFF << 5); /* clear old offset */
-        buf->code[offset] |= (imm19 << 5);  /* set new offset */
-    } 
-    else 
+        emit_instr(buf, encode_strb_offset(rt, REG_TAPE_PTR, offset));
+    }
+    else if (offset >= -256 && offset < 0)
     {
-        /* for unconditional B instruction, offset is encoded in bits 0-25 */
-        int imm26 = (branch_offset / 4) & 0x3FFFFFF;
-        buf->code[offset] &= ~0x3FFFFFF; /* Clear old offset */
-        buf->code[offset] |= imm26; /* Set new offset */
+        emit_instr(buf, encode_sturb(rt, REG_TAPE_PTR, offset));
+    }
+    else
+    {
+        emit_cell_addr(buf, REG_ADDR, offset);
+        emit_instr(buf, encode_strb(rt, REG_ADDR));
     }
 }
 
-void emit_io_op(CodeBuffer* buf, int is_output)
+void emit_io_op(CodeBuffer* buf, Target target, int is_output, int offset)
 {
     /* preserve X0 in X9 (a caller-saved register we can use) */
     emit_instr(buf, encode_mov_reg(9, REG_TAPE_PTR));
 
+    bool linux_abi = target == TARGET_ARM64_LINUX;
+    int syscall_reg = linux_abi ? REG_SYSCALL_LINUX : REG_SYSCALL;
     if (is_output)  /* stdout */
     {
-        emit_instr(buf, encode_mov_imm(REG_SYSCALL, 4)); /* macOS write syscall */
+        emit_instr(buf, encode_mov_imm(syscall_reg, linux_abi ? 64 : 4)); /* write */
         emit_instr(buf, encode_mov_imm(0, 1));
     }
     else /* stdin */
     {
-        emit_instr(buf, encode_mov_imm(REG_SYSCALL, 3)); /* macOS read syscall */
+        emit_instr(buf, encode_mov_imm(syscall_reg, linux_abi ? 63 : 3)); /* read */
         emit_instr(buf, encode_mov_imm(0, 0));
     }
 
-    emit_instr(buf, encode_mov_reg(REG_BUF_PTR, 9)); /* X1 = buffer address (current byte pointer) */
+    emit_add_const(buf, REG_BUF_PTR, 9, offset); /* X1 = buffer address (the addressed cell) */
+
     emit_instr(buf, encode_mov_imm(REG_BUF_SIZE, 1)); /* X2 = length (1) */
-    emit_instr(buf, encode_svc(0x80)); /* make syscall with macOS SVC #0x80 convention */
+    emit_instr(buf, encode_svc(linux_abi ? 0 : 0x80)); /* macOS uses SVC #0x80, Linux SVC #0 */
     emit_instr(buf, encode_mov_reg(REG_TAPE_PTR, 9)); /* restore X0 from X9 */
 }
 
-CodeBuffer* codegen(IRProgram* program) 
+/* syscall `linux_nr` or `xnu_nr`, whichever ABI the target uses; result in x0 */
+static void emit_syscall(CodeBuffer* buf, Target target, int linux_nr, int xnu_nr)
+{
+    bool linux_abi = target == TARGET_ARM64_LINUX;
+    emit_instr(buf, encode_mov_imm(linux_abi ? REG_SYSCALL_LINUX : REG_SYSCALL, linux_abi ? linux_nr : xnu_nr));
+    emit_instr(buf, encode_svc(linux_abi ? 0 : 0x80));
+}
+
+/* branch (to be patched) taken when the syscall just made failed: Linux returns -errno, XNU sets
+ * the carry flag. With `or_zero` a 0 result counts as failure too, e.g. read at end of file */
+static int emit_branch_if_failed(CodeBuffer* buf, Target target, bool or_zero, int* second)
 {
-    if (!program || !program->first) 
+    *second = -1;
+    if (target == TARGET_ARM64_LINUX)
     {
-        fprintf(stderr, "Empty program to compile\n");
-        return NULL;
+        emit_instr(buf, encode_cmp_imm(0, 0));
+        emit_instr(buf, encode_b_cond(or_zero ? ARM64_COND_LE : ARM64_COND_LT, 0));
+        return arm_pc(buf) - 1;
     }
-    
-    CodeBuffer* buf = create_code_buffer(5000);
-    if (!buf) 
+
+    emit_instr(buf, encode_b_cond(ARM64_COND_CS, 0));
+    if (or_zero)
     {
-        fprintf(stderr, "Failed to create code buffer\n");
-        return NULL;
+        *second = arm_pc(buf);
+        emit_instr(buf, encode_cbz(0, 0));
     }
+    return arm_pc(buf) - (or_zero ? 2 : 1);
+}
+
+static void patch_failed_here(CodeBuffer* buf, int first, int second)
+{
+    patch_br_here(buf, first);
+    if (second >= 0)
+        patch_br_here(buf, second);
+}
+
+/* out-of-line flush of BFIO.out, called with bl when the buffer fills, before blocking on input
+ * and at exit. It writes [REG_IO, REG_OUT_PTR) in a loop (write may be partial), drops the rest on
+ * error and resets REG_OUT_PTR; every other register it touches is restored, so cached cells survive */
+static void emit_flush_helper(CodeBuffer* buf, Target target)
+{
+    emit_instr(buf, encode_stp_pre(0, 1, REG_SP, -48));
+    emit_instr(buf, encode_stp(REG_BUF_SIZE, REG_SYSCALL_LINUX, REG_SP, 16));
+    emit_instr(buf, encode_stp(REG_SYSCALL, REG_FACTOR, REG_SP, 32));
+    emit_instr(buf, encode_mov_reg(REG_BUF_PTR, REG_IO));
+    emit_instr(buf, encode_sub_reg(REG_BUF_SIZE, REG_OUT_PTR, REG_IO));
+
+    int loop = arm_pc(buf);
+    int done_patch = arm_pc(buf);
+    emit_instr(buf, encode_cbz(REG_BUF_SIZE, 0)); /* nothing (left) to write */
+    emit_instr(buf, encode_mov_imm(0, 1)); /* stdout */
+    emit_syscall(buf, target, 64, 4); /* write */
+    int failed_second;
+    int failed = emit_branch_if_failed(buf, target, true, &failed_second); /* 0 bytes would spin forever */
 
-    /* allocate memory for loop tracking */
-    int max_loop_id = -1;
-    IROperation* op = program->first;
-    while (op) 
+    emit_instr(buf, encode_add_reg(REG_BUF_PTR, REG_BUF_PTR, 0));
+    emit_instr(buf, encode_sub_reg(REG_BUF_SIZE, REG_BUF_SIZE, 0));
+    emit_instr(buf, encode_b(compute_br_offset(buf, arm_pc(buf), loop)));
+
+    patch_br_here(buf, done_patch);
+    patch_failed_here(buf, failed, failed_second);
+    emit_instr(buf, encode_mov_reg(REG_OUT_PTR, REG_IO)); /* empty again */
+    emit_instr(buf, encode_ldp(REG_SYSCALL, REG_FACTOR, REG_SP, 32));
+    emit_instr(buf, encode_ldp(REG_BUF_SIZE, REG_SYSCALL_LINUX, REG_SP, 16));
+    emit_instr(buf, encode_ldp_post(0, 1, REG_SP, 48));
+    emit_instr(buf, encode_ret());
+}
+
+/* --profile-generate: one more on counter `index` of BFIO.profile; uses REG_TEMP and REG_FACTOR */
+static void emit_count(CodeBuffer* buf, int index)
+{
+    emit_add_const(buf, REG_FACTOR, REG_IO, offsetof(BFIO, profile));
+    emit_instr(buf, encode_ldr_x(REG_FACTOR, REG_FACTOR, 0));
+    int offset = index * 8;
+    if (offset > 0xFFF * 8) /* past the scaled immediate */
+    {
+        emit_mov_const(buf, REG_TEMP, (uint64_t)offset);
+        emit_instr(buf, encode_add_reg(REG_FACTOR, REG_FACTOR, REG_TEMP));
+        offset = 0;
+    }
+    emit_instr(buf, encode_ldr_x(REG_TEMP, REG_FACTOR, offset));
+    emit_instr(buf, encode_add_imm(REG_TEMP, REG_TEMP, 1));
+    emit_instr(buf, encode_str_x(REG_TEMP, REG_FACTOR, offset));
+}
+
+/* bl to a runtime helper, which always sits in front of the code that calls it */
+static void emit_helper_call(CodeBuffer* buf, int helper_pc)
+{
+    emit_instr(buf, encode_bl(compute_br_offset(buf, arm_pc(buf), helper_pc)));
+}
+
+/* '.' with buffered output: append the byte and only call out when the buffer is full */
+static void emit_buffered_output(CodeBuffer* buf, int reg, int flush_pc)
+{
+    emit_instr(buf, encode_strb_post(reg, REG_OUT_PTR, 1));
+    emit_instr(buf, encode_cmp_reg(REG_OUT_PTR, REG_OUT_END));
+    emit_instr(buf, encode_b_cond(ARM64_COND_NE, 2 * sizeof(uint32_t))); /* skip the call */
+    emit_helper_call(buf, flush_pc);
+}
+
+/* out-of-line refill of [REG_IN_PTR, REG_IN_END), called with bl when ',' finds it empty. The first
+ * call checks whether stdin is a regular file; if so the whole file is mapped and there is nothing
+ * more to refill until end of input. Otherwise each call reads up to BF_IN_BUFFER bytes. At end of
+ * input the range is pointed at BFIO.eof_cell, which holds the value the EOF mode asks for; for
+ * BF_EOF_UNCHANGED that is the cell's current value, passed in REG_ADDR. Every register other than
+ * the two range registers is restored */
+static void emit_refill_helper(CodeBuffer* buf, Target target, EofMode eof_mode, int flush_pc)
+{
+    emit_instr(buf, encode_stp_pre(0, 1, REG_SP, -96));
+    emit_instr(buf, encode_stp(2, 3, REG_SP, 16));
+    emit_instr(buf, encode_stp(4, 5, REG_SP, 32));
+    emit_instr(buf, encode_stp(REG_SYSCALL_LINUX, REG_ADDR, REG_SP, 48));
+    emit_instr(buf, encode_stp(REG_SYSCALL, REG_FACTOR, REG_SP, 64));
+    emit_instr(buf, encode_stp(REG_LINK, 31, REG_SP, 80)); /* x31 is xzr here; keeps sp 16-byte aligned */
+
+    if (flush_pc >= 0) /* we may be about to block, so pending output (e.g. a prompt) goes first */
+        emit_helper_call(buf, flush_pc);
+
+    if (eof_mode == BF_EOF_UNCHANGED)
     {
-        if ((op->type == IR_LOOP_START || op->type == IR_LOOP_END) && 
-            op->loop_id > max_loop_id) 
+        emit_add_const(buf, REG_BUF_PTR, REG_IO, offsetof(BFIO, eof_cell));
+        emit_instr(buf, encode_strb(REG_ADDR, REG_BUF_PTR));
+    }
+
+    /* first call only: is stdin a regular file with bytes left past the current offset? */
+    emit_add_const(buf, REG_BUF_PTR, REG_IO, offsetof(BFIO, in_probed));
+    emit_instr(buf, encode_ldrb(REG_BUF_SIZE, REG_BUF_PTR));
+    int probed = arm_pc(buf);
+    emit_instr(buf, encode_cbnz(REG_BUF_SIZE, 0));
+    emit_instr(buf, encode_mov_imm(REG_BUF_SIZE, 1));
+    emit_instr(buf, encode_strb(REG_BUF_SIZE, REG_BUF_PTR));
+
+    int no_seek_second, no_end_second, no_map_second;
+    emit_instr(buf, encode_mov_imm(0, 0)); /* lseek(0, 0, SEEK_CUR); fails for pipes and terminals */
+    emit_instr(buf, encode_mov_imm(1, 0));
+    emit_instr(buf, encode_mov_imm(2, 1));
+    emit_syscall(buf, target, 62, 199);
+    int no_seek = emit_branch_if_failed(buf, target, false, &no_seek_second);
+    emit_instr(buf, encode_mov_reg(REG_IN_PTR, 0)); /* offset */
+
+    emit_instr(buf, encode_mov_imm(0, 0)); /* lseek(0, 0, SEEK_END) */
+    emit_instr(buf, encode_mov_imm(1, 0));
+    emit_instr(buf, encode_mov_imm(2, 2));
+    emit_syscall(buf, target, 62, 199);
+    int no_end = emit_branch_if_failed(buf, target, false, &no_end_second);
+    emit_instr(buf, encode_cmp_reg(0, REG_IN_PTR));
+    int nothing_left = arm_pc(buf);
+    emit_instr(buf, encode_b_cond(ARM64_COND_LE, 0)); /* also catches size-0 files like those in /proc */
+    emit_instr(buf, encode_mov_reg(REG_IN_END, 0)); /* size */
+
+    emit_instr(buf, encode_mov_imm(0, 0)); /* mmap(NULL, size, PROT_READ, MAP_PRIVATE, 0, 0) */
+    emit_instr(buf, encode_mov_reg(1, REG_IN_END));
+    emit_instr(buf, encode_mov_imm(2, 1));
+    emit_instr(buf, encode_mov_imm(3, 2));
+    emit_instr(buf, encode_mov_imm(4, 0));
+    emit_instr(buf, encode_mov_imm(5, 0));
+    emit_syscall(buf, target, 222, 197);
+    int no_map = emit_branch_if_failed(buf, target, false, &no_map_second);
+    emit_instr(buf, encode_add_reg(REG_IN_PTR, REG_IN_PTR, 0)); /* the mapping is the whole file */
+    emit_instr(buf, encode_add_reg(REG_IN_END, REG_IN_END, 0));
+    int mapped = arm_pc(buf);
+    emit_instr(buf, encode_b(0));
+
+    /* no mapping after all; put the file offset back where we found it and read instead */
+    patch_br_here(buf, nothing_left);
+    patch_failed_here(buf, no_map, no_map_second);
+    emit_instr(buf, encode_mov_imm(0, 0));
+    emit_instr(buf, encode_mov_reg(1, REG_IN_PTR));
+    emit_instr(buf, encode_mov_imm(2, 0)); /* SEEK_SET */
+    emit_syscall(buf, target, 62, 199);
+
+    patch_br_here(buf, probed);
+    patch_failed_here(buf, no_seek, no_seek_second);
+    patch_failed_here(buf, no_end, no_end_second);
+    int eof_second;
+    emit_instr(buf, encode_mov_imm(0, 0)); /* read(0, io->in, BF_IN_BUFFER) */
+    emit_add_const(buf, REG_BUF_PTR, REG_IO, offsetof(BFIO, in));
+    emit_mov_const(buf, REG_BUF_SIZE, BF_IN_BUFFER);
+    emit_syscall(buf, target, 63, 3);
+    int eof = emit_branch_if_failed(buf, target, true, &eof_second);
+    emit_add_const(buf, REG_IN_PTR, REG_IO, offsetof(BFIO, in));
+    emit_instr(buf, encode_add_reg(REG_IN_END, REG_IN_PTR, 0));
+    int filled = arm_pc(buf);
+    emit_instr(buf, encode_b(0));
+
+    patch_failed_here(buf, eof, eof_second);
+    if (eof_mode != BF_EOF_UNCHANGED)
+    {
+        emit_instr(buf, encode_mov_imm(REG_BUF_SIZE, eof_mode == BF_EOF_ZERO ? 0 : 0xFF));
+        emit_add_const(buf, REG_BUF_PTR, REG_IO, offsetof(BFIO, eof_cell));
+        emit_instr(buf, encode_strb(REG_BUF_SIZE, REG_BUF_PTR));
+    }
+    emit_add_const(buf, REG_IN_PTR, REG_IO, offsetof(BFIO, eof_cell));
+    emit_instr(buf, encode_add_imm(REG_IN_END, REG_IN_PTR, 1));
+
+    patch_br_here(buf, mapped);
+    patch_br_here(buf, filled);
+    emit_instr(buf, encode_ldp(REG_LINK, 31, REG_SP, 80));
+    emit_instr(buf, encode_ldp(REG_SYSCALL, REG_FACTOR, REG_SP, 64));
+    emit_instr(buf, encode_ldp(REG_SYSCALL_LINUX, REG_ADDR, REG_SP, 48));
+    emit_instr(buf, encode_ldp(4, 5, REG_SP, 32));
+    emit_instr(buf, encode_ldp(2, 3, REG_SP, 16));
+    emit_instr(buf, encode_ldp_post(0, 1, REG_SP, 96));
+    emit_instr(buf, encode_ret());
+}
+
+/* hosted_io: the helpers hand the ranges to the C functions in BFIO.host instead of making
+ * syscalls. A C call may clobber x0-x17 and the link register, so all of them are kept; cached
+ * cells live in x3-x15 and survive the call like they survive a syscall */
+static void emit_host_call(CodeBuffer* buf, size_t callback, bool input, bool store_eof)
+{
+    emit_instr(buf, encode_stp_pre(0, 1, REG_SP, -160));
+    for (int reg = 2; reg < 18; reg += 2)
+        emit_instr(buf, encode_stp(reg, reg + 1, REG_SP, reg * 8));
+    emit_instr(buf, encode_stp(REG_LINK, 31, REG_SP, 144)); /* x31 is xzr here; keeps sp 16-byte aligned */
+
+    if (store_eof)
+    {
+        emit_add_const(buf, REG_FACTOR, REG_IO, offsetof(BFIO, eof_cell));
+        emit_instr(buf, encode_strb(REG_ADDR, REG_FACTOR));
+    }
+    emit_add_const(buf, REG_FACTOR, REG_IO, offsetof(BFIO, host));
+    emit_instr(buf, encode_str_x(REG_OUT_PTR, REG_FACTOR, offsetof(BFHost, out_ptr)));
+    emit_instr(buf, encode_ldr_x(REG_SYSCALL, REG_FACTOR, (int)(callback - offsetof(BFIO, host))));
+    emit_instr(buf, encode_mov_reg(0, REG_IO));
+    emit_instr(buf, encode_blr(REG_SYSCALL));
+
+    emit_add_const(buf, REG_FACTOR, REG_IO, offsetof(BFIO, host));
+    emit_instr(buf, encode_ldr_x(REG_OUT_PTR, REG_FACTOR, offsetof(BFHost, out_ptr)));
+    emit_instr(buf, encode_ldr_x(REG_OUT_END, REG_FACTOR, offsetof(BFHost, out_end)));
+    if (input)
+    {
+        emit_instr(buf, encode_ldr_x(REG_IN_PTR, REG_FACTOR, offsetof(BFHost, in_ptr)));
+        emit_instr(buf, encode_ldr_x(REG_IN_END, REG_FACTOR, offsetof(BFHost, in_end)));
+    }
+
+    emit_instr(buf, encode_ldp(REG_LINK, 31, REG_SP, 144));
+    for (int reg = 16; reg >= 2; reg -= 2)
+        emit_instr(buf, encode_ldp(reg, reg + 1, REG_SP, reg * 8));
+    emit_instr(buf, encode_ldp_post(0, 1, REG_SP, 160));
+    emit_instr(buf, encode_ret());
+}
+
+static void emit_hosted_flush_helper(CodeBuffer* buf)
+{
+    emit_host_call(buf, offsetof(BFIO, host.flush), false, false);
+}
+
+/* like emit_refill_helper, the old cell value comes in REG_ADDR for BF_EOF_UNCHANGED; the host
+ * flushes pending output itself before it waits for input */
+static void emit_hosted_refill_helper(CodeBuffer* buf, EofMode eof_mode)
+{
+    emit_host_call(buf, offsetof(BFIO, host.refill), true, eof_mode == BF_EOF_UNCHANGED);
+}
+
+/* X1 = an address in the string pool, patched in once the pool is placed (see place_strings); the
+ * far form reaches past adr's +/-1 MB. Returns the adr to patch */
+static int emit_data_adr(CodeBuffer* buf, bool far)
+{
+    int adr = arm_pc(buf);
+    emit_instr(buf, encode_adr(REG_BUF_PTR, 0));
+    if (far) /* adr takes its own address and the distance is added to that */
+    {
+        emit_instr(buf, encode_movz(REG_FACTOR, 0, 0));
+        emit_instr(buf, encode_movk(REG_FACTOR, 0, 1));
+        emit_instr(buf, encode_add_reg(REG_BUF_PTR, REG_BUF_PTR, REG_FACTOR));
+    }
+    return adr;
+}
+
+/* IR_OUTPUT_STR: one write of a constant string, straight from the read-only data behind the
+ * code, looping on partial writes like the flush helper. Returns the adr to patch */
+static int emit_output_str(CodeBuffer* buf, Target target, int length, bool far)
+{
+    emit_instr(buf, encode_mov_reg(REG_ADDR, REG_TAPE_PTR));
+    int adr = emit_data_adr(buf, far);
+    emit_mov_const(buf, REG_BUF_SIZE, (uint64_t)length);
+
+    int loop = arm_pc(buf);
+    emit_instr(buf, encode_mov_imm(0, 1)); /* stdout */
+    emit_syscall(buf, target, 64, 4); /* write */
+    int failed_second;
+    int failed = emit_branch_if_failed(buf, target, true, &failed_second);
+    emit_instr(buf, encode_add_reg(REG_BUF_PTR, REG_BUF_PTR, 0));
+    emit_instr(buf, encode_sub_reg(REG_BUF_SIZE, REG_BUF_SIZE, 0));
+    emit_instr(buf, encode_cbnz(REG_BUF_SIZE, compute_br_offset(buf, arm_pc(buf), loop)));
+
+    patch_failed_here(buf, failed, failed_second);
+    emit_instr(buf, encode_mov_reg(REG_TAPE_PTR, REG_ADDR));
+    return adr;
+}
+
+/* IR_OUTPUT_STR with hosted_io: the string is copied into the output range like so many '.'s,
+ * which leave it with room for one more. Returns the adr to patch */
+static int emit_hosted_output_str(CodeBuffer* buf, int length, bool far, int flush_pc)
+{
+    int adr = emit_data_adr(buf, far);
+    emit_mov_const(buf, REG_BUF_SIZE, (uint64_t)length);
+
+    int loop = arm_pc(buf);
+    emit_instr(buf, encode_ldrb_post(REG_ADDR, REG_BUF_PTR, 1));
+    emit_buffered_output(buf, REG_ADDR, flush_pc);
+    emit_instr(buf, encode_sub_imm(REG_BUF_SIZE, REG_BUF_SIZE, 1));
+    emit_instr(buf, encode_cbnz(REG_BUF_SIZE, compute_br_offset(buf, arm_pc(buf), loop)));
+    return adr;
+}
+
+/* append the string pool after the instructions and point each IR_OUTPUT_STR and IR_UPDATE_VEC at
+ * its data; `adrs` holds their adr instructions in program order. Returns false if some adr needs
+ * the far form */
+static bool place_strings(CodeBuffer* buf, IRProgram* program, const int* adrs, bool far)
+{
+    emit_bytes(buf, program->strings, program->string_size);
+
+    int n = 0;
+    for (size_t i = 0; i < program->size; i++)
+    {
+        if (program->ops[i].type != IR_OUTPUT_STR && program->ops[i].type != IR_UPDATE_VEC)
+            continue;
+
+        int adr = adrs[n++];
+        int64_t distance = (int64_t)(buf->text_size + program->ops[i].src) - (int64_t)adr * 4;
+        size_t pos = (size_t)adr * sizeof(uint32_t);
+        if (far)
         {
-            max_loop_id = op->loop_id;
+            write_u32(buf, pos, encode_adr(REG_BUF_PTR, 0));
+            write_u32(buf, pos + 4, encode_movz(REG_FACTOR, distance & 0xFFFF, 0));
+            write_u32(buf, pos + 8, encode_movk(REG_FACTOR, (distance >> 16) & 0xFFFF, 1));
         }
-        op = op->next;
+        else if (distance < (1 << 20))
+            write_u32(buf, pos, encode_adr(REG_BUF_PTR, (int32_t)distance));
+        else
+            return false;
     }
-    
-    int* loop_start_offsets = malloc((max_loop_id + 1) * sizeof(int));
-    int* loop_end_patches = malloc((max_loop_id + 1) * sizeof(int));
+    return true;
+}
+
+/* cells cached in registers; x9, x16 and x17 are taken and x0-x2 belong to the tape pointer and I/O */
+#define CACHE_REGS 12
+static const int cache_regs[CACHE_REGS] = { 3, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 15 };
 
-    if (!loop_start_offsets || !loop_end_patches) 
+typedef struct
+{
+    int offset;      /* cell offset relative to the current tape pointer */
+    bool valid;      /* register holds tape[ptr + offset] */
+    bool dirty;      /* register is newer than the tape */
+    bool normalized; /* bits above the low byte are zero, so cbz/cbnz can test the register directly */
+    unsigned age;    /* last use, for LRU eviction */
+} CachedCell;
+
+typedef struct
+{
+    CachedCell slots[CACHE_REGS];
+    unsigned clock;
+} CellCache;
+
+static void cache_write_back(CodeBuffer* buf, CellCache* cache, int slot)
+{
+    CachedCell* cell = &cache->slots[slot];
+    if (cell->valid && cell->dirty)
+    {
+        emit_store_cell(buf, cache_regs[slot], cell->offset); /* strb only stores the low byte */
+        cell->dirty = false;
+    }
+}
+
+/* write every dirty cell back; the registers stay valid */
+static void cache_flush(CodeBuffer* buf, CellCache* cache)
+{
+    for (int i = 0; i < CACHE_REGS; i++)
+        cache_write_back(buf, cache, i);
+}
+
+/* forget every cell; only call this once the tape is up to date */
+static void cache_invalidate(CellCache* cache)
+{
+    for (int i = 0; i < CACHE_REGS; i++)
+        cache->slots[i].valid = false;
+}
+
+/* the pointer moved by delta cells, so what was at offset k is now at offset k - delta */
+static void cache_rebase(CellCache* cache, int delta)
+{
+    for (int i = 0; i < CACHE_REGS; i++)
+        cache->slots[i].offset -= delta;
+}
+
+/* slot holding tape[ptr + offset], or -1 */
+static int cache_find(CellCache* cache, int offset)
+{
+    for (int i = 0; i < CACHE_REGS; i++)
+    {
+        if (cache->slots[i].valid && cache->slots[i].offset == offset)
+            return i;
+    }
+    return -1;
+}
+
+/* register holding tape[ptr + offset]; loads it when `load` is set, otherwise the caller overwrites it */
+static int cache_get(CodeBuffer* buf, CellCache* cache, int offset, bool load)
+{
+    int slot = cache_find(cache, offset);
+
+    if (slot < 0) /* miss; take a free register or evict the least recently used one */
+    {
+        slot = 0;
+        for (int i = 0; i < CACHE_REGS; i++)
+        {
+            if (!cache->slots[i].valid)
+            {
+                slot = i;
+                break;
+            }
+            if (cache->slots[i].age < cache->slots[slot].age)
+                slot = i;
+        }
+
+        cache_write_back(buf, cache, slot);
+        CachedCell* cell = &cache->slots[slot];
+        cell->offset = offset;
+        cell->valid = true;
+        cell->dirty = false;
+        cell->normalized = true;
+        if (load)
+            emit_load_cell(buf, cache_regs[slot], offset);
+    }
+
+    cache->slots[slot].age = ++cache->clock;
+    return slot;
+}
+
+/* slot holding tape[ptr + offset] with the upper bits cleared, ready for cbz/cbnz */
+static int cache_get_test(CodeBuffer* buf, CellCache* cache, int offset)
+{
+    int slot = cache_get(buf, cache, offset, true);
+    if (!cache->slots[slot].normalized)
+    {
+        emit_instr(buf, encode_uxtb(cache_regs[slot], cache_regs[slot]));
+        cache->slots[slot].normalized = true;
+    }
+    return slot;
+}
+
+/* forget everything except `slot`, which holds cell 0 and matches the tape; for labels
+ * where every incoming edge leaves the current cell in that register */
+static void cache_keep_only(CellCache* cache, int slot)
+{
+    cache_invalidate(cache);
+    CachedCell* cell = &cache->slots[slot];
+    cell->offset = 0;
+    cell->valid = true;
+    cell->dirty = false;
+    cell->normalized = true;
+}
+
+/* register about to be overwritten with a new value for tape[ptr + offset] */
+static int cache_def(CodeBuffer* buf, CellCache* cache, int offset, bool load, bool normalized)
+{
+    int slot = cache_get(buf, cache, offset, load);
+    cache->slots[slot].dirty = true;
+    cache->slots[slot].normalized = normalized;
+    return cache_regs[slot];
+}
+
+/* write back and forget the cells in [low, high), which are about to change in memory */
+static void cache_forget_range(CodeBuffer* buf, CellCache* cache, int low, int high)
+{
+    for (int i = 0; i < CACHE_REGS; i++)
+    {
+        CachedCell* cell = &cache->slots[i];
+        if (cell->valid && cell->offset >= low && cell->offset < high)
+        {
+            cache_write_back(buf, cache, i);
+            cell->valid = false;
+        }
+    }
+}
+
+/* load or store the `size` cells at tape[ptr + offset] in vector register vt */
+static void emit_vec_cells(CodeBuffer* buf, bool load, int vt, int offset, int size)
+{
+    if (offset >= 0 && offset % size == 0 && offset / size <= 4095)
+        emit_instr(buf, load ? encode_ldr_vec(vt, REG_TAPE_PTR, offset, size) : encode_str_vec(vt, REG_TAPE_PTR, offset, size));
+    else if (offset >= -256 && offset < 256)
+        emit_instr(buf, load ? encode_ldur_vec(vt, REG_TAPE_PTR, offset, size) : encode_stur_vec(vt, REG_TAPE_PTR, offset, size));
+    else
+    {
+        emit_cell_addr(buf, REG_ADDR, offset);
+        emit_instr(buf, load ? encode_ldr_vec(vt, REG_ADDR, 0, size) : encode_str_vec(vt, REG_ADDR, 0, size));
+    }
+}
+
+/* IR_UPDATE_VEC: v0 = cells, v1 = add, v2 = keep. Lanes that are all set skip the load of the
+ * cells and lanes that are all added skip the mask. Returns the adr of the constants to patch */
+static int emit_update_vec(CodeBuffer* buf, CellCache* cache, const IRProgram* program, IROperation* op, bool far)
+{
+    int size = op->value;
+    const uint8_t* keep = program->strings + op->src + size;
+    bool keep_all = true, keep_none = true;
+    for (int k = 0; k < size; k++)
+    {
+        keep_all &= keep[k] == 0xFF;
+        keep_none &= keep[k] == 0;
+    }
+
+    cache_forget_range(buf, cache, op->offset, op->offset + size);
+    int adr = emit_data_adr(buf, far);
+    emit_instr(buf, encode_ldr_vec(1, REG_BUF_PTR, 0, size));
+    if (keep_none)
+    {
+        emit_vec_cells(buf, false, 1, op->offset, size);
+        return adr;
+    }
+
+    emit_vec_cells(buf, true, 0, op->offset, size);
+    if (!keep_all)
+    {
+        emit_instr(buf, encode_ldr_vec(2, REG_BUF_PTR, size, size));
+        emit_instr(buf, encode_and_vec(0, 0, 2, size));
+    }
+    emit_instr(buf, encode_add_vec(0, 0, 1, size));
+    emit_vec_cells(buf, false, 0, op->offset, size);
+    return adr;
+}
+
+/* target += source * value, in a constant number of instructions; factors are taken
+ * mod 256 as signed so -1 is a plain subtract rather than a multiply by 255 */
+void emit_add_mul(CodeBuffer* buf, int target, int source, int value)
+{
+    int factor = value & 0xFF;
+    if (factor >= 128)
+        factor -= 256;
+
+    int magnitude = factor < 0 ? -factor : factor;
+    if ((magnitude & (magnitude - 1)) == 0) /* power of two, including 1: shifted add/sub */
+    {
+        int shift = __builtin_ctz(magnitude);
+        if (factor > 0)
+            emit_instr(buf, encode_add_shift(target, target, source, shift));
+        else
+            emit_instr(buf, encode_sub_shift(target, target, source, shift));
+    }
+    else /* target +/-= source * |factor| */
+    {
+        emit_instr(buf, encode_movz(REG_FACTOR, magnitude, 0));
+        if (factor > 0)
+            emit_instr(buf, encode_madd(target, source, REG_FACTOR, target));
+        else
+            emit_instr(buf, encode_msub(target, source, REG_FACTOR, target));
+    }
+}
+
+/* ',' with buffered input: a byte load from the input cursor, and a call out only when it runs
+ * dry. Nothing is syscalled inline, so the cache stays intact and the cell just gets a new value */
+static void emit_buffered_input(CodeBuffer* buf, CellCache* cache, int offset, EofMode eof_mode, int refill_pc)
+{
+    bool cached = cache_find(cache, offset) >= 0;
+    int reg = cache_def(buf, cache, offset, false, true);
+
+    emit_instr(buf, encode_cmp_reg(REG_IN_PTR, REG_IN_END));
+    int skip = arm_pc(buf);
+    emit_instr(buf, encode_b_cond(ARM64_COND_NE, 0));
+    if (eof_mode == BF_EOF_UNCHANGED) /* the refill helper hands the old value back at EOF */
+    {
+        if (cached)
+            emit_instr(buf, encode_mov_reg(REG_ADDR, reg));
+        else
+            emit_load_cell(buf, REG_ADDR, offset);
+    }
+    emit_helper_call(buf, refill_pc);
+    patch_br_here(buf, skip);
+    emit_instr(buf, encode_ldrb_post(reg, REG_IN_PTR, 1));
+}
+
+/* cell[ptr + op->offset] += cell[ptr + op->src] * op->value through the cell cache */
+static void emit_cached_add_mul(CodeBuffer* buf, CellCache* cache, IROperation* op)
+{
+    if ((op->value & 0xFF) == 0)
+        return;
+
+    int source = cache_regs[cache_get(buf, cache, op->src, true)]; /* just touched, so not the next victim */
+    int target = cache_def(buf, cache, op->offset, true, false);
+    emit_add_mul(buf, target, source, op->value);
+}
+
+/* nops until the next instruction starts on an `align`-byte boundary */
+static void emit_align(CodeBuffer* buf, int align)
+{
+    if (align <= (int)sizeof(uint32_t))
+        return;
+
+    while (buf->size % (size_t)align != 0)
+        emit_instr(buf, encode_nop());
+}
+
+static void emit_ptr_step(CodeBuffer* buf, int step)
+{
+    emit_add_const(buf, REG_TAPE_PTR, REG_TAPE_PTR, step);
+}
+
+/* strides the vector scan handles; they all divide 16, so every step of 16 cells lines up with the stride */
+static bool scan_vectorizable(int step)
+{
+    return step == 1 || step == 2 || step == 4 || step == 8 ||
+           step == -1 || step == -2 || step == -4 || step == -8;
+}
+
+/* cells tested one at a time before the vector loop. Most scans stop within a few cells, and a
+ * 16-byte load of cells that were just stored one byte at a time waits for the stores to retire */
+#define SCAN_PROBES 4
+
+/* vector scan: 16 cells per step. cmeq finds the zero bytes, shrn narrows that to a nibble per
+ * cell in a general register, and the cells the stride does not visit are masked out; the first
+ * (forward) or last (backward) remaining nibble is where the scan stops. Backward steps load the
+ * 16 cells ending at the pointer. Loads reach up to 15 cells past where the scan stops, which the
+ * BF_TAPE_PAD zeroes on either side of the tape cover. `tested` says the current cell is already
+ * known not to stop the scan */
+static void emit_vector_scan(CodeBuffer* buf, IROperation* op, int align, bool tested)
+{
+    bool until_zero = op->type == IR_SCAN_ZERO;
+    int step = op->value;
+    bool forward = step > 0;
+    int stride = forward ? step : -step;
+
+    int probes[SCAN_PROBES];
+    for (int i = 0; i < SCAN_PROBES; i++)
+    {
+        if (tested || i > 0)
+            emit_ptr_step(buf, step);
+        emit_instr(buf, encode_ldrb(REG_TEMP, REG_TAPE_PTR));
+        probes[i] = arm_pc(buf);
+        emit_instr(buf, until_zero ? encode_cbz(REG_TEMP, 0) : encode_cbnz(REG_TEMP, 0));
+    }
+
+    /* nibbles of the cells at 0, stride, 2 * stride, ...; from the top for backward scans */
+    uint64_t lanes = stride == 1 ? ~0ull : stride == 2 ? 0x0F0F0F0F0F0F0F0Full :
+                     stride == 4 ? 0x000F000F000F000Full : 0x0000000F0000000Full;
+    if (!forward)
+        lanes <<= 4 * (stride - 1);
+    if (!until_zero || stride != 1)
+        emit_mov_const(buf, REG_FACTOR, lanes);
+
+    emit_ptr_step(buf, forward ? -16 : 16); /* the loop steps first */
+    emit_align(buf, align);
+    int head = arm_pc(buf);
+    emit_ptr_step(buf, forward ? 16 : -16);
+    emit_instr(buf, forward ? encode_ldr_q(0, REG_TAPE_PTR, 0) : encode_ldur_q(0, REG_TAPE_PTR, -15));
+    emit_instr(buf, encode_cmeq_zero_16b(0, 0));
+    emit_instr(buf, encode_shrn_8b(0, 0, 4));
+    emit_instr(buf, encode_umov_d0(REG_TEMP, 0));
+    if (!until_zero) /* the cells that are not zero */
+        emit_instr(buf, encode_bic_reg(REG_TEMP, REG_FACTOR, REG_TEMP));
+    else if (stride != 1)
+        emit_instr(buf, encode_and_reg(REG_TEMP, REG_TEMP, REG_FACTOR));
+    emit_instr(buf, encode_cbz(REG_TEMP, compute_br_offset(buf, arm_pc(buf), head)));
+
+    if (forward) /* count trailing zeros */
+        emit_instr(buf, encode_rbit(REG_TEMP, REG_TEMP));
+    emit_instr(buf, encode_clz(REG_TEMP, REG_TEMP));
+    emit_instr(buf, encode_lsr(REG_TEMP, REG_TEMP, 2)); /* nibbles to cells */
+    emit_instr(buf, forward ? encode_add_reg(REG_TAPE_PTR, REG_TAPE_PTR, REG_TEMP)
+                            : encode_sub_reg(REG_TAPE_PTR, REG_TAPE_PTR, REG_TEMP));
+    for (int i = 0; i < SCAN_PROBES; i++)
+        patch_br_here(buf, probes[i]);
+}
+
+/* rotated scan: test the cached cell once up front, then step/load/branch with a single
+ * bottom test; the cell the scan stops on ends up in the same register on both paths */
+static void emit_rotated_scan(CodeBuffer* buf, CellCache* cache, IROperation* op, int align, bool vector)
+{
+    bool until_zero = op->type == IR_SCAN_ZERO;
+    int slot = cache_get_test(buf, cache, 0);
+    int reg = cache_regs[slot];
+    cache_flush(buf, cache); /* the pointer moves by an unknown amount */
+
+    int guard = arm_pc(buf); /* skip the scan if we are already there */
+    emit_instr(buf, until_zero ? encode_cbz(reg, 0) : encode_cbnz(reg, 0));
+
+    if (vector)
+    {
+        emit_vector_scan(buf, op, align, true);
+        emit_instr(buf, encode_ldrb(reg, REG_TAPE_PTR));
+        patch_br_here(buf, guard);
+        cache_keep_only(cache, slot);
+        return;
+    }
+
+    emit_align(buf, align);
+    int head = arm_pc(buf);
+    emit_ptr_step(buf, op->value);
+    emit_instr(buf, encode_ldrb(reg, REG_TAPE_PTR));
+
+    int32_t back = compute_br_offset(buf, arm_pc(buf), head);
+    emit_instr(buf, until_zero ? encode_cbnz(reg, back) : encode_cbz(reg, back));
+    patch_br(buf, guard, compute_br_offset(buf, guard, arm_pc(buf)));
+
+    cache_keep_only(cache, slot);
+}
+
+/* cbz/cbnz reach +/-1 MB and b reaches +/-128 MB; offsets are in bytes */
+static bool cond_branch_fits(int32_t offset)
+{
+    return offset >= -(1 << 20) && offset < (1 << 20);
+}
+
+static bool branch_fits(int32_t offset)
+{
+    return offset >= -(1 << 27) && offset < (1 << 27);
+}
+
+/* forward branch taken when reg is zero (or non-zero), target patched later; returns the
+ * instruction to patch. The long form skips over a b with the inverted test */
+static int emit_branch_fwd(CodeBuffer* buf, int reg, bool if_zero, bool is_long)
+{
+    if (is_long)
+    {
+        emit_instr(buf, if_zero ? encode_cbnz(reg, 8) : encode_cbz(reg, 8));
+        emit_instr(buf, encode_b(0));
+    }
+    else
+    {
+        emit_instr(buf, if_zero ? encode_cbz(reg, 0) : encode_cbnz(reg, 0));
+    }
+    return arm_pc(buf) - 1;
+}
+
+/* backward branch to `target` taken when reg is zero (or non-zero); returns the offset that was encoded */
+static int32_t emit_branch_back(CodeBuffer* buf, int reg, bool if_zero, int target, bool is_long)
+{
+    if (is_long)
+        emit_instr(buf, if_zero ? encode_cbnz(reg, 8) : encode_cbz(reg, 8));
+
+    int32_t offset = compute_br_offset(buf, arm_pc(buf), target);
+    if (is_long)
+        emit_instr(buf, encode_b(offset));
+    else
+        emit_instr(buf, if_zero ? encode_cbz(reg, offset) : encode_cbnz(reg, offset));
+    return offset;
+}
+
+/* one code generation pass; loops flagged in long_loops get the long branch form, and
+ * *relaxed is set when some other loop turned out to need it */
+static CodeBuffer* codegen_pass(IRProgram* program, const CodegenOptions* options, bool* long_loops, bool* far_strings,
+                                bool* relaxed)
+{
+    CodeBuffer* buf = create_code_buffer(5000 * sizeof(uint32_t));
+    if (!buf) 
+    {
+        fprintf(stderr, "Failed to create code buffer\n");
+        return NULL;
+    }
+
+    /* loop tracking; open loops never share a depth so one slot per nesting level is enough */
+    size_t open_slots = (size_t)program->max_depth + 1;
+    int* loop_start_offsets = malloc(open_slots * sizeof(int));
+    int* loop_end_patches = malloc(open_slots * sizeof(int));
+    int* loop_head_slots = malloc(open_slots * sizeof(int)); /* cache slot holding cell 0 at a rotated loop head */
+
+    size_t string_count = 0; /* ops that read the string pool */
+    for (size_t i = 0; i < program->size; i++)
+        string_count += program->ops[i].type == IR_OUTPUT_STR || program->ops[i].type == IR_UPDATE_VEC;
+    int* string_adrs = malloc((string_count + 1) * sizeof(int));
+    int string_index = 0;
+
+    if (!loop_start_offsets || !loop_end_patches || !loop_head_slots || !string_adrs) 
     {
         fprintf(stderr, "Memory allocation error\n");
         free_code_buffer(buf);
         free(loop_start_offsets);
         free(loop_end_patches);
+        free(loop_head_slots);
+        free(string_adrs);
         return NULL;
     }
 
-    memset(loop_start_offsets, -1, (max_loop_id + 1) * sizeof(int));
-    memset(loop_end_patches, -1, (max_loop_id + 1) * sizeof(int));
+    /* cells live in registers within a straight-line run and go back to the tape at
+     * loop edges, I/O and scans, where control flow merges or memory is read directly */
+    CellCache cache;
+    memset(&cache, 0, sizeof(cache));
+
+    /* buffered I/O: the function is entered with the BFIO block in x1. The runtime helpers go
+     * first, behind a branch, so every call to one is a backward bl with a known target */
+    int flush_pc = -1;
+    int refill_pc = -1;
+    bool buffered_io = options->buffered_output || options->buffered_input || options->profile; /* counters are found through REG_IO */
+    if (buffered_io)
+    {
+        int skip = arm_pc(buf);
+        emit_instr(buf, encode_b(0));
+        if (options->hosted_io)
+        {
+            flush_pc = arm_pc(buf);
+            emit_hosted_flush_helper(buf);
+            refill_pc = arm_pc(buf);
+            emit_hosted_refill_helper(buf, options->eof_mode);
+        }
+        else
+        {
+            if (options->buffered_output)
+            {
+                flush_pc = arm_pc(buf);
+                emit_flush_helper(buf, options->target);
+            }
+            if (options->buffered_input)
+            {
+                refill_pc = arm_pc(buf);
+                emit_refill_helper(buf, options->target, options->eof_mode, flush_pc);
+            }
+        }
+        patch_br_here(buf, skip);
+
+        emit_instr(buf, encode_stp_pre(REG_OUT_PTR, REG_OUT_END, REG_SP, -48));
+        emit_instr(buf, encode_stp(REG_IO, REG_LINK, REG_SP, 16));
+        emit_instr(buf, encode_stp(REG_IN_PTR, REG_IN_END, REG_SP, 32));
+        emit_instr(buf, encode_mov_reg(REG_IO, REG_BUF_PTR));
+        if (options->hosted_io) /* the host has set both ranges up */
+        {
+            emit_add_const(buf, REG_FACTOR, REG_IO, offsetof(BFIO, host));
+            emit_instr(buf, encode_ldr_x(REG_OUT_PTR, REG_FACTOR, offsetof(BFHost, out_ptr)));
+            emit_instr(buf, encode_ldr_x(REG_OUT_END, REG_FACTOR, offsetof(BFHost, out_end)));
+            emit_instr(buf, encode_ldr_x(REG_IN_PTR, REG_FACTOR, offsetof(BFHost, in_ptr)));
+            emit_instr(buf, encode_ldr_x(REG_IN_END, REG_FACTOR, offsetof(BFHost, in_end)));
+        }
+        else
+        {
+            emit_instr(buf, encode_mov_reg(REG_OUT_PTR, REG_BUF_PTR));
+            emit_add_const(buf, REG_OUT_END, REG_BUF_PTR, BF_OUT_BUFFER);
+            emit_instr(buf, encode_mov_imm(REG_IN_PTR, 0)); /* empty, so the first ',' refills */
+            emit_instr(buf, encode_mov_imm(REG_IN_END, 0));
+        }
+    }
 
-    op = program->first;
-    while (op)
+    int loop_id = -1; /* innermost loop around the op */
+    for (size_t i = 0; i < program->size; i++)
     {
+        IROperation* op = &program->ops[i];
         switch (op->type) 
         {
             case IR_PTR_ADD:
             {
-                    emit_instr(buf, encode_add_imm(REG_TAPE_PTR, REG_TAPE_PTR, op->value));
-                    break;
+                emit_add_const(buf, REG_TAPE_PTR, REG_TAPE_PTR, op->value);
+                cache_rebase(&cache, op->value);
+                break;
             }
                 
             case IR_PTR_SUB:
             { 
-                emit_instr(buf, encode_sub_imm(REG_TAPE_PTR, REG_TAPE_PTR, op->value));
+                emit_add_const(buf, REG_TAPE_PTR, REG_TAPE_PTR, -(int64_t)op->value);
+                cache_rebase(&cache, -op->value);
                 break;
             }
                 
             case IR_VAL_ADD:
             {    
-                emit_instr(buf, encode_ldrb(REG_TEMP, REG_TAPE_PTR));
-                emit_instr(buf, encode_add_imm(REG_TEMP, REG_TEMP, op->value));
-                emit_instr(buf, encode_strb(REG_TEMP, REG_TAPE_PTR));
+                int reg = cache_def(buf, &cache, op->offset, true, false);
+                emit_instr(buf, encode_add_imm(reg, reg, op->value & 0xFF)); /* cells wrap at 256 */
                 break;
             }
                 
             case IR_VAL_SUB:
             { 
-                emit_instr(buf, encode_ldrb(REG_TEMP, REG_TAPE_PTR));
-                emit_instr(buf, encode_sub_imm(REG_TEMP, REG_TEMP, op->value));
-                emit_instr(buf, encode_strb(REG_TEMP, REG_TAPE_PTR));
+                int reg = cache_def(buf, &cache, op->offset, true, false);
+                emit_instr(buf, encode_sub_imm(reg, reg, op->value & 0xFF));
                 break; 
             }
                 
             case IR_OUTPUT: 
             {
-                emit_io_op(buf, 1); /* output = true */
+                if (options->buffered_output) /* no syscall inline, so the cache stays intact */
+                {
+                    int reg = cache_regs[cache_get(buf, &cache, op->offset, true)];
+                    emit_buffered_output(buf, reg, flush_pc);
+                    break;
+                }
+
+                cache_flush(buf, &cache);
+                cache_invalidate(&cache); /* the syscall is free to clobber caller-saved registers */
+                emit_io_op(buf, options->target, 1, op->offset); /* output = true */
                 break;
             }
                 
+            case IR_OUTPUT_STR:
+            {
+                if (options->hosted_io) /* no syscall inline, so the cache stays intact */
+                {
+                    string_adrs[string_index++] = emit_hosted_output_str(buf, op->value, *far_strings, flush_pc);
+                    break;
+                }
+                cache_flush(buf, &cache);
+                cache_invalidate(&cache);
+                if (options->buffered_output) /* whatever is buffered goes out first */
+                    emit_helper_call(buf, flush_pc);
+                string_adrs[string_index++] = emit_output_str(buf, options->target, op->value, *far_strings);
+                break;
+            }
+
+            case IR_UPDATE_VEC:
+                string_adrs[string_index++] = emit_update_vec(buf, &cache, program, op, *far_strings);
+                break;
+
             case IR_INPUT:
             {
-                emit_io_op(buf, 0); /* output = false */
+                if (options->buffered_input)
+                {
+                    emit_buffered_input(buf, &cache, op->offset, options->eof_mode, refill_pc);
+                    break;
+                }
+
+                cache_flush(buf, &cache);
+                cache_invalidate(&cache);
+                if (options->buffered_output) /* prompts must be out before we block on a read */
+                    emit_helper_call(buf, flush_pc);
+                emit_io_op(buf, options->target, 0, op->offset); /* output = false */
                 break;
             }
 
             case IR_LOOP_START:
             {   
-                loop_start_offsets[op->loop_id] = buf->size; /* record the start position of this loop */
-                emit_instr(buf, encode_ldrb(REG_TEMP, REG_TAPE_PTR)); /* then load value at pointer */
+                int depth = program->loops[op->loop_id].depth;
+                loop_id = op->loop_id;
+                int align = loop_align_for(program, loop_id, options);
+                if (options->profile)
+                    emit_count(buf, 2 * loop_id); /* reached */
+                if (options->rotate_loops)
+                {
+                    /* guard: skip the loop entirely if the cell is already zero */
+                    int slot = cache_get_test(buf, &cache, 0);
+                    cache_flush(buf, &cache);
+                    loop_end_patches[depth] = emit_branch_fwd(buf, cache_regs[slot], true, long_loops[op->loop_id]);
+
+                    /* the back-edge arrives with cell 0 in the same register, so it stays cached */
+                    cache_keep_only(&cache, slot);
+                    loop_head_slots[depth] = slot;
+                    emit_align(buf, align);
+                    loop_start_offsets[depth] = arm_pc(buf);
+                    if (options->profile)
+                        emit_count(buf, 2 * loop_id + 1); /* one more iteration */
+                    break;
+                }
+
+                /* the back-edge lands here too, so nothing may be cached across the label */
+                cache_flush(buf, &cache);
+                cache_invalidate(&cache);
+                emit_align(buf, align);
+
+                loop_start_offsets[depth] = arm_pc(buf); /* record the start position of this loop */
+                int reg = cache_regs[cache_get_test(buf, &cache, 0)]; /* the loaded value stays cached for the body */
                 
                 /* branch to end of loop if zero; will be patched later in the second pass */
-                emit_instr(buf, encode_cbz(REG_TEMP, 0));
-                loop_end_patches[op->loop_id] = buf->size - 1;
+                loop_end_patches[depth] = emit_branch_fwd(buf, reg, true, long_loops[op->loop_id]);
+                if (options->profile)
+                    emit_count(buf, 2 * loop_id + 1);
                 break;
             }
                 
             case IR_LOOP_END:
             {  
-                emit_instr(buf, encode_ldrb(REG_TEMP, REG_TAPE_PTR)); /* load value at pointer */
+                int depth = program->loops[op->loop_id].depth;
+                loop_id = program->loops[op->loop_id].parent;
+                int slot = cache_get_test(buf, &cache, 0); /* usually still live from the body */
+                cache_flush(buf, &cache);
+
+                if (options->rotate_loops)
+                {
+                    /* single bottom test; hand cell 0 over in the register the head expects */
+                    int head = loop_head_slots[depth];
+                    if (slot != head)
+                        emit_instr(buf, encode_mov_reg(cache_regs[head], cache_regs[slot]));
+                    slot = head;
+                }
+                cache_invalidate(&cache);
                 
                 /* branch back to start of loop if not zero */
-                int32_t backwards_offset = compute_br_offset(
-                    buf, buf->size, loop_start_offsets[op->loop_id]);
-
-                emit_instr(buf, encode_cbnz(REG_TEMP, backwards_offset));
+                bool is_long = long_loops[op->loop_id];
+                int32_t backwards_offset = emit_branch_back(buf, cache_regs[slot], false, loop_start_offsets[depth], is_long);
                 
                 /* patch the forward jump from loop start */
-                if (loop_end_patches[op->loop_id] >= 0)
+                int32_t forwards_offset = compute_br_offset(
+                    buf, loop_end_patches[depth], arm_pc(buf));
+                patch_br(buf, loop_end_patches[depth], forwards_offset);
+
+                if (!is_long && (!cond_branch_fits(backwards_offset) || !cond_branch_fits(forwards_offset)))
                 {
-                    int32_t forwards_offset = compute_br_offset(
-                        buf, loop_end_patches[op->loop_id], buf->size);
-                    patch_br(buf, loop_end_patches[op->loop_id], forwards_offset);
-                } 
-                else 
+                    long_loops[op->loop_id] = true; /* out of cbz/cbnz range; regenerate with the long form */
+                    *relaxed = true;
+                }
+                else if (is_long && (!branch_fits(backwards_offset) || !branch_fits(forwards_offset)))
                 {
-                    fprintf(stderr, "Warning: Unmatched loop end for loop ID %d\n", op->loop_id);
+                    fprintf(stderr, "Error: loop body exceeds the 128 MB branch range\n");
+                    free(loop_start_offsets);
+                    free(loop_end_patches);
+                    free(loop_head_slots);
+                    free(string_adrs);
+                    free_code_buffer(buf);
+                    return NULL;
                 }
+
+                if (options->rotate_loops) /* guard and back-edge both fall out with cell 0 == 0 in the head register */
+                    cache_keep_only(&cache, slot);
                 break;
             }
                 
             case IR_SET_ZERO:
             {
-                emit_instr(buf, encode_strb_offset(31, REG_TAPE_PTR, 0)); /* XZR = zero register */
+                int reg = cache_def(buf, &cache, op->offset, false, true);
+                emit_instr(buf, encode_movz(reg, 0, 0));
                 break;
             }
                 
             case IR_SET_VAL: /* set current cell to a specific value */
             {    
-                emit_instr(buf, encode_mov_imm(REG_TEMP, op->value));
-                emit_instr(buf, encode_strb(REG_TEMP, REG_TAPE_PTR));
+                int reg = cache_def(buf, &cache, op->offset, false, true);
+                emit_instr(buf, encode_movz(reg, op->value & 0xFF, 0));
                 break;
             }
                 
-            case IR_ADD_MUL: /* add multiplication: cell[ptr+offset] += cell[ptr] * factor */
+            case IR_ADD_MUL: /* add multiplication: cell[ptr+offset] += cell[ptr+src] * factor */
             {
-                emit_instr(buf, encode_ldrb(REG_TEMP, REG_TAPE_PTR)); /* load source value */
-                emit_instr(buf, encode_mov_reg(9, REG_TAPE_PTR)); /* save the original stack pointer */
-                emit_instr(buf, encode_add_imm(REG_TAPE_PTR, REG_TAPE_PTR, op->offset)); /* move to target cell */
-                emit_instr(buf, encode_ldrb(2, REG_TAPE_PTR)); /* load target */
-                for (int i = 0; i < op->value; i++) 
-                    emit_instr(buf, encode_add_imm(2, 2, REG_TEMP)); /* perform mult by repeated addition */
-                
-                emit_instr(buf, encode_strb(2, REG_TAPE_PTR)); /* store result*/
-                emit_instr(buf, encode_mov_reg(REG_TAPE_PTR, 9)); /* restore the pointer */
-                emit_instr(buf, encode_strb_offset(31, REG_TAPE_PTR, 0)); /* clear the source cell buffer */
+                emit_cached_add_mul(buf, &cache, op);
                 break;
             }
                 
-            case IR_MOVE_VAL: /* move operation: cell[ptr+offset] += cell[ptr], cell[ptr] = 0 */
+            case IR_MOVE_VAL: /* move operation: cell[ptr+offset] += cell[ptr+src] * factor, cell[ptr+src] = 0 */
             {
-                emit_instr(buf, encode_ldrb(REG_TEMP, REG_TAPE_PTR)); /* load source value */
-                emit_instr(buf, encode_mov_reg(9, REG_TAPE_PTR)); /* save stack pointer */
-                emit_instr(buf, encode_add_imm(REG_TAPE_PTR, REG_TAPE_PTR, op->offset)); /* move to target cell */
-                emit_instr(buf, encode_ldrb(2, REG_TAPE_PTR)); /* load target value */
-                emit_instr(buf, encode_add_imm(2, 2, REG_TEMP)); /* add source to target */
-                emit_instr(buf, encode_strb(2, REG_TAPE_PTR)); /* store result */
-                
-                emit_instr(buf, encode_mov_reg(REG_TAPE_PTR, 9)); /* restore pointer */
-                emit_instr(buf, encode_strb_offset(31, REG_TAPE_PTR, 0)); /* clear the source cell buffer */
+                emit_cached_add_mul(buf, &cache, op);
+                int reg = cache_def(buf, &cache, op->src, false, true); /* clear the source cell */
+                emit_instr(buf, encode_movz(reg, 0, 0));
                 break;
             }  
             case IR_SCAN_ZERO: /* scan until finding a zero: while (*ptr) ptr += step */
+            case IR_SCAN_NONZERO: /* scan until finding non-zero: while (!*ptr) ptr += step */
             {
-                int scan_start = buf->size;
-                
-                emit_instr(buf, encode_ldrb(REG_TEMP, REG_TAPE_PTR)); /* load current cell */
-                emit_instr(buf, encode_cbz(REG_TEMP, 0)); /* if zero then exit loop */
-                int scan_patch = buf->size - 1;
-                
-                /* move pointer in steps */
-                if (op->value > 0) 
-                {
-                    emit_instr(buf, encode_add_imm(REG_TAPE_PTR, REG_TAPE_PTR, op->value));
-                } 
-                else 
+                bool vector = options->vector_scans && !loop_is_cold(program, loop_id) && scan_vectorizable(op->value);
+                int align = loop_align_for(program, loop_id, options);
+                if (options->rotate_loops)
                 {
-                    emit_instr(buf, encode_sub_imm(REG_TAPE_PTR, REG_TAPE_PTR, -op->value));
+                    emit_rotated_scan(buf, &cache, op, align, vector);
+                    break;
                 }
-                    
-                /* jump back to start of scan */
-                int32_t scan_back = compute_br_offset(buf, buf->size, scan_start);
-                emit_instr(buf, encode_b(scan_back));
-                    
-                /* then patch the exit point */
-                int32_t scan_exit = compute_br_offset(buf, scan_patch, buf->size);
-                patch_br(buf, scan_patch, scan_exit);
 
-                break;
-            }
+                cache_flush(buf, &cache);
+                cache_invalidate(&cache); /* the pointer moves by an unknown amount */
+                if (vector)
+                {
+                    emit_vector_scan(buf, op, align, false);
+                    break;
+                }
+                emit_align(buf, align);
+                int scan_start = arm_pc(buf);
                 
-            case IR_SCAN_NONZERO: /* scan until finding non-zero: while (!*ptr) ptr += step */
-            {
-                int scan_start = buf->size;
                 emit_instr(buf, encode_ldrb(REG_TEMP, REG_TAPE_PTR)); /* load current cell */
+                if (op->type == IR_SCAN_ZERO)
+                    emit_instr(buf, encode_cbz(REG_TEMP, 0)); /* if zero then exit loop */
+                else
+                    emit_instr(buf, encode_cbnz(REG_TEMP, 0)); /* if non-zero, exit loop */
+                int scan_patch = arm_pc(buf) - 1;
                 
-                emit_instr(buf, encode_cbnz(REG_TEMP, 0)); /* if non-zero, exit loop */
-                int scan_patch = buf->size - 1;
-                    
-                /* move pointer by step */
-                if (op->value > 0) 
-                {
-                    emit_instr(buf, encode_add_imm(REG_TAPE_PTR, REG_TAPE_PTR, op->value));
-                } 
-                else 
-                {
-                    emit_instr(buf, encode_sub_imm(REG_TAPE_PTR, REG_TAPE_PTR, -op->value));
-                }
+                emit_ptr_step(buf, op->value); /* move pointer in steps */
                     
                 /* jump back to start of scan */
-                int32_t scan_back = compute_br_offset(buf, buf->size, scan_start);
+                int32_t scan_back = compute_br_offset(buf, arm_pc(buf), scan_start);
                 emit_instr(buf, encode_b(scan_back));
                     
-                /* patch the exit point */
-                int32_t scan_exit = compute_br_offset(buf, scan_patch, buf->size);
+                /* then patch the exit point */
+                int32_t scan_exit = compute_br_offset(buf, scan_patch, arm_pc(buf));
                 patch_br(buf, scan_patch, scan_exit);
                 break;
             }
@@ -337,17 +1252,71 @@ CodeBuffer* codegen(IRProgram* program)
             case IR_CONDITIONAL: /* for advanced optimizations */
                 fprintf(stderr, "Warning: IR_CONDITIONAL is yet to be implemented\n");
                 break;
+
+            case IR_NOP: /* tombstone; nothing to emit */
+                break;
         }
-        
-        op = op->next;
     }
     
+    cache_flush(buf, &cache); /* leaving the block; the tape must hold every cell */
+
     /** runtime epilogue */
-    emit_instr(buf, encode_mov_imm(0, 0)); /* need to return 0 otherwise we getting ugly return value :( */
+    if (options->buffered_output)
+        emit_helper_call(buf, flush_pc);
+    if (!options->return_ptr) /* otherwise X0 already holds the tape pointer */
+        emit_instr(buf, encode_mov_imm(0, 0)); /* need to return 0 otherwise we getting ugly return value :( */
+    if (buffered_io)
+    {
+        emit_instr(buf, encode_ldp(REG_IN_PTR, REG_IN_END, REG_SP, 32));
+        emit_instr(buf, encode_ldp(REG_IO, REG_LINK, REG_SP, 16));
+        emit_instr(buf, encode_ldp_post(REG_OUT_PTR, REG_OUT_END, REG_SP, 48));
+    }
     emit_instr(buf, encode_ret()); /* ret */
+    finish_code_buffer(buf);
+
+    if (!place_strings(buf, program, string_adrs, *far_strings))
+    {
+        *far_strings = true;
+        *relaxed = true;
+    }
     
     /* clean up */
     free(loop_start_offsets);
     free(loop_end_patches);
+    free(loop_head_slots);
+    free(string_adrs);
+    return buf;
+}
+
+CodeBuffer* codegen_arm64(IRProgram* program, const CodegenOptions* options)
+{
+    if (!program)
+    {
+        fprintf(stderr, "Empty program to compile\n");
+        return NULL;
+    }
+
+    bool* long_loops = calloc(program->loop_count + 1, sizeof(bool));
+    if (!long_loops)
+    {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    /* branch relaxation: every loop starts with the short cbz/cbnz form and any that end up
+     * out of range are regenerated in the long form; long forms only grow the code, so each
+     * pass flags a superset of the last and this settles after a few passes */
+    CodeBuffer* buf;
+    bool far_strings = false; /* the same, for the string data behind the code */
+    for (;;)
+    {
+        bool relaxed = false;
+        buf = codegen_pass(program, options, long_loops, &far_strings, &relaxed);
+        if (!buf || !relaxed)
+            break;
+        free_code_buffer(buf);
+    }
+
+    free(long_loops);
     return buf;
-}
\ No newline at end of file
+}
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "arm64_encoder.h"
+#include "bfc.h"
+#include "x86_encoder.h"
+
+/* a static, non-PIE ELF64 executable written by hand, so no linker is needed:
+ *
+ *   0x400000  ELF header, program headers
+ *             _start stub: tape address -> first argument, call bf_main, exit with its result
+ *             bf_main: the generated code, ending in ret
+ *             .rodata: the code buffer's read-only data, right behind the code
+ *   ...       .bss: the tape with BF_TAPE_PAD cells either side, then the BFIO block, in its
+ *             own RW segment
+ *
+ * Section headers and a symbol table follow in the file (not loaded) so objdump and perf
+ * can name the pieces. The structures are spelled out here since macOS has no <elf.h> */
+
+#define ELF_BASE 0x400000ull
+#define ELF_PAGE 0x10000ull /* covers 4K, 16K and 64K page kernels */
+
+typedef struct
+{
+    uint8_t e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} Elf64Header;
+
+typedef struct
+{
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+} Elf64ProgramHeader;
+
+typedef struct
+{
+    uint32_t sh_name;
+    uint32_t sh_type;
+    uint64_t sh_flags;
+    uint64_t sh_addr;
+    uint64_t sh_offset;
+    uint64_t sh_size;
+    uint32_t sh_link;
+    uint32_t sh_info;
+    uint64_t sh_addralign;
+    uint64_t sh_entsize;
+} Elf64SectionHeader;
+
+typedef struct
+{
+    uint32_t st_name;
+    uint8_t st_info;
+    uint8_t st_other;
+    uint16_t st_shndx;
+    uint64_t st_value;
+    uint64_t st_size;
+} Elf64Symbol;
+
+#define ET_EXEC 2
+#define EM_X86_64 62
+#define EM_AARCH64 183
+#define PT_LOAD 1
+#define PT_GNU_STACK 0x6474e551
+#define PF_X 1
+#define PF_W 2
+#define PF_R 4
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_NOBITS 8
+#define SHF_WRITE 1
+#define SHF_ALLOC 2
+#define SHF_EXECINSTR 4
+#define STB_GLOBAL 1
+#define STT_OBJECT 1
+#define STT_FUNC 2
+
+/* section indices, in the order they are written */
+enum { SEC_NULL, SEC_TEXT, SEC_RODATA, SEC_BSS, SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB, SEC_COUNT };
+
+static const char shstrtab[] = "\0.text\0.rodata\0.bss\0.symtab\0.strtab\0.shstrtab";
+static const char strtab[] = "\0_start\0bf_main\0bf_tape\0bf_io";
+
+static size_t align_up(size_t value, size_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+/* _start for x86-64 Linux; rsp is 16-byte aligned at entry, which the call keeps sane */
+static void emit_x86_start(CodeBuffer* stub, uint64_t stub_addr, uint64_t main_addr, uint64_t tape_addr, uint64_t io_addr)
+{
+    x86_mov_r32_imm(stub, X86_RDI, (uint32_t)tape_addr); /* non-PIE, so the addresses fit in 32 bits */
+    x86_mov_r32_imm(stub, X86_RSI, (uint32_t)io_addr);
+    emit_byte(stub, 0xE8); /* call rel32 */
+    emit_u32(stub, (uint32_t)(int32_t)(main_addr - (stub_addr + stub->size + 4)));
+    x86_mov_r64_r64(stub, X86_RDI, X86_RAX); /* exit status = return value */
+    x86_mov_r32_imm(stub, X86_RAX, 231); /* exit_group */
+    x86_syscall(stub);
+}
+
+/* _start for AArch64 Linux; x0 carries both the tape and the exit status */
+static void emit_arm64_start(CodeBuffer* stub, uint64_t stub_addr, uint64_t main_addr, uint64_t tape_addr, uint64_t io_addr)
+{
+    emit_u32(stub, encode_movz(0, tape_addr & 0xFFFF, 0));
+    emit_u32(stub, encode_movk(0, (tape_addr >> 16) & 0xFFFF, 1));
+    emit_u32(stub, encode_movz(1, io_addr & 0xFFFF, 0));
+    emit_u32(stub, encode_movk(1, (io_addr >> 16) & 0xFFFF, 1));
+    emit_u32(stub, encode_bl((int32_t)(main_addr - (stub_addr + stub->size))));
+    emit_u32(stub, encode_movz(8, 94, 0)); /* exit_group */
+    emit_u32(stub, encode_svc(0));
+}
+
+int write_elf(const char* filename, const CodeBuffer* buf, Target target)
+{
+    if (target != TARGET_X86_64_LINUX && target != TARGET_ARM64_LINUX)
+    {
+        fprintf(stderr, "Error: ELF output needs a Linux target\n");
+        return -1;
+    }
+
+    /* file layout; everything up to the end of .rodata is one RX segment at ELF_BASE */
+    size_t phdrs_offset = sizeof(Elf64Header);
+    size_t phnum = 3;
+    size_t stub_offset = align_up(phdrs_offset + phnum * sizeof(Elf64ProgramHeader), 16);
+    size_t stub_size = 32; /* both stubs fit */
+    size_t main_offset = align_up(stub_offset + stub_size, 16);
+    size_t rodata_offset = main_offset + buf->text_size;
+    size_t load_end = main_offset + buf->size;
+
+    uint64_t bss_addr = align_up(ELF_BASE + load_end, ELF_PAGE);
+    uint64_t tape_addr = bss_addr + BF_TAPE_PAD;
+    uint64_t io_addr = align_up(tape_addr + BF_TAPE_SIZE + BF_TAPE_PAD, 16);
+    uint64_t bss_size = io_addr + sizeof(BFIO) - bss_addr;
+    if (bss_addr + bss_size > 0xFFFFFFFFull)
+    {
+        fprintf(stderr, "Error: program too large for a 32-bit tape address\n");
+        return -1;
+    }
+
+    CodeBuffer* stub = create_code_buffer(stub_size);
+    if (!stub)
+    {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+
+    if (target == TARGET_X86_64_LINUX)
+        emit_x86_start(stub, ELF_BASE + stub_offset, ELF_BASE + main_offset, tape_addr, io_addr);
+    else
+        emit_arm64_start(stub, ELF_BASE + stub_offset, ELF_BASE + main_offset, tape_addr, io_addr);
+
+    /* symbols, then the three string tables, then the section headers */
+    Elf64Symbol symbols[5];
+    memset(symbols, 0, sizeof(symbols));
+    symbols[1] = (Elf64Symbol){ 1, (STB_GLOBAL << 4) | STT_FUNC, 0, SEC_TEXT, ELF_BASE + stub_offset, stub->size };
+    symbols[2] = (Elf64Symbol){ 8, (STB_GLOBAL << 4) | STT_FUNC, 0, SEC_TEXT, ELF_BASE + main_offset, buf->text_size };
+    symbols[3] = (Elf64Symbol){ 16, (STB_GLOBAL << 4) | STT_OBJECT, 0, SEC_BSS, tape_addr, BF_TAPE_SIZE };
+    symbols[4] = (Elf64Symbol){ 24, (STB_GLOBAL << 4) | STT_OBJECT, 0, SEC_BSS, io_addr, sizeof(BFIO) };
+
+    size_t symtab_offset = align_up(load_end, 8);
+    size_t strtab_offset = symtab_offset + sizeof(symbols);
+    size_t shstrtab_offset = strtab_offset + sizeof(strtab);
+    size_t shdrs_offset = align_up(shstrtab_offset + sizeof(shstrtab), 8);
+
+    Elf64SectionHeader sections[SEC_COUNT];
+    memset(sections, 0, sizeof(sections));
+    sections[SEC_TEXT] = (Elf64SectionHeader){ 1, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, ELF_BASE + stub_offset,
+                                               stub_offset, rodata_offset - stub_offset, 0, 0, 16, 0 };
+    sections[SEC_RODATA] = (Elf64SectionHeader){ 7, SHT_PROGBITS, SHF_ALLOC, ELF_BASE + rodata_offset,
+                                                 rodata_offset, buf->size - buf->text_size, 0, 0, 1, 0 };
+    sections[SEC_BSS] = (Elf64SectionHeader){ 15, SHT_NOBITS, SHF_ALLOC | SHF_WRITE, bss_addr,
+                                              align_up(load_end, 8), bss_size, 0, 0, 16, 0 };
+    sections[SEC_SYMTAB] = (Elf64SectionHeader){ 20, SHT_SYMTAB, 0, 0, symtab_offset, sizeof(symbols),
+                                                 SEC_STRTAB, 1, 8, sizeof(Elf64Symbol) };
+    sections[SEC_STRTAB] = (Elf64SectionHeader){ 28, SHT_STRTAB, 0, 0, strtab_offset, sizeof(strtab), 0, 0, 1, 0 };
+    sections[SEC_SHSTRTAB] = (Elf64SectionHeader){ 36, SHT_STRTAB, 0, 0, shstrtab_offset, sizeof(shstrtab), 0, 0, 1, 0 };
+
+    Elf64ProgramHeader phdrs[3] = {
+        { PT_LOAD, PF_R | PF_X, 0, ELF_BASE, ELF_BASE, load_end, load_end, ELF_PAGE },
+        { PT_LOAD, PF_R | PF_W, 0, bss_addr, bss_addr, 0, bss_size, ELF_PAGE }, /* zero-filled tape */
+        { PT_GNU_STACK, PF_R | PF_W, 0, 0, 0, 0, 0, 16 }, /* non-executable stack */
+    };
+
+    Elf64Header header = {
+        .e_ident = { 0x7F, 'E', 'L', 'F', 2 /* 64-bit */, 1 /* little-endian */, 1 /* version */, 0 /* SysV ABI */ },
+        .e_type = ET_EXEC,
+        .e_machine = target == TARGET_X86_64_LINUX ? EM_X86_64 : EM_AARCH64,
+        .e_version = 1,
+        .e_entry = ELF_BASE + stub_offset,
+        .e_phoff = phdrs_offset,
+        .e_shoff = shdrs_offset,
+        .e_ehsize = sizeof(Elf64Header),
+        .e_phentsize = sizeof(Elf64ProgramHeader),
+        .e_phnum = phnum,
+        .e_shentsize = sizeof(Elf64SectionHeader),
+        .e_shnum = SEC_COUNT,
+        .e_shstrndx = SEC_SHSTRTAB,
+    };
+
+    /* assemble the whole file in memory; padding stays zero */
+    size_t file_size = shdrs_offset + sizeof(sections);
+    uint8_t* image = calloc(1, file_size);
+    if (!image)
+    {
+        fprintf(stderr, "Memory allocation error\n");
+        free_code_buffer(stub);
+        return -1;
+    }
+
+    memcpy(image, &header, sizeof(header));
+    memcpy(image + phdrs_offset, phdrs, sizeof(phdrs));
+    memcpy(image + stub_offset, stub->code, stub->size);
+    memcpy(image + main_offset, buf->code, buf->size);
+    memcpy(image + symtab_offset, symbols, sizeof(symbols));
+    memcpy(image + strtab_offset, strtab, sizeof(strtab));
+    memcpy(image + shstrtab_offset, shstrtab, sizeof(shstrtab));
+    memcpy(image + shdrs_offset, sections, sizeof(sections));
+    free_code_buffer(stub);
+
+    FILE* out = fopen(filename, "wb");
+    if (!out)
+    {
+        perror("Error opening output file");
+        free(image);
+        return -1;
+    }
+
+    size_t written = fwrite(image, 1, file_size, out);
+    free(image);
+    if (fclose(out) != 0 || written != file_size)
+    {
+        perror("Error writing output file");
+        return -1;
+    }
+
+    if (chmod(filename, 0755) != 0)
+    {
+        perror("Error making output executable");
+        return -1;
+    }
+    return 0;
+}
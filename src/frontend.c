@@ -5,6 +5,8 @@
 #include <string.h>
 #include "bfc.h"
 
+/* the original frontend, one whole-file pass per stage; only the benchmarks still use it, as the
+ * baseline for the streaming frontend further down */
 char* preproc(const char* src)
 {
     size_t len = strlen(src);
@@ -76,6 +78,26 @@ void free_tkarr(TokenArray* arr)
     free(arr);
 }
 
+/* double the bracket stack, copying it off the C stack the first time */
+static int grow_loop_stack(int** stack, size_t* capacity, int* inline_stack)
+{
+    size_t new_capacity = *capacity * 2;
+    int* grown = (*stack == inline_stack) ? malloc(new_capacity * sizeof(int))
+                                          : realloc(*stack, new_capacity * sizeof(int));
+    if (!grown)
+    {
+        perror("memory allocation error");
+        return -1;
+    }
+
+    if (*stack == inline_stack)
+        memcpy(grown, inline_stack, *capacity * sizeof(int));
+
+    *stack = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
 TokenArray* tokenize(const char* proc_src)
 {
     size_t code = strlen(proc_src);
@@ -87,9 +109,13 @@ TokenArray* tokenize(const char* proc_src)
         return NULL;
     }
 
+    /* bracket stack; starts out on the C stack and moves to the heap
+     * only for programs that nest deeper than that */
     int loopid = 0;
-    int loop_stack[256];
-    int loop_depth = 0;
+    int inline_stack[256];
+    int* loop_stack = inline_stack;
+    size_t loop_capacity = sizeof(inline_stack) / sizeof(inline_stack[0]);
+    size_t loop_depth = 0;
 
     for (size_t i = 0; i < code; ++i)
     {
@@ -122,9 +148,11 @@ TokenArray* tokenize(const char* proc_src)
                 break;
                 
             case '[':
-                if (loop_depth >= 256) 
+                if (loop_depth >= loop_capacity && 
+                    grow_loop_stack(&loop_stack, &loop_capacity, inline_stack) != 0) 
                 {
-                    fprintf(stderr, "Error: Too many nested loops\n");
+                    if (loop_stack != inline_stack)
+                        free(loop_stack);
                     free_tkarr(tokens);
                     return NULL;
                 }
@@ -139,6 +167,8 @@ TokenArray* tokenize(const char* proc_src)
                 if (loop_depth <= 0) 
                 {
                     fprintf(stderr, "Error: Unmatched closing bracket\n");
+                    if (loop_stack != inline_stack)
+                        free(loop_stack);
                     free_tkarr(tokens);
                     return NULL;
                 }
@@ -154,6 +184,9 @@ TokenArray* tokenize(const char* proc_src)
         }
     }
 
+    if (loop_stack != inline_stack)
+        free(loop_stack);
+
     if (loop_depth > 0) 
     {
         fprintf(stderr, "Error: Unmatched opening bracket(s)\n");
@@ -172,6 +205,16 @@ IRProgram* parse(TokenArray* tokens)
         fprintf(stderr, "Failed to create IR program\n");
         return NULL;
     }
+
+    /* at most one op per token; reserve once instead of growing along the way */
+    if (ir_reserve(program, tokens->count) != 0)
+    {
+        free_ir_program(program);
+        return NULL;
+    }
+
+    /* the loop tree is built as we go; the parent links double as the bracket stack */
+    int open_loop = -1;
     
     for (size_t i = 0; i < tokens->count; i++) 
     {
@@ -204,11 +247,17 @@ IRProgram* parse(TokenArray* tokens)
                 break;
                 
             case TOK_LOOP_START:
-                add_ir_op(program, IR_LOOP_START, 0, 0, token->loop_id);
+                if (ir_begin_loop(program, token->loop_id, open_loop, token->pos) != 0)
+                {
+                    free_ir_program(program);
+                    return NULL;
+                }
+                open_loop = token->loop_id;
                 break;
                 
             case TOK_LOOP_END:
-                add_ir_op(program, IR_LOOP_END, 0, 0, token->loop_id);
+                ir_end_loop(program, token->loop_id);
+                open_loop = program->loops[token->loop_id].parent;
                 break;
                 
             case TOK_EOF: /* end of file*/
@@ -217,4 +266,357 @@ IRProgram* parse(TokenArray* tokens)
     }
     
     return program;
-}
\ No newline at end of file
+}
+/* streaming frontend; reads the source in fixed-size chunks and emits IR directly,
+ * so the only full-size copy of the program that ever exists is the IR itself */
+#define STREAM_CHUNK_SIZE (64 * 1024)
+
+/* the lexer looks at the source 64 bytes at a time; a block gets a bitmask with one bit
+ * per byte that is a brainfuck command, so comment blocks are skipped with a single test
+ * and blocks that continue the current +-<> run are counted without touching each byte */
+#define LEX_BLOCK 64
+
+#if defined(__SSE2__) && defined(__GNUC__) && !defined(BFC_NO_SIMD)
+#include <immintrin.h>
+
+/* AVX2 versions are built whatever -march says and used when the CPU has AVX2; see stream_chunk */
+#define LEX_AVX2 __attribute__((target("avx2")))
+
+/* bytes equal to '+' ',' '-' '.' (0x2b..0x2e), '<' '>' (0x3c|2 == 0x3e) and '[' ']' */
+LEX_AVX2 static inline uint32_t lex_classify32(const char* p)
+{
+    __m256i b = _mm256_loadu_si256((const __m256i*)p);
+    __m256i arith = _mm256_cmpeq_epi8(_mm256_max_epu8(_mm256_sub_epi8(b, _mm256_set1_epi8(0x2b)),
+                                                      _mm256_set1_epi8(3)), _mm256_set1_epi8(3));
+    __m256i ptr = _mm256_cmpeq_epi8(_mm256_or_si256(b, _mm256_set1_epi8(2)), _mm256_set1_epi8(0x3e));
+    __m256i open = _mm256_cmpeq_epi8(b, _mm256_set1_epi8('['));
+    __m256i close = _mm256_cmpeq_epi8(b, _mm256_set1_epi8(']'));
+    __m256i any = _mm256_or_si256(_mm256_or_si256(arith, ptr), _mm256_or_si256(open, close));
+    return (uint32_t)_mm256_movemask_epi8(any);
+}
+
+LEX_AVX2 static inline uint64_t lex_classify_avx2(const char* p)
+{
+    return lex_classify32(p) | ((uint64_t)lex_classify32(p + 32) << 32);
+}
+
+LEX_AVX2 static inline uint64_t lex_match_avx2(const char* p, char c)
+{
+    __m256i v = _mm256_set1_epi8(c);
+    uint32_t lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), v));
+    uint32_t hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 32)), v));
+    return lo | ((uint64_t)hi << 32);
+}
+
+#endif
+
+#if defined(__SSE2__) && !defined(BFC_NO_SIMD)
+#include <emmintrin.h>
+
+/* bytes equal to '+' ',' '-' '.' (0x2b..0x2e), '<' '>' (0x3c|2 == 0x3e) and '[' ']' */
+static inline uint64_t lex_classify16(const char* p)
+{
+    __m128i b = _mm_loadu_si128((const __m128i*)p);
+    __m128i arith = _mm_cmpeq_epi8(_mm_max_epu8(_mm_sub_epi8(b, _mm_set1_epi8(0x2b)),
+                                                _mm_set1_epi8(3)), _mm_set1_epi8(3));
+    __m128i ptr = _mm_cmpeq_epi8(_mm_or_si128(b, _mm_set1_epi8(2)), _mm_set1_epi8(0x3e));
+    __m128i open = _mm_cmpeq_epi8(b, _mm_set1_epi8('['));
+    __m128i close = _mm_cmpeq_epi8(b, _mm_set1_epi8(']'));
+    __m128i any = _mm_or_si128(_mm_or_si128(arith, ptr), _mm_or_si128(open, close));
+    return (uint64_t)(uint16_t)_mm_movemask_epi8(any);
+}
+
+static inline uint64_t lex_classify(const char* p)
+{
+    return lex_classify16(p) | (lex_classify16(p + 16) << 16) |
+           (lex_classify16(p + 32) << 32) | (lex_classify16(p + 48) << 48);
+}
+
+static inline uint64_t lex_match16(const char* p, __m128i v)
+{
+    return (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), v));
+}
+
+static inline uint64_t lex_match(const char* p, char c)
+{
+    __m128i v = _mm_set1_epi8(c);
+    return lex_match16(p, v) | (lex_match16(p + 16, v) << 16) |
+           (lex_match16(p + 32, v) << 32) | (lex_match16(p + 48, v) << 48);
+}
+
+#elif defined(__ARM_NEON) && !defined(BFC_NO_SIMD)
+#include <arm_neon.h>
+
+/* NEON has no movemask; weight each byte lane with its bit and fold pairwise */
+static inline uint64_t lex_movemask(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d)
+{
+    const uint8x16_t bits = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t ab = vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits));
+    uint8x16_t cd = vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits));
+    uint8x16_t abcd = vpaddq_u8(ab, cd);
+    abcd = vpaddq_u8(abcd, abcd);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(abcd), 0);
+}
+
+/* bytes equal to '+' ',' '-' '.' (0x2b..0x2e), '<' '>' (0x3c|2 == 0x3e) and '[' ']' */
+static inline uint8x16_t lex_classify16(const char* p)
+{
+    uint8x16_t b = vld1q_u8((const uint8_t*)p);
+    uint8x16_t arith = vcltq_u8(vsubq_u8(b, vdupq_n_u8(0x2b)), vdupq_n_u8(4));
+    uint8x16_t ptr = vceqq_u8(vorrq_u8(b, vdupq_n_u8(2)), vdupq_n_u8(0x3e));
+    uint8x16_t open = vceqq_u8(b, vdupq_n_u8('['));
+    uint8x16_t close = vceqq_u8(b, vdupq_n_u8(']'));
+    return vorrq_u8(vorrq_u8(arith, ptr), vorrq_u8(open, close));
+}
+
+static inline uint64_t lex_classify(const char* p)
+{
+    return lex_movemask(lex_classify16(p), lex_classify16(p + 16),
+                        lex_classify16(p + 32), lex_classify16(p + 48));
+}
+
+static inline uint64_t lex_match(const char* p, char c)
+{
+    uint8x16_t v = vdupq_n_u8((uint8_t)c);
+    const uint8_t* u = (const uint8_t*)p;
+    return lex_movemask(vceqq_u8(vld1q_u8(u), v), vceqq_u8(vld1q_u8(u + 16), v),
+                        vceqq_u8(vld1q_u8(u + 32), v), vceqq_u8(vld1q_u8(u + 48), v));
+}
+
+#else /* scalar fallback */
+
+static inline uint64_t lex_classify(const char* p)
+{
+    uint64_t mask = 0;
+    for (int i = 0; i < LEX_BLOCK; i++)
+    {
+        char c = p[i];
+        if (c == '>' || c == '<' || c == '+' || c == '-' || 
+            c == '.' || c == ',' || c == '[' || c == ']') 
+        {
+            mask |= 1ull << i;
+        }
+    }
+    return mask;
+}
+
+static inline uint64_t lex_match(const char* p, char c)
+{
+    uint64_t mask = 0;
+    for (int i = 0; i < LEX_BLOCK; i++)
+        mask |= (uint64_t)(p[i] == c) << i;
+    return mask;
+}
+
+#endif
+
+typedef struct
+{
+    IRProgram* program;
+    IROptype run_type; /* op of the pending +-<> run; IR_NOP if none */
+    char run_char; /* source character of the pending run */
+    int run_length;
+    int open_loop; /* innermost unclosed loop; -1 at top level */
+    int next_loop_id;
+    size_t pos; /* position in the filtered program, same numbering as Token.pos */
+} StreamState;
+
+static void flush_run(StreamState* st)
+{
+    if (st->run_type != IR_NOP)
+        add_ir_op(st->program, st->run_type, st->run_length, 0, -1);
+
+    st->run_type = IR_NOP;
+    st->run_char = 0;
+    st->run_length = 0;
+}
+
+static void push_run(StreamState* st, IROptype type, char c)
+{
+    if (st->run_type != type)
+        flush_run(st);
+
+    st->run_type = type;
+    st->run_char = c;
+    st->run_length++;
+}
+
+/* feed one source byte; returns -1 on a bracket error */
+static int stream_byte(StreamState* st, char c)
+{
+    switch (c)
+    {
+        case '>': push_run(st, IR_PTR_ADD, c); break;
+        case '<': push_run(st, IR_PTR_SUB, c); break;
+        case '+': push_run(st, IR_VAL_ADD, c); break;
+        case '-': push_run(st, IR_VAL_SUB, c); break;
+
+        case '.':
+            flush_run(st);
+            add_ir_op(st->program, IR_OUTPUT, 0, 0, -1);
+            break;
+
+        case ',':
+            flush_run(st);
+            add_ir_op(st->program, IR_INPUT, 0, 0, -1);
+            break;
+
+        case '[':
+            flush_run(st);
+            if (ir_begin_loop(st->program, st->next_loop_id, st->open_loop, st->pos) != 0)
+                return -1;
+            st->open_loop = st->next_loop_id++;
+            break;
+
+        case ']':
+            if (st->open_loop < 0)
+            {
+                fprintf(stderr, "Error: Unmatched closing bracket\n");
+                return -1;
+            }
+
+            flush_run(st);
+            ir_end_loop(st->program, st->open_loop);
+            st->open_loop = st->program->loops[st->open_loop].parent;
+            break;
+
+        default: /* comment */
+            return 0;
+    }
+
+    st->pos++;
+    return 0;
+}
+
+/* the whole 64-byte blocks of a chunk, from *i on; inlined once per instruction set, so the
+ * classify and match helpers are inlined into each copy. Returns -1 on a bracket error */
+static inline __attribute__((always_inline)) int stream_blocks(StreamState* st, const char* chunk, size_t len,
+                                                               size_t* at, uint64_t (*classify)(const char*),
+                                                               uint64_t (*match)(const char*, char))
+{
+    size_t i = *at;
+    for (; i + LEX_BLOCK <= len; i += LEX_BLOCK)
+    {
+        uint64_t commands = classify(chunk + i);
+        if (commands == 0) /* nothing but comments */
+            continue;
+
+        /* a whole block that extends the pending run, e.g. a long +++... initializer */
+        if (commands == ~0ull && st->run_type != IR_NOP && 
+            match(chunk + i, st->run_char) == ~0ull)
+        {
+            st->run_length += LEX_BLOCK;
+            st->pos += LEX_BLOCK;
+            continue;
+        }
+
+        while (commands)
+        {
+            if (stream_byte(st, chunk[i + __builtin_ctzll(commands)]) != 0)
+                return -1;
+            commands &= commands - 1;
+        }
+    }
+
+    *at = i;
+    return 0;
+}
+
+#ifdef LEX_AVX2
+LEX_AVX2 static int stream_blocks_avx2(StreamState* st, const char* chunk, size_t len, size_t* at)
+{
+    return stream_blocks(st, chunk, len, at, lex_classify_avx2, lex_match_avx2);
+}
+#endif
+
+/* feed one chunk of raw source; returns -1 on a bracket error */
+static int stream_chunk(StreamState* st, const char* chunk, size_t len)
+{
+    size_t i = 0;
+    int result;
+#ifdef LEX_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        result = stream_blocks_avx2(st, chunk, len, &i);
+    else
+#endif
+        result = stream_blocks(st, chunk, len, &i, lex_classify, lex_match);
+    if (result != 0)
+        return -1;
+
+    for (; i < len; i++) /* tail shorter than a block */
+    {
+        if (stream_byte(st, chunk[i]) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static IRProgram* stream_finish(StreamState* st, int failed)
+{
+    flush_run(st);
+    if (!failed && st->open_loop >= 0)
+    {
+        fprintf(stderr, "Error: Unmatched opening bracket(s)\n");
+        failed = 1;
+    }
+
+    if (failed)
+    {
+        free_ir_program(st->program);
+        return NULL;
+    }
+
+    return st->program;
+}
+
+IRProgram* parse_source(const char* src, size_t len)
+{
+    IRProgram* program = create_ir_program();
+    if (!program)
+    {
+        fprintf(stderr, "Failed to create IR program\n");
+        return NULL;
+    }
+
+    StreamState st = { program, IR_NOP, 0, 0, -1, 0, 0 };
+    int failed = stream_chunk(&st, src, len) != 0;
+    return stream_finish(&st, failed);
+}
+
+IRProgram* parse_file(const char* filename)
+{
+    FILE* input = fopen(filename, "rb");
+    if (!input)
+    {
+        perror("Error opening input file");
+        return NULL;
+    }
+
+    char* chunk = malloc(STREAM_CHUNK_SIZE);
+    IRProgram* program = create_ir_program();
+    if (!chunk || !program)
+    {
+        fprintf(stderr, "Failed to create IR program\n");
+        free(chunk);
+        free_ir_program(program);
+        fclose(input);
+        return NULL;
+    }
+
+    StreamState st = { program, IR_NOP, 0, 0, -1, 0, 0 };
+    size_t n;
+    int failed = 0;
+    while (!failed && (n = fread(chunk, 1, STREAM_CHUNK_SIZE, input)) > 0)
+        failed = stream_chunk(&st, chunk, n) != 0;
+
+    if (ferror(input))
+    {
+        perror("Error reading input file");
+        failed = 1;
+    }
+
+    free(chunk);
+    fclose(input);
+    return stream_finish(&st, failed);
+}
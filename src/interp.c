@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bfc.h"
+#include "tier.h"
+
+/* the interpreter runs the optimized IR without a backend: the IR is translated into a flat
+ * bytecode, one instruction per live op with loops turned into jumps, and dispatched through
+ * computed goto (direct threading) where the compiler has it, or a switch everywhere else */
+#if defined(__GNUC__)
+#define INTERP_THREADED 1
+#else
+#define INTERP_THREADED 0
+#endif
+
+typedef enum
+{
+    OP_ADD,          /* cell[a] += b */
+    OP_SET,          /* cell[a] = b */
+    OP_PTR,          /* ptr += a */
+    OP_OUTPUT,       /* write cell[a] */
+    OP_INPUT,        /* read into cell[a] */
+    OP_JZ,           /* if cell[0] == 0, go to instruction b; c is the loop_id */
+    OP_JNZ,          /* if cell[0] != 0, go to instruction b; c is the loop_id */
+    OP_JZ_COUNTED,   /* OP_JZ that counts toward tiering, or runs the loop natively once it can */
+    OP_JNZ_COUNTED,  /* OP_JNZ, likewise */
+    OP_ADD_MUL,      /* cell[a] += cell[c] * b */
+    OP_MOVE_VAL,     /* the same, then cell[c] = 0 */
+    OP_SCAN_ZERO,    /* while (cell[0]) ptr += a */
+    OP_SCAN_NONZERO, /* while (!cell[0]) ptr += a */
+    OP_OUTPUT_STR,   /* write c bytes of the string pool, from b */
+    OP_UPDATE_VEC,   /* cell[a + k] = (cell[a + k] & keep[k]) + add[k] for k < c; add, then keep, at b */
+    OP_HALT,
+    OP_COUNT
+} InterpOp;
+
+typedef struct
+{
+    const void* handler; /* address of the op's code once threaded */
+    int32_t a;
+    int32_t b;
+    int32_t c;
+    uint8_t op; /* InterpOp */
+} InterpInstr;
+
+struct InterpCode
+{
+    InterpInstr* instrs;
+    size_t count;
+    uint8_t* strings; /* a copy of the string pool, so the code outlives the IR */
+    bool threaded;    /* handlers are filled in; done on the first run */
+};
+
+/* the runtime side: the same buffering as the generated code, in plain C */
+typedef struct
+{
+    uint8_t out[BF_OUT_BUFFER];
+    size_t out_len;
+    uint8_t in[BF_IN_BUFFER];
+    size_t in_pos;
+    size_t in_len;
+    EofMode eof_mode;
+} InterpIO;
+
+static InterpInstr* emit_instr_op(InterpCode* code, InterpOp op, int32_t a, int32_t b, int32_t c)
+{
+    InterpInstr* instr = &code->instrs[code->count++];
+    instr->handler = NULL;
+    instr->op = (uint8_t)op;
+    instr->a = a;
+    instr->b = b;
+    instr->c = c;
+    return instr;
+}
+
+/* `counted` makes loop heads and back-edges count toward tiering; see tier.h */
+static InterpCode* compile_code(const IRProgram* program, bool counted)
+{
+    if (!program)
+    {
+        fprintf(stderr, "Invalid program to interpret\n");
+        return NULL;
+    }
+
+    InterpCode* code = calloc(1, sizeof(InterpCode));
+    size_t* loop_starts = malloc((program->loop_count + 1) * sizeof(size_t)); /* OP_JZ of each open loop */
+    if (code)
+    {
+        code->instrs = malloc((program->size + 1) * sizeof(InterpInstr));
+        code->strings = malloc(program->string_size + 1);
+    }
+    if (!code || !loop_starts || !code->instrs || !code->strings)
+    {
+        perror("Memory allocation error");
+        free(loop_starts);
+        free_interp(code);
+        return NULL;
+    }
+    memcpy(code->strings, program->strings, program->string_size);
+
+    for (size_t i = 0; i < program->size; i++)
+    {
+        const IROperation* op = &program->ops[i];
+        switch (op->type)
+        {
+            case IR_PTR_ADD:
+            case IR_PTR_SUB:
+            {
+                int32_t delta = op->type == IR_PTR_ADD ? op->value : -op->value;
+                if (code->count > 0 && code->instrs[code->count - 1].op == OP_PTR) /* merge runs */
+                    code->instrs[code->count - 1].a += delta;
+                else
+                    emit_instr_op(code, OP_PTR, delta, 0, 0);
+                break;
+            }
+
+            case IR_VAL_ADD:
+                emit_instr_op(code, OP_ADD, op->offset, op->value & 0xFF, 0);
+                break;
+
+            case IR_VAL_SUB:
+                emit_instr_op(code, OP_ADD, op->offset, -op->value & 0xFF, 0);
+                break;
+
+            case IR_SET_ZERO:
+                emit_instr_op(code, OP_SET, op->offset, 0, 0);
+                break;
+
+            case IR_SET_VAL:
+                emit_instr_op(code, OP_SET, op->offset, op->value & 0xFF, 0);
+                break;
+
+            case IR_OUTPUT:
+                emit_instr_op(code, OP_OUTPUT, op->offset, 0, 0);
+                break;
+
+            case IR_INPUT:
+                emit_instr_op(code, OP_INPUT, op->offset, 0, 0);
+                break;
+
+            case IR_LOOP_START:
+                loop_starts[op->loop_id] = code->count;
+                emit_instr_op(code, counted ? OP_JZ_COUNTED : OP_JZ, 0, 0, op->loop_id); /* the exit is patched at the loop end */
+                break;
+
+            case IR_LOOP_END:
+            {
+                size_t start = loop_starts[op->loop_id];
+                emit_instr_op(code, counted ? OP_JNZ_COUNTED : OP_JNZ, 0, (int32_t)(start + 1), op->loop_id);
+                code->instrs[start].b = (int32_t)code->count;
+                break;
+            }
+
+            case IR_ADD_MUL:
+                emit_instr_op(code, OP_ADD_MUL, op->offset, op->value & 0xFF, op->src);
+                break;
+
+            case IR_MOVE_VAL:
+                emit_instr_op(code, OP_MOVE_VAL, op->offset, op->value & 0xFF, op->src);
+                break;
+
+            case IR_SCAN_ZERO:
+                emit_instr_op(code, OP_SCAN_ZERO, op->value, 0, 0);
+                break;
+
+            case IR_SCAN_NONZERO:
+                emit_instr_op(code, OP_SCAN_NONZERO, op->value, 0, 0);
+                break;
+
+            case IR_OUTPUT_STR:
+                emit_instr_op(code, OP_OUTPUT_STR, 0, op->src, op->value);
+                break;
+
+            case IR_UPDATE_VEC:
+                emit_instr_op(code, OP_UPDATE_VEC, op->offset, op->src, op->value);
+                break;
+
+            case IR_CONDITIONAL:
+                fprintf(stderr, "Warning: IR_CONDITIONAL is yet to be implemented\n");
+                break;
+
+            case IR_NOP:
+                break;
+        }
+    }
+    emit_instr_op(code, OP_HALT, 0, 0, 0);
+
+    free(loop_starts);
+    return code;
+}
+
+InterpCode* interp_compile(const IRProgram* program)
+{
+    return compile_code(program, false);
+}
+
+InterpCode* interp_compile_counted(const IRProgram* program)
+{
+    return compile_code(program, true);
+}
+
+void free_interp(InterpCode* code)
+{
+    if (!code)
+        return;
+
+    free(code->instrs);
+    free(code->strings);
+    free(code);
+}
+
+/* write out BFIO-style buffered output; like the flush helper, a failed write drops the rest */
+static void interp_flush(InterpIO* io)
+{
+    size_t done = 0;
+    while (done < io->out_len)
+    {
+        ssize_t n = write(STDOUT_FILENO, io->out + done, io->out_len - done);
+        if (n <= 0)
+            break;
+        done += (size_t)n;
+    }
+    io->out_len = 0;
+}
+
+static void interp_write(InterpIO* io, const uint8_t* bytes, size_t length)
+{
+    while (length > 0)
+    {
+        if (io->out_len == BF_OUT_BUFFER)
+            interp_flush(io);
+
+        size_t n = BF_OUT_BUFFER - io->out_len;
+        if (n > length)
+            n = length;
+        memcpy(io->out + io->out_len, bytes, n);
+        io->out_len += n;
+        bytes += n;
+        length -= n;
+    }
+}
+
+/* ',': the next byte of stdin, refilling the buffer when it runs dry. Pending output goes out
+ * before we block, so prompts show up */
+static void interp_read(InterpIO* io, uint8_t* cell)
+{
+    if (io->in_pos == io->in_len)
+    {
+        interp_flush(io);
+        ssize_t n = read(STDIN_FILENO, io->in, BF_IN_BUFFER);
+        if (n <= 0)
+        {
+            if (io->eof_mode == BF_EOF_ZERO)
+                *cell = 0;
+            else if (io->eof_mode == BF_EOF_MINUS_ONE)
+                *cell = 255;
+            return;
+        }
+        io->in_pos = 0;
+        io->in_len = (size_t)n;
+    }
+    *cell = io->in[io->in_pos++];
+}
+
+/* `tier` is NULL unless the code was made by interp_compile_counted */
+static int run_code(InterpCode* code, EofMode eof_mode, Tier* tier)
+{
+    if (!code)
+    {
+        fprintf(stderr, "No interpreter code to execute\n");
+        return -1;
+    }
+
+    size_t tape_size = BF_TAPE_SIZE + 2 * BF_TAPE_PAD;
+    uint8_t* tape = calloc(tape_size, 1);
+    InterpIO* io = malloc(sizeof(InterpIO));
+    if (!tape || !io)
+    {
+        perror("Interpreter memory allocation failed");
+        free(tape);
+        free(io);
+        return -1;
+    }
+    io->out_len = 0;
+    io->in_pos = io->in_len = 0;
+    io->eof_mode = eof_mode;
+
+    uint8_t* ptr = tape + BF_TAPE_PAD;
+    uint8_t* tape_end = tape + tape_size; /* bound for memchr; scans never stop past the padding */
+    TierLoop* loops = tier ? tier_loops(tier) : NULL;
+    BFIO* native_io = tier ? tier_io(tier) : NULL;
+    const InterpInstr* base = code->instrs;
+    const InterpInstr* pc = base;
+
+#if INTERP_THREADED
+    static const void* const handlers[OP_COUNT] = {
+        [OP_ADD] = &&do_OP_ADD,
+        [OP_SET] = &&do_OP_SET,
+        [OP_PTR] = &&do_OP_PTR,
+        [OP_OUTPUT] = &&do_OP_OUTPUT,
+        [OP_INPUT] = &&do_OP_INPUT,
+        [OP_JZ] = &&do_OP_JZ,
+        [OP_JNZ] = &&do_OP_JNZ,
+        [OP_JZ_COUNTED] = &&do_OP_JZ_COUNTED,
+        [OP_JNZ_COUNTED] = &&do_OP_JNZ_COUNTED,
+        [OP_ADD_MUL] = &&do_OP_ADD_MUL,
+        [OP_MOVE_VAL] = &&do_OP_MOVE_VAL,
+        [OP_SCAN_ZERO] = &&do_OP_SCAN_ZERO,
+        [OP_SCAN_NONZERO] = &&do_OP_SCAN_NONZERO,
+        [OP_OUTPUT_STR] = &&do_OP_OUTPUT_STR,
+        [OP_UPDATE_VEC] = &&do_OP_UPDATE_VEC,
+        [OP_HALT] = &&do_OP_HALT,
+    };
+    if (!code->threaded)
+    {
+        for (size_t i = 0; i < code->count; i++)
+            code->instrs[i].handler = handlers[code->instrs[i].op];
+        code->threaded = true;
+    }
+
+#define CASE(op) do_##op:
+#define NEXT() goto *(++pc)->handler
+#define JUMP(target) do { pc = base + (target); goto *pc->handler; } while (0)
+    goto *pc->handler;
+#else
+#define CASE(op) case op:
+#define NEXT() { pc++; continue; } /* no do-while here; the continue is for the dispatch loop */
+#define JUMP(target) { pc = base + (target); continue; }
+    for (;;)
+    switch ((InterpOp)pc->op)
+#endif
+    {
+        CASE(OP_ADD)
+            ptr[pc->a] += (uint8_t)pc->b;
+            NEXT();
+
+        CASE(OP_SET)
+            ptr[pc->a] = (uint8_t)pc->b;
+            NEXT();
+
+        CASE(OP_PTR)
+            ptr += pc->a;
+            NEXT();
+
+        CASE(OP_OUTPUT)
+            if (io->out_len == BF_OUT_BUFFER)
+                interp_flush(io);
+            io->out[io->out_len++] = ptr[pc->a];
+            NEXT();
+
+        CASE(OP_INPUT)
+            interp_read(io, &ptr[pc->a]);
+            NEXT();
+
+        CASE(OP_JZ)
+            if (!*ptr)
+                JUMP(pc->b);
+            NEXT();
+
+        CASE(OP_JNZ)
+            if (*ptr)
+                JUMP(pc->b);
+            NEXT();
+
+        CASE(OP_JZ_COUNTED)
+        {
+            TierLoop* loop = &loops[pc->c];
+            TierEntry entry = atomic_load_explicit(&loop->entry, memory_order_acquire);
+            if (entry) /* the whole loop, natively; our output has to go out first */
+            {
+                interp_flush(io);
+                ptr = entry(ptr, native_io);
+                JUMP(pc->b);
+            }
+            if (!*ptr)
+                JUMP(pc->b);
+            if (++loop->count == TIER_THRESHOLD)
+                tier_request(tier, pc->c);
+            NEXT();
+        }
+
+        CASE(OP_JNZ_COUNTED)
+        {
+            if (!*ptr)
+                NEXT();
+            TierLoop* loop = &loops[pc->c];
+            TierEntry entry = atomic_load_explicit(&loop->entry, memory_order_acquire);
+            if (entry) /* the cell is non-zero, so this is as good as the loop head */
+            {
+                interp_flush(io);
+                ptr = entry(ptr, native_io);
+                NEXT();
+            }
+            if (++loop->count == TIER_THRESHOLD)
+                tier_request(tier, pc->c);
+            JUMP(pc->b);
+        }
+
+        CASE(OP_ADD_MUL)
+            ptr[pc->a] += (uint8_t)(ptr[pc->c] * pc->b);
+            NEXT();
+
+        CASE(OP_MOVE_VAL)
+            ptr[pc->a] += (uint8_t)(ptr[pc->c] * pc->b);
+            ptr[pc->c] = 0;
+            NEXT();
+
+        CASE(OP_SCAN_ZERO)
+            if (pc->a == 1 && ptr < tape_end) /* the common [>] */
+            {
+                uint8_t* zero = memchr(ptr, 0, (size_t)(tape_end - ptr));
+                ptr = zero ? zero : tape_end;
+            }
+            else
+            {
+                while (*ptr)
+                    ptr += pc->a;
+            }
+            NEXT();
+
+        CASE(OP_SCAN_NONZERO)
+            while (!*ptr)
+                ptr += pc->a;
+            NEXT();
+
+        CASE(OP_OUTPUT_STR)
+            interp_write(io, code->strings + pc->b, (size_t)pc->c);
+            NEXT();
+
+        CASE(OP_UPDATE_VEC)
+        {
+            const uint8_t* add = code->strings + pc->b;
+            const uint8_t* keep = add + pc->c;
+            for (int32_t k = 0; k < pc->c; k++)
+                ptr[pc->a + k] = (uint8_t)((ptr[pc->a + k] & keep[k]) + add[k]);
+            NEXT();
+        }
+
+        CASE(OP_HALT)
+            goto halt;
+
+#if !INTERP_THREADED
+        default: /* OP_COUNT; never emitted */
+            goto halt;
+#endif
+    }
+#undef CASE
+#undef NEXT
+#undef JUMP
+
+halt:
+    interp_flush(io);
+    free(tape);
+    free(io);
+    return 0;
+}
+
+int interp_exec(InterpCode* code, EofMode eof_mode)
+{
+    return run_code(code, eof_mode, NULL);
+}
+
+int interp_exec_tiered(InterpCode* code, EofMode eof_mode, Tier* tier)
+{
+    return run_code(code, eof_mode, tier);
+}
+
+int interp_run(const IRProgram* program, EofMode eof_mode)
+{
+    InterpCode* code = interp_compile(program);
+    if (!code)
+        return -1;
+
+    int result = interp_exec(code, eof_mode);
+    free_interp(code);
+    return result;
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "bfc.h"
 
 IRProgram* create_ir_program() 
@@ -11,9 +12,16 @@ IRProgram* create_ir_program()
         return NULL;
     }
     
-    program->first = NULL;
-    program->last = NULL;
+    program->ops = NULL;
+    program->size = 0;
+    program->capacity = 0;
     program->count = 0;
+    program->loops = NULL;
+    program->loop_count = 0;
+    program->loop_capacity = 0;
+    program->max_depth = 0;
+    program->strings = NULL;
+    program->string_size = 0;
     return program;
 }
 
@@ -22,61 +30,200 @@ void free_ir_program(IRProgram* program)
     if (!program) 
         return;
     
-    IROperation* op = program->first;
-    while (op) /* traverse the list */
-    {
-        IROperation* next = op->next;
-        free(op);
-        op = next;
-    }
-    
+    free(program->ops); /* every op lives in the one array */
+    free(program->loops);
+    free(program->strings);
     free(program);
 }
 
-IROperation* create_ir_op(IROptype type, int value, int offset, int loop_id) 
+IRProgram* copy_ir_program(const IRProgram* program)
 {
-    IROperation* op = malloc(sizeof(IROperation));
-    if (!op) 
+    IRProgram* copy = create_ir_program();
+    if (!copy)
+        return NULL;
+
+    copy->ops = malloc((program->size ? program->size : 1) * sizeof(IROperation));
+    copy->loops = malloc((program->loop_count ? program->loop_count : 1) * sizeof(IRLoop));
+    copy->strings = program->string_size ? malloc(program->string_size) : NULL;
+    if (!copy->ops || !copy->loops || (program->string_size && !copy->strings))
     {
         perror("Memory allocation error");
+        free_ir_program(copy);
         return NULL;
     }
-    
+
+    memcpy(copy->ops, program->ops, program->size * sizeof(IROperation));
+    memcpy(copy->loops, program->loops, program->loop_count * sizeof(IRLoop));
+    if (program->string_size)
+        memcpy(copy->strings, program->strings, program->string_size);
+    copy->size = program->size;
+    copy->capacity = program->size ? program->size : 1;
+    copy->count = program->count;
+    copy->loop_count = program->loop_count;
+    copy->loop_capacity = program->loop_count ? program->loop_count : 1;
+    copy->max_depth = program->max_depth;
+    copy->string_size = program->string_size;
+    return copy;
+}
+
+int ir_reserve(IRProgram* program, size_t capacity)
+{
+    if (capacity <= program->capacity)
+        return 0;
+
+    IROperation* ops = realloc(program->ops, capacity * sizeof(IROperation));
+    if (!ops) 
+    {
+        perror("Memory allocation error");
+        return -1;
+    }
+
+    program->ops = ops;
+    program->capacity = capacity;
+    return 0;
+}
+
+void ir_set_op(IROperation* op, IROptype type, int value, int offset, int loop_id)
+{
     op->type = type;
     op->value = value;
     op->offset = offset;
+    op->src = 0;
     op->loop_id = loop_id;
-    op->next = NULL;
-    
-    return op;
 }
 
 void add_ir_op(IRProgram* program, IROptype type, int value, int offset, int loop_id) 
 {
-    IROperation* op = create_ir_op(type, value, offset, loop_id);
-    if (!op) 
+    if (program->size >= program->capacity) /* grow geometrically so appends stay amortized O(1) */
     {
-        fprintf(stderr, "Failed to create IR operation\n");
-        return;
+        size_t new_capacity = program->capacity ? program->capacity * 2 : 1024;
+        if (ir_reserve(program, new_capacity) != 0) 
+        {
+            fprintf(stderr, "Failed to create IR operation\n");
+            return;
+        }
     }
     
-    if (program->last) 
+    ir_set_op(&program->ops[program->size++], type, value, offset, loop_id);
+    program->count++;
+}
+
+void ir_remove(IRProgram* program, size_t index)
+{
+    if (program->ops[index].type == IR_NOP)
+        return;
+
+    program->ops[index].type = IR_NOP;
+    program->count--;
+}
+
+void ir_move_op(IRProgram* program, size_t from, size_t to)
+{
+    IROperation* op = &program->ops[to];
+    *op = program->ops[from];
+
+    if (op->type == IR_LOOP_START)
+        program->loops[op->loop_id].start = to;
+    else if (op->type == IR_LOOP_END)
+        program->loops[op->loop_id].end = to;
+}
+
+void ir_compact(IRProgram* program)
+{
+    size_t w = 0;
+    for (size_t r = 0; r < program->size; r++) 
     {
-        program->last->next = op;
-        program->last = op;
-    } 
-    else
+        if (program->ops[r].type == IR_NOP)
+            continue;
+
+        if (w != r)
+            ir_move_op(program, r, w);
+        w++;
+    }
+
+    program->size = w;
+    program->count = w;
+}
+
+int ir_begin_loop(IRProgram* program, int loop_id, int parent, size_t pos)
+{
+    if ((size_t)loop_id >= program->loop_capacity) 
     {
-        program->first = op;
-        program->last = op;
+        size_t new_capacity = program->loop_capacity ? program->loop_capacity * 2 : 256;
+        while (new_capacity <= (size_t)loop_id)
+            new_capacity *= 2;
+
+        IRLoop* loops = realloc(program->loops, new_capacity * sizeof(IRLoop));
+        if (!loops) 
+        {
+            perror("Memory allocation error");
+            return -1;
+        }
+
+        program->loops = loops;
+        program->loop_capacity = new_capacity;
     }
-    
-    program->count++;
+
+    IRLoop* loop = &program->loops[loop_id];
+    loop->start = program->size;
+    loop->end = program->size; /* patched by ir_end_loop */
+    loop->parent = parent;
+    loop->depth = parent < 0 ? 0 : program->loops[parent].depth + 1;
+    loop->children = 0;
+    loop->pos = pos;
+    loop->live = true;
+    loop->heat = LOOP_UNPROFILED;
+
+    if (parent >= 0)
+        program->loops[parent].children++;
+    if (loop->depth > program->max_depth)
+        program->max_depth = loop->depth;
+    if ((size_t)loop_id >= program->loop_count)
+        program->loop_count = loop_id + 1;
+
+    add_ir_op(program, IR_LOOP_START, 0, 0, loop_id);
+    return 0;
+}
+
+void ir_end_loop(IRProgram* program, int loop_id)
+{
+    program->loops[loop_id].end = program->size;
+    add_ir_op(program, IR_LOOP_END, 0, 0, loop_id);
+}
+
+void ir_remove_loop(IRProgram* program, int loop_id)
+{
+    IRLoop* loop = &program->loops[loop_id];
+    if (!loop->live)
+        return;
+
+    loop->live = false;
+    if (loop->parent >= 0)
+        program->loops[loop->parent].children--;
+}
+
+int ir_add_string(IRProgram* program, const uint8_t* bytes, size_t length)
+{
+    if (program->string_size + length > INT32_MAX) /* offsets and lengths live in int fields */
+        return -1;
+
+    uint8_t* strings = realloc(program->strings, program->string_size + length + 1);
+    if (!strings)
+    {
+        perror("Memory allocation error");
+        return -1;
+    }
+
+    memcpy(strings + program->string_size, bytes, length);
+    program->strings = strings;
+    int offset = (int)program->string_size;
+    program->string_size += length;
+    return offset;
 }
 
 void ir_dump(IRProgram* program)
 {
-    if (!program || !program->first)
+    if (!program || program->count == 0)
     {
         printf("Empty program\n");
         return;
@@ -85,11 +232,13 @@ void ir_dump(IRProgram* program)
     printf("IR Program (%zu operations):\n", program->count);
     printf("---------------------------------------\n");
     
-    IROperation* op = program->first;
     int index = 0;
-    
-    while (op)
+    for (size_t i = 0; i < program->size; i++)
     {
+        IROperation* op = &program->ops[i];
+        if (op->type == IR_NOP)
+            continue;
+
         printf("[%d] ", index++);
         
         switch (op->type)
@@ -101,34 +250,34 @@ void ir_dump(IRProgram* program)
                 printf("PTR_SUB     value=%d\n", op->value);
                 break;
             case IR_VAL_ADD:
-                printf("VAL_ADD     value=%d\n", op->value);
+                printf("VAL_ADD     value=%d  offset=%d\n", op->value, op->offset);
                 break;
             case IR_VAL_SUB:
-                printf("VAL_SUB     value=%d\n", op->value);
+                printf("VAL_SUB     value=%d  offset=%d\n", op->value, op->offset);
                 break;
             case IR_OUTPUT:
-                printf("OUTPUT\n");
+                printf("OUTPUT      offset=%d\n", op->offset);
                 break;
             case IR_INPUT:
-                printf("INPUT\n");
+                printf("INPUT       offset=%d\n", op->offset);
                 break;
             case IR_LOOP_START:
-                printf("LOOP_START  id=%d\n", op->loop_id);
+                printf("LOOP_START  id=%d  depth=%d\n", op->loop_id, program->loops[op->loop_id].depth);
                 break;
             case IR_LOOP_END:
                 printf("LOOP_END    id=%d\n", op->loop_id);
                 break;
             case IR_SET_ZERO:
-                printf("SET_ZERO\n");
+                printf("SET_ZERO    offset=%d\n", op->offset);
                 break;
             case IR_SET_VAL:
-                printf("SET_VAL     value=%d\n", op->value);
+                printf("SET_VAL     value=%d  offset=%d\n", op->value, op->offset);
                 break;
             case IR_ADD_MUL:
-                printf("ADD_MUL     value=%d  offset=%d\n", op->value, op->offset);
+                printf("ADD_MUL     value=%d  offset=%d  src=%d\n", op->value, op->offset, op->src);
                 break;
             case IR_MOVE_VAL:
-                printf("MOVE_VAL    value=%d  offset=%d\n", op->value, op->offset);
+                printf("MOVE_VAL    value=%d  offset=%d  src=%d\n", op->value, op->offset, op->src);
                 break;
             case IR_SCAN_ZERO:
                 printf("SCAN_ZERO   step=%d\n", op->value);
@@ -139,12 +288,25 @@ void ir_dump(IRProgram* program)
             case IR_CONDITIONAL:
                 printf("CONDITIONAL value=%d  offset=%d\n", op->value, op->offset);
                 break;
+            case IR_OUTPUT_STR:
+                printf("OUTPUT_STR  length=%d  \"", op->value);
+                for (int k = 0; k < op->value && k < 32; k++)
+                {
+                    uint8_t c = program->strings[op->src + k];
+                    if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\')
+                        putchar(c);
+                    else
+                        printf("\\x%02x", c);
+                }
+                printf(op->value > 32 ? "\"...\n" : "\"\n");
+                break;
+            case IR_UPDATE_VEC:
+                printf("UPDATE_VEC  width=%d  offset=%d\n", op->value, op->offset);
+                break;
             default:
                 printf("UNKNOWN     type=%d\n", op->type);
                 break;
         }
-        
-        op = op->next;
     }
     
     printf("---------------------------------------\n");
@@ -0,0 +1,307 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "bfrt.h"
+
+/* one file per program, named after its key: the code exactly as codegen left it, then a
+ * trailer. The code only reaches the tape and BFIO through its arguments and its read-only data
+ * through PC-relative addresses, so there is nothing to relocate; the file's first pages are
+ * mapped executable as they are. Files are written to a temporary name and renamed into place, so
+ * concurrent runs only ever see whole entries. Every hit touches the file's mtime, and a store
+ * that takes the directory over its limit removes the least recently used entries. A run that
+ * dies between the two leaves its temporary behind, which the next store removes once it is old */
+#define CACHE_MAGIC "bfccache"
+#define CACHE_FORMAT 1
+#define CACHE_SUFFIX ".bfcc"
+#define CACHE_TEMP "tmp." /* then mkstemp's XXXXXX */
+#define CACHE_TEMP_GRACE 60 /* seconds; far longer than a store takes to write and rename */
+#define CACHE_DEFAULT_LIMIT (64u << 20) /* bytes; BFC_CACHE_SIZE overrides, in MB */
+
+#ifndef BFC_BUILD_ID /* the Makefile passes a hash of the sources */
+#define BFC_BUILD_ID __DATE__ " " __TIME__ /* built some other way; at least every build is a new key */
+#endif
+
+typedef struct
+{
+    char magic[8];
+    uint32_t format;
+    uint32_t target;
+    uint64_t key[2];
+    uint64_t size;      /* bytes of code and read-only data before the trailer */
+    uint64_t text_size;
+} CacheTrailer;
+
+typedef struct
+{
+    char name[64];
+    off_t size;
+    time_t used;
+} CacheEntry;
+
+/* two 64-bit lanes over everything that decides the code, eight bytes per step; the key is looked
+ * up on every run, so this is most of what a warm start costs */
+static void hash_word(JitCacheKey* key, uint64_t word)
+{
+    key->hash[0] = (key->hash[0] ^ word) * 0x100000001b3ull;
+    key->hash[0] ^= key->hash[0] >> 32;
+    key->hash[1] = (key->hash[1] ^ word) * 0xff51afd7ed558ccdull;
+    key->hash[1] ^= key->hash[1] >> 29;
+}
+
+static void hash_bytes(JitCacheKey* key, const void* data, size_t length)
+{
+    const uint8_t* bytes = data;
+    uint64_t word;
+    for (; length >= sizeof(word); bytes += sizeof(word), length -= sizeof(word))
+    {
+        memcpy(&word, bytes, sizeof(word));
+        hash_word(key, word);
+    }
+
+    word = 0;
+    memcpy(&word, bytes, length);
+    hash_word(key, word ^ ((uint64_t)length << 56)); /* the tail, and how long it was */
+}
+
+static void hash_u64(JitCacheKey* key, uint64_t value)
+{
+    hash_word(key, value);
+}
+
+void jit_cache_key(JitCacheKey* key, const char* source, size_t length, int opt_level,
+                   const CodegenOptions* options, const void* profile, size_t profile_length)
+{
+    key->hash[0] = 0xcbf29ce484222325ull;
+    key->hash[1] = 0x9e3779b97f4a7c15ull;
+    hash_bytes(key, BFC_VERSION, sizeof(BFC_VERSION));
+    hash_bytes(key, BFC_BUILD_ID, sizeof(BFC_BUILD_ID));
+
+    /* field by field, so padding never leaks in */
+    hash_u64(key, (uint64_t)opt_level);
+    hash_u64(key, options->target);
+    hash_u64(key, options->rotate_loops);
+    hash_u64(key, (uint64_t)options->loop_align);
+    hash_u64(key, options->buffered_output);
+    hash_u64(key, options->buffered_input);
+    hash_u64(key, options->eof_mode);
+    hash_u64(key, options->vector_scans);
+    hash_u64(key, options->vector_updates);
+    hash_u64(key, options->return_ptr);
+    hash_u64(key, options->profile);
+    hash_u64(key, options->hosted_io);
+
+    hash_u64(key, length);
+    hash_bytes(key, source, length);
+    hash_u64(key, profile_length);
+    if (profile_length > 0)
+        hash_bytes(key, profile, profile_length);
+}
+
+/* the code in an entry is run as it is, so entries and the directory holding them must be ours
+ * and writable by nobody else; otherwise anyone who can compute a key could plant code under it */
+static bool private_to_us(const struct stat* st)
+{
+    return st->st_uid == geteuid() && (st->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/* $BFC_CACHE_DIR, else $XDG_CACHE_HOME/bfc, else ~/.cache/bfc; created on demand, and only used
+ * when it is private to us */
+static int cache_dir(char* dir, size_t size)
+{
+    const char* env = getenv("BFC_CACHE_DIR");
+    int n;
+    if (env && *env)
+        n = snprintf(dir, size, "%s", env);
+    else if ((env = getenv("XDG_CACHE_HOME")) && *env)
+        n = snprintf(dir, size, "%s/bfc", env);
+    else if ((env = getenv("HOME")) && *env)
+        n = snprintf(dir, size, "%s/.cache/bfc", env);
+    else
+        return -1;
+    if (n < 0 || (size_t)n >= size)
+        return -1;
+
+    /* each missing component in turn, like mkdir -p */
+    for (char* p = dir + 1; *p; p++)
+    {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        int made = mkdir(dir, 0700);
+        *p = '/';
+        if (made != 0 && errno != EEXIST)
+            return -1;
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+        return -1;
+
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode) || !private_to_us(&st))
+        return -1;
+    return 0;
+}
+
+static int entry_path(char* path, size_t size, const JitCacheKey* key)
+{
+    char dir[4096];
+    if (cache_dir(dir, sizeof(dir)) != 0)
+        return -1;
+    int n = snprintf(path, size, "%s/%016llx%016llx" CACHE_SUFFIX, dir, (unsigned long long)key->hash[0],
+                     (unsigned long long)key->hash[1]);
+    return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+JITContext* jit_cache_load(const JitCacheKey* key, Target target)
+{
+    char path[4200];
+    if (entry_path(path, sizeof(path), key) != 0)
+        return NULL;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL; /* a miss */
+
+    struct stat st;
+    CacheTrailer trailer;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || !private_to_us(&st) ||
+        st.st_size < (off_t)sizeof(trailer) ||
+        pread(fd, &trailer, sizeof(trailer), st.st_size - (off_t)sizeof(trailer)) != (ssize_t)sizeof(trailer) ||
+        memcmp(trailer.magic, CACHE_MAGIC, sizeof(trailer.magic)) != 0 || trailer.format != CACHE_FORMAT ||
+        trailer.target != (uint32_t)target || trailer.key[0] != key->hash[0] || trailer.key[1] != key->hash[1] ||
+        trailer.size == 0 || trailer.size + sizeof(trailer) != (uint64_t)st.st_size)
+    {
+        close(fd); /* stale, damaged or not ours; the next store replaces it */
+        return NULL;
+    }
+
+    JITContext* ctx = init_jit_file(fd, (size_t)trailer.size);
+    if (!ctx) /* the file cannot be mapped executable; copy it in like freshly generated code */
+    {
+        CodeBuffer* code = create_code_buffer((size_t)trailer.size);
+        if (code && pread(fd, code->code, (size_t)trailer.size, 0) == (ssize_t)trailer.size)
+        {
+            code->size = (size_t)trailer.size;
+            code->text_size = (size_t)trailer.text_size;
+            ctx = init_jit(code);
+        }
+        free_code_buffer(code);
+    }
+
+    if (ctx)
+        futimens(fd, NULL); /* most recently used */
+    close(fd);
+    return ctx;
+}
+
+static int compare_entries(const void* a, const void* b)
+{
+    const CacheEntry* x = a;
+    const CacheEntry* y = b;
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+/* drop the least recently used entries until the directory is within its limit, and any
+ * temporaries orphaned by a store that never finished */
+static void evict(const char* dir, uint64_t limit)
+{
+    DIR* d = opendir(dir);
+    if (!d)
+        return;
+
+    size_t count = 0;
+    size_t capacity = 64;
+    CacheEntry* entries = malloc(capacity * sizeof(CacheEntry));
+    uint64_t total = 0;
+    time_t orphaned = time(NULL) - CACHE_TEMP_GRACE;
+    struct dirent* de;
+    while (entries && (de = readdir(d)))
+    {
+        size_t len = strlen(de->d_name);
+        if (strncmp(de->d_name, CACHE_TEMP, strlen(CACHE_TEMP)) == 0)
+        {
+            struct stat st;
+            if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(st.st_mode) &&
+                st.st_mtime < orphaned)
+                unlinkat(dirfd(d), de->d_name, 0);
+            continue;
+        }
+        if (len <= strlen(CACHE_SUFFIX) || len >= sizeof(entries->name) ||
+            strcmp(de->d_name + len - strlen(CACHE_SUFFIX), CACHE_SUFFIX) != 0)
+            continue;
+
+        struct stat st;
+        if (fstatat(dirfd(d), de->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if (count == capacity)
+        {
+            capacity *= 2;
+            CacheEntry* grown = realloc(entries, capacity * sizeof(CacheEntry));
+            if (!grown)
+                break;
+            entries = grown;
+        }
+        memcpy(entries[count].name, de->d_name, len + 1);
+        entries[count].size = st.st_size;
+        entries[count].used = st.st_mtime;
+        total += (uint64_t)st.st_size;
+        count++;
+    }
+
+    if (entries && total > limit)
+    {
+        qsort(entries, count, sizeof(CacheEntry), compare_entries);
+        for (size_t i = 0; i < count && total > limit; i++)
+        {
+            if (unlinkat(dirfd(d), entries[i].name, 0) == 0)
+                total -= (uint64_t)entries[i].size;
+        }
+    }
+
+    free(entries);
+    closedir(d);
+}
+
+int jit_cache_store(const JitCacheKey* key, Target target, const CodeBuffer* compiled)
+{
+    char dir[4096];
+    char path[4200];
+    char temp[4200];
+    if (!compiled || compiled->size == 0 || cache_dir(dir, sizeof(dir)) != 0 ||
+        entry_path(path, sizeof(path), key) != 0)
+        return -1;
+
+    uint64_t limit = CACHE_DEFAULT_LIMIT;
+    const char* env = getenv("BFC_CACHE_SIZE");
+    if (env && *env)
+        limit = strtoull(env, NULL, 10) << 20;
+    if (compiled->size + sizeof(CacheTrailer) > limit)
+        return -1; /* would push everything else out and still not fit */
+
+    snprintf(temp, sizeof(temp), "%s/" CACHE_TEMP "XXXXXX", dir);
+    int fd = mkstemp(temp);
+    if (fd < 0)
+        return -1;
+
+    CacheTrailer trailer = { .format = CACHE_FORMAT, .target = (uint32_t)target,
+                             .key = { key->hash[0], key->hash[1] }, .size = compiled->size,
+                             .text_size = compiled->text_size };
+    memcpy(trailer.magic, CACHE_MAGIC, sizeof(trailer.magic));
+
+    bool written = write(fd, compiled->code, compiled->size) == (ssize_t)compiled->size &&
+                   write(fd, &trailer, sizeof(trailer)) == (ssize_t)sizeof(trailer);
+    if (close(fd) != 0 || !written || rename(temp, path) != 0)
+    {
+        unlink(temp);
+        return -1;
+    }
+
+    evict(dir, limit);
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bfrt.h"
+#include "libbfc.h"
+
+/* the code is built with hosted_io, so it never makes a syscall: output goes into a range the
+ * instance hands it and input comes from one, and when either runs out the code calls back into
+ * host_flush or host_refill below. The program's code is mapped once and only ever read;
+ * everything a run changes belongs to the instance */
+struct BfcProgram
+{
+    JITContext* code; /* no tape; instances bring their own */
+    EofMode eof_mode;
+};
+
+struct BfcInstance
+{
+    BfcProgram* program;
+    uint8_t* tape; /* padding included */
+    BFIO* io;
+    BfcIO* run;         /* the current run's buffers and callbacks */
+    uint8_t* out_start; /* the output range the code fills */
+    uint8_t* out_limit;
+    bool spilled;       /* no write callback and `output` is full; the rest goes to io->out and is lost */
+};
+
+void bfc_default_options(BfcOptions* options)
+{
+    options->opt_level = 2;
+    options->eof_mode = BFC_EOF_UNCHANGED;
+}
+
+BfcProgram* bfc_compile(const char* source, size_t length, const BfcOptions* options)
+{
+    BfcOptions defaults;
+    if (!options)
+    {
+        bfc_default_options(&defaults);
+        options = &defaults;
+    }
+    if (!source || options->opt_level < 0 || options->opt_level > 3 ||
+        options->eof_mode < BFC_EOF_UNCHANGED || options->eof_mode > BFC_EOF_MINUS_ONE)
+    {
+        fprintf(stderr, "Invalid source or options to compile\n");
+        return NULL;
+    }
+
+    IRProgram* ir = parse_source(source, length);
+    if (!ir)
+        return NULL;
+    if (options->opt_level >= 1)
+        ir = optimize1(ir);
+    if (options->opt_level >= 2)
+        ir = optimize2(ir);
+    if (options->opt_level >= 3)
+        ir = optimize3(ir);
+
+    CodegenOptions cg_options;
+    default_codegen_options(&cg_options);
+    cg_options.eof_mode = (EofMode)options->eof_mode;
+    cg_options.hosted_io = true;
+
+    CodeBuffer* compiled = ir ? codegen(ir, &cg_options) : NULL;
+    JITContext* code = compiled ? init_jit_code(compiled) : NULL;
+    free_code_buffer(compiled);
+    free_ir_program(ir);
+    if (!code)
+        return NULL;
+
+    BfcProgram* program = malloc(sizeof(BfcProgram));
+    if (!program)
+    {
+        perror("Memory allocation error");
+        free_jit(code);
+        return NULL;
+    }
+    program->code = code;
+    program->eof_mode = cg_options.eof_mode;
+    return program;
+}
+
+void bfc_free_program(BfcProgram* program)
+{
+    if (!program)
+        return;
+    free_jit(program->code);
+    free(program);
+}
+
+BfcInstance* bfc_create_instance(BfcProgram* program)
+{
+    if (!program)
+    {
+        fprintf(stderr, "No program to instantiate\n");
+        return NULL;
+    }
+
+    BfcInstance* instance = calloc(1, sizeof(BfcInstance));
+    if (!instance)
+    {
+        perror("Memory allocation error");
+        return NULL;
+    }
+    instance->program = program;
+    instance->tape = malloc(BF_TAPE_SIZE + 2 * BF_TAPE_PAD);
+    instance->io = malloc(sizeof(BFIO));
+    if (!instance->tape || !instance->io)
+    {
+        perror("Memory allocation error");
+        bfc_free_instance(instance);
+        return NULL;
+    }
+    return instance;
+}
+
+void bfc_free_instance(BfcInstance* instance)
+{
+    if (!instance)
+        return;
+    free(instance->tape);
+    free(instance->io);
+    free(instance);
+}
+
+/* the code stored the end of its output in out_ptr; after this the range has room again */
+static void host_flush(BFIO* io)
+{
+    BfcInstance* instance = io->host.user;
+    BfcIO* run = instance->run;
+    uint8_t* end = io->host.out_ptr;
+
+    if (run->write)
+    {
+        const uint8_t* data = instance->out_start;
+        while (data < end)
+        {
+            size_t taken = run->write(run->user, data, (size_t)(end - data));
+            if (taken == 0 || taken > (size_t)(end - data))
+            {
+                run->truncated = true;
+                break;
+            }
+            data += taken;
+        }
+        io->host.out_ptr = instance->out_start;
+    }
+    else if (instance->spilled)
+    {
+        if (end > instance->out_start)
+            run->truncated = true;
+        io->host.out_ptr = instance->out_start;
+    }
+    else if (end == instance->out_limit) /* `output` is full; keep it, and drop what comes after */
+    {
+        run->output_length = (size_t)(end - run->output);
+        instance->spilled = true;
+        instance->out_start = io->out;
+        instance->out_limit = io->out + BF_OUT_BUFFER;
+        io->host.out_ptr = instance->out_start;
+        io->host.out_end = instance->out_limit;
+    }
+}
+
+static void host_refill(BFIO* io)
+{
+    BfcInstance* instance = io->host.user;
+    BfcIO* run = instance->run;
+
+    if (run->write && io->host.out_ptr > instance->out_start) /* a prompt goes out before we wait */
+        host_flush(io);
+
+    size_t got = run->read ? run->read(run->user, io->in, BF_IN_BUFFER) : 0;
+    if (got > 0 && got <= BF_IN_BUFFER)
+    {
+        io->host.in_ptr = io->in;
+        io->host.in_end = io->in + got;
+        return;
+    }
+
+    /* for BF_EOF_UNCHANGED the code has already put the cell's value in eof_cell */
+    if (instance->program->eof_mode == BF_EOF_ZERO)
+        io->eof_cell = 0;
+    else if (instance->program->eof_mode == BF_EOF_MINUS_ONE)
+        io->eof_cell = 0xFF;
+    io->host.in_ptr = &io->eof_cell;
+    io->host.in_end = &io->eof_cell + 1;
+}
+
+int bfc_run(BfcInstance* instance, BfcIO* run)
+{
+    if (!instance || !run)
+    {
+        fprintf(stderr, "Invalid instance or I/O to run\n");
+        return -1;
+    }
+
+    BFIO* io = instance->io;
+    memset(instance->tape, 0, BF_TAPE_SIZE + 2 * BF_TAPE_PAD);
+    io->eof_cell = 0;
+    io->profile = NULL;
+    run->output_length = 0;
+    run->truncated = false;
+
+    /* the range always has room for one more byte when the code gets it */
+    instance->run = run;
+    if (run->output && run->output_size > 0)
+    {
+        instance->out_start = run->output;
+        instance->out_limit = run->output + run->output_size;
+        instance->spilled = false;
+    }
+    else /* our own buffer; without write, everything in it is lost */
+    {
+        instance->out_start = io->out;
+        instance->out_limit = io->out + BF_OUT_BUFFER;
+        instance->spilled = !run->write;
+    }
+
+    io->host = (BFHost){
+        .out_ptr = instance->out_start,
+        .out_end = instance->out_limit,
+        .in_ptr = run->input,
+        .in_end = run->input ? run->input + run->input_size : NULL,
+        .flush = host_flush,
+        .refill = host_refill,
+        .user = instance,
+    };
+
+    typedef int (*Entry)(uint8_t* tape, BFIO* io);
+    Entry entry = (Entry)jit_entry(instance->program->code);
+    int result = entry(instance->tape + BF_TAPE_PAD, io);
+
+    if (!run->write && !instance->spilled) /* the final flush left out_ptr where output ends */
+        run->output_length = (size_t)(io->host.out_ptr - run->output);
+    instance->run = NULL;
+    return result;
+}
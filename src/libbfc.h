@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* libbfc: the compiler as a library. A program is compiled once into its own executable region,
+ * and any number of instances run it, each with a tape of its own. Nothing is written to stdout,
+ * and errors go to stderr, as in the rest of bfc. Programs and instances are independent of
+ * each other, so different instances may run at the same time on different threads; one
+ * instance runs one thing at a time */
+#if defined(__GNUC__)
+#define BFC_API __attribute__((visibility("default"))) /* the shared library exports nothing else */
+#else
+#define BFC_API
+#endif
+
+typedef struct BfcProgram BfcProgram;
+typedef struct BfcInstance BfcInstance;
+
+/* what ',' leaves in the cell at end of input; the same values as EofMode */
+#define BFC_EOF_UNCHANGED 0
+#define BFC_EOF_ZERO 1
+#define BFC_EOF_MINUS_ONE 2
+
+typedef struct
+{
+    int opt_level; /* 0 to 3, as -O */
+    int eof_mode;  /* BFC_EOF_* */
+} BfcOptions;
+
+/* where a run reads and writes. Input and output buffers are used in place: the program reads
+ * `input` directly and writes its output directly into `output`. Both buffers must stay valid
+ * for the whole run */
+typedef struct
+{
+    const uint8_t* input; /* read first; may be NULL when input_size is 0 */
+    size_t input_size;
+    size_t (*read)(void* user, uint8_t* data, size_t size); /* then this, for more; 0 or NULL is end of input */
+
+    uint8_t* output; /* output lands here; NULL for a buffer of the instance's own */
+    size_t output_size;
+    size_t (*write)(void* user, const uint8_t* data, size_t size); /* gets the output each time the buffer
+                                                                      * fills, before a read and at the end;
+                                                                      * returns how much it took */
+    void* user; /* passed to read and write */
+
+    size_t output_length; /* out: without write, the bytes of output left in `output` */
+    bool truncated;       /* out: output was lost; the buffer filled up without a write, or write took less */
+} BfcIO;
+
+BFC_API void bfc_default_options(BfcOptions* options);
+
+BFC_API BfcProgram* bfc_compile(const char* source, size_t length, const BfcOptions* options); /* NULL on error */
+
+BFC_API void bfc_free_program(BfcProgram* program); /* only once all of its instances are freed */
+
+BFC_API BfcInstance* bfc_create_instance(BfcProgram* program);
+
+BFC_API int bfc_run(BfcInstance* instance, BfcIO* io); /* from the start, on a zeroed tape; 0 on success */
+
+BFC_API void bfc_free_instance(BfcInstance* instance);
@@ -4,49 +4,105 @@
 #include "bfc.h"
 #include "bfrt.h"
 
-char *read_source_file(const char *filename) 
+/* write the compiled program to a binary file */
+void write_binary_file(const char *filename, CodeBuffer *buf) 
 {
-    FILE *input = fopen(filename, "r");
-    if (!input)
+    FILE *out = fopen(filename, "wb");
+    if (!out) 
+    {
+        perror("Error opening output file");
+        exit(1);
+    }
+
+    /* write the machine binary */
+    fwrite(buf->code, 1, buf->size, out);
+    fclose(out);
+}
+
+/* the whole file in memory, for hashing; NULL with a message on failure */
+char *read_file(const char *filename, size_t *length)
+{
+    FILE *in = fopen(filename, "rb");
+    if (!in)
     {
         perror("Error opening input file");
         return NULL;
     }
 
-    /* get file size */
-    fseek(input, 0, SEEK_END);
-    size_t program_size = ftell(input);
-    fseek(input, 0, SEEK_SET);
-
-    char *program = malloc(program_size + 1);
-    if (!program) 
+    size_t capacity = 1 << 16;
+    size_t size = 0;
+    char *data = malloc(capacity);
+    size_t n;
+    while (data && (n = fread(data + size, 1, capacity - size, in)) > 0)
     {
+        size += n;
+        if (size == capacity)
+        {
+            capacity *= 2;
+            char *grown = realloc(data, capacity);
+            if (!grown)
+            {
+                free(data);
+                data = NULL;
+            }
+            else
+                data = grown;
+        }
+    }
+
+    if (!data)
         perror("Memory allocation error");
-        fclose(input);
-        return NULL;
+    else if (ferror(in))
+    {
+        perror("Error reading input file");
+        free(data);
+        data = NULL;
     }
+    fclose(in);
+    *length = size;
+    return data;
+}
 
-    /* read the program into memory */
-    size_t bytes_read = fread(program, 1, program_size, input);
-    fclose(input);
+/* run the JIT code between the usual status lines, then free it */
+int run_jit(JITContext *ctx)
+{
+    printf("Executing JIT compiled code...\n");
+    fflush(stdout); /* the program writes straight to the fd; keep our output in order */
 
-    program[bytes_read] = '\0';
-    return program;
+    int result = jit_exec_context(ctx);
+    if (result != 0)
+        fprintf(stderr, "JIT execution completed with non-zero code: %d\n", result);
+    else
+        printf("JIT execution completed successfully\n");
+    return result;
 }
 
-/* write the compiled program to a binary file */
-void write_binary_file(const char *filename, CodeBuffer *buf) 
+/* --profile-generate: run the instrumented code, then write out what it counted */
+int run_profiled(CodeBuffer *compiled, const IRProgram *program, const char *profile_file)
 {
-    FILE *out = fopen(filename, "wb");
-    if (!out) 
+    uint64_t *counters = calloc(2 * program->loop_count + 1, sizeof(uint64_t));
+    JITContext *ctx = counters ? init_jit(compiled) : NULL;
+    if (!ctx)
     {
-        perror("Error opening output file");
-        exit(1);
+        fprintf(stderr, "Failed to initialize JIT environment\n");
+        free(counters);
+        return -1;
     }
 
-    /* write the machine binary */
-    fwrite(buf->code, sizeof(uint32_t), buf->size, out);
-    fclose(out);
+    jit_set_profile(ctx, counters);
+    fflush(stdout); /* the program writes straight to the fd; keep our output in order */
+    int result = exec_jit(ctx);
+    free_jit(ctx);
+
+    if (result == 0)
+    {
+        if (profile_write(profile_file, program, counters) == 0)
+            printf("Profile written to %s\n", profile_file);
+        else
+            result = -1;
+    }
+    free(counters);
+    return result;
 }
 
 void print_usage(const char *program_name)
@@ -61,6 +117,24 @@ void print_usage(const char *program_name)
     fprintf(stderr, "  -O2               Enable intermediate optimizations\n");
     fprintf(stderr, "  -O3               Enable aggressive optimizations\n");
     fprintf(stderr, "  -j, --jit         Enable JIT runtime execution\n");
+    fprintf(stderr, "  --interp          Run the program in the interpreter; no output file needed\n");
+    fprintf(stderr, "  --tiered          Start in the interpreter and move hot loops to JIT code\n");
+    fprintf(stderr, "                    compiled in the background; no output file needed\n");
+    fprintf(stderr, "  --profile-generate=F  With --jit, count loop iterations and write them to F\n");
+    fprintf(stderr, "  --profile-use=F   Align the hot loops in profile F and build cold ones for size\n");
+    fprintf(stderr, "  --cache           With --jit, reuse code compiled by earlier runs of the same\n");
+    fprintf(stderr, "                    source and options (kept in $BFC_CACHE_DIR or ~/.cache/bfc)\n");
+    fprintf(stderr, "  --raw             Write bare machine code instead of an ELF executable\n");
+    fprintf(stderr, "  --no-rotate-loops Test loops at both the top and the bottom\n");
+    fprintf(stderr, "  --align-loops=N   Align loop heads to N bytes (16 or 32)\n");
+    fprintf(stderr, "  --no-vector-scans Scan for zero cells one cell at a time\n");
+    fprintf(stderr, "  --no-vector-updates  Update cells one at a time instead of 8 or 16 at once\n");
+    fprintf(stderr, "  --unbuffered-output  Make a write syscall for every '.' instead of buffering\n");
+    fprintf(stderr, "  --unbuffered-input   Make a read syscall for every ',' instead of mapping or\n");
+    fprintf(stderr, "                    buffering stdin\n");
+    fprintf(stderr, "  --eof=M           What ',' stores at end of input: unchanged (default), 0 or -1\n");
+    fprintf(stderr, "  --target=T        Generate code for T: arm64-darwin, arm64-linux or x86_64-linux\n");
+    fprintf(stderr, "                    (default: the host)\n");
     fprintf(stderr, "  -h, --help        Display this help message\n");
 }
 
@@ -70,6 +144,14 @@ int main(int argc, char *argv[])
     int verbose = 0;
     int opt_level = 1;
     int use_jit = 0;
+    int use_interp = 0;
+    int use_tiered = 0;
+    int raw_output = 0;
+    int use_cache = 0;
+    const char *profile_out = NULL;
+    const char *profile_in = NULL;
+    CodegenOptions cg_options;
+    default_codegen_options(&cg_options);
 
     int arg_idx = 1;
     while (arg_idx < argc && argv[arg_idx][0] == '-') 
@@ -100,6 +182,86 @@ int main(int argc, char *argv[])
         {
             use_jit = 1;
         }
+        else if (strcmp(argv[arg_idx], "--interp") == 0)
+        {
+            use_interp = 1;
+        }
+        else if (strcmp(argv[arg_idx], "--tiered") == 0)
+        {
+            use_tiered = 1;
+        }
+        else if (strncmp(argv[arg_idx], "--profile-generate=", 19) == 0)
+        {
+            profile_out = argv[arg_idx] + 19;
+            cg_options.profile = true;
+        }
+        else if (strncmp(argv[arg_idx], "--profile-use=", 14) == 0)
+        {
+            profile_in = argv[arg_idx] + 14;
+        }
+        else if (strcmp(argv[arg_idx], "--cache") == 0)
+        {
+            use_cache = 1;
+        }
+        else if (strcmp(argv[arg_idx], "--raw") == 0)
+        {
+            raw_output = 1;
+        }
+        else if (strcmp(argv[arg_idx], "--no-rotate-loops") == 0)
+        {
+            cg_options.rotate_loops = false;
+        }
+        else if (strcmp(argv[arg_idx], "--no-vector-scans") == 0)
+        {
+            cg_options.vector_scans = false;
+        }
+        else if (strcmp(argv[arg_idx], "--no-vector-updates") == 0)
+        {
+            cg_options.vector_updates = false;
+        }
+        else if (strcmp(argv[arg_idx], "--unbuffered-output") == 0)
+        {
+            cg_options.buffered_output = false;
+        }
+        else if (strcmp(argv[arg_idx], "--unbuffered-input") == 0)
+        {
+            cg_options.buffered_input = false;
+        }
+        else if (strncmp(argv[arg_idx], "--eof=", 6) == 0)
+        {
+            const char* mode = argv[arg_idx] + 6;
+            if (strcmp(mode, "unchanged") == 0)
+                cg_options.eof_mode = BF_EOF_UNCHANGED;
+            else if (strcmp(mode, "0") == 0)
+                cg_options.eof_mode = BF_EOF_ZERO;
+            else if (strcmp(mode, "-1") == 0)
+                cg_options.eof_mode = BF_EOF_MINUS_ONE;
+            else
+            {
+                fprintf(stderr, "Error: --eof expects unchanged, 0 or -1\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[arg_idx], "--target=", 9) == 0)
+        {
+            const Backend* backend = find_backend(argv[arg_idx] + 9);
+            if (!backend)
+            {
+                fprintf(stderr, "Error: unknown target '%s'\n", argv[arg_idx] + 9);
+                print_usage(argv[0]);
+                return 1;
+            }
+            cg_options.target = backend->target;
+        }
+        else if (strncmp(argv[arg_idx], "--align-loops=", 14) == 0)
+        {
+            cg_options.loop_align = atoi(argv[arg_idx] + 14);
+            if (cg_options.loop_align != 0 && cg_options.loop_align != 16 && cg_options.loop_align != 32)
+            {
+                fprintf(stderr, "Error: --align-loops expects 16 or 32\n");
+                return 1;
+            }
+        }
         else if (strcmp(argv[arg_idx], "-h") == 0 ||
                 strcmp(argv[arg_idx], "--help") == 0)
         {
@@ -115,55 +277,102 @@ int main(int argc, char *argv[])
         arg_idx++;
     }
 
-    if (argc - arg_idx < 2) 
+    if (!cg_options.buffered_input && cg_options.eof_mode != BF_EOF_UNCHANGED)
     {
-        fprintf(stderr, "Error: Missing input or output file\n");
-        print_usage(argv[0]);
+        fprintf(stderr, "Error: --eof needs buffered input\n");
         return 1;
     }
 
-    const char *input_file = argv[arg_idx];
-    const char *output_file = argv[arg_idx + 1];
-    char *program = read_source_file(input_file);
-    if (!program)
+    if (use_jit + use_interp + use_tiered > 1)
+    {
+        fprintf(stderr, "Error: only one of --jit, --interp and --tiered can be given\n");
         return 1;
+    }
 
-    char *processed_program = preproc(program);
-    if (!processed_program) 
+    if ((use_jit || use_tiered) && cg_options.target != host_target())
     {
-        fprintf(stderr, "Failed to preprocess input\n");
-        free(program);
+        fprintf(stderr, "Error: --jit and --tiered can only run code for the host target\n");
         return 1;
     }
 
-    if (verbose) 
+    if (profile_out && !use_jit)
     {
-        printf("Preprocessed program size: %zu bytes\n", strlen(processed_program));
+        fprintf(stderr, "Error: --profile-generate needs --jit\n");
+        return 1;
     }
 
-    TokenArray *tokens = tokenize(processed_program);
-    if (!tokens) 
+    if (use_cache && (!use_jit || profile_out))
     {
-        fprintf(stderr, "Tokenization failed\n");
-        free(program);
-        free(processed_program);
+        fprintf(stderr, "Error: --cache needs --jit, and does not apply to --profile-generate\n");
         return 1;
     }
 
-    if (verbose)
-        printf("Token count: %zu\n", tokens->count);
+    if (profile_in && (use_interp || use_tiered))
+    {
+        fprintf(stderr, "Error: --profile-use does not apply to --interp or --tiered\n");
+        return 1;
+    }
+
+    bool run_only = use_interp || use_tiered; /* nothing is written out */
+    if (argc - arg_idx < (run_only ? 1 : 2)) 
+    {
+        fprintf(stderr, "Error: Missing input or output file\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *input_file = argv[arg_idx];
+    const char *output_file = run_only ? NULL : argv[arg_idx + 1];
+    /* with --cache the source is read whole and hashed first; a hit skips everything up to the run */
+    char *source = NULL;
+    size_t source_length = 0;
+    JitCacheKey cache_key;
+    if (use_cache)
+    {
+        char *profile = NULL;
+        size_t profile_length = 0;
+        source = read_file(input_file, &source_length);
+        if (!source || (profile_in && !(profile = read_file(profile_in, &profile_length))))
+        {
+            free(source);
+            return 1;
+        }
+        jit_cache_key(&cache_key, source, source_length, opt_level, &cg_options, profile, profile_length);
+        free(profile);
+
+        JITContext *cached = jit_cache_load(&cache_key, cg_options.target);
+        if (cached)
+        {
+            free(source);
+            if (verbose)
+                printf("Using cached JIT code\n");
 
-    /* conv to IR; note that we skip AST generation because brainfuck is too simple for it */
-    IRProgram *ir_program = parse(tokens);
+            int result = run_jit(cached);
+            if (result != 0)
+                fprintf(stderr, "JIT execution failed with code: %d\n", result);
+            return 0;
+        }
+    }
+
+    /* the frontend streams the file straight into IR; note that we skip AST generation
+     * because brainfuck is too simple for it */
+    IRProgram *ir_program = source ? parse_source(source, source_length) : parse_file(input_file);
+    free(source);
     if (!ir_program) 
     {
         fprintf(stderr, "IR conversion failed\n");
-        free(program);
-        free(processed_program);
-        free_tkarr(tokens);
         return 1;
     }
 
+    if (use_tiered) /* the optimizer runs in the background, next to the interpreter */
+    {
+        if (verbose)
+            printf("Using tiered execution\n");
+        fflush(stdout);
+
+        return tier_run(ir_program, opt_level, &cg_options) != 0;
+    }
+
     if (verbose) 
     {
         printf("Before optimization: %zu\n", ir_program->count);
@@ -200,13 +409,27 @@ int main(int argc, char *argv[])
         }
     }
 
-    CodeBuffer *compiled = codegen(ir_program);
+    if (use_interp) /* no backend involved, so this works on any host */
+    {
+        if (verbose)
+            printf("Using the interpreter\n");
+        fflush(stdout); /* the program writes straight to the fd; keep our output in order */
+
+        int result = interp_run(ir_program, cg_options.eof_mode);
+        free_ir_program(ir_program);
+        return result != 0;
+    }
+
+    if (profile_in && profile_apply(profile_in, ir_program) != 0)
+    {
+        free_ir_program(ir_program);
+        return 1;
+    }
+
+    CodeBuffer *compiled = codegen(ir_program, &cg_options);
     if (!compiled) 
     {
         fprintf(stderr, "Compilation failed\n");
-        free(program);
-        free(processed_program);
-        free_tkarr(tokens);
         free_ir_program(ir_program);
         return 1;
     }
@@ -215,8 +438,20 @@ int main(int argc, char *argv[])
     {
         if (verbose)
             printf("Using JIT runtime execution\n");
-        
-        int result = jit_exec(compiled);
+        if (use_cache && jit_cache_store(&cache_key, cg_options.target, compiled) != 0 && verbose)
+            printf("Could not store the code in the JIT cache\n");
+
+        int result = -1;
+        if (profile_out)
+            result = run_profiled(compiled, ir_program, profile_out);
+        else
+        {
+            JITContext *ctx = init_jit(compiled);
+            if (ctx)
+                result = run_jit(ctx);
+            else
+                fprintf(stderr, "Failed to initialize JIT environment\n");
+        }
         if (result != 0) 
             fprintf(stderr, "JIT execution failed with code: %d\n", result);
         else if (verbose)
@@ -224,18 +459,24 @@ int main(int argc, char *argv[])
     }
     else /* standard AOT output */
     {
-        write_binary_file(output_file, compiled);
+        /* Linux targets get a runnable ELF executable; otherwise (or with --raw) just the code */
+        if (raw_output || cg_options.target == TARGET_ARM64_DARWIN)
+        {
+            write_binary_file(output_file, compiled);
+        }
+        else if (write_elf(output_file, compiled, cg_options.target) != 0)
+        {
+            free_code_buffer(compiled);
+            free_ir_program(ir_program);
+            return 1;
+        }
 
         printf("Compiled successfully. Output written to %s\n", output_file);
-        printf("Code size: %zu instructions (%zu bytes)\n", compiled->size,
-                compiled->size * sizeof(uint32_t));
+        printf("Code size: %zu bytes for %s\n", compiled->size, get_backend(cg_options.target)->name);
         printf("IR operations: %zu\n", ir_program->count);
     }
     
     free_code_buffer(compiled);
-    free(program);
-    free(processed_program);
-    free_tkarr(tokens);
     free_ir_program(ir_program);
     return 0;
 }
\ No newline at end of file
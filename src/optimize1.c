@@ -3,142 +3,398 @@
 #include <stdlib.h>
 #include "bfc.h"
 
+/* true if a and b are the same kind of operation (pointer or value) pointing opposite ways */
+static bool is_inverse(IROptype a, IROptype b)
+{
+    return (a == IR_PTR_ADD && b == IR_PTR_SUB) ||
+           (a == IR_PTR_SUB && b == IR_PTR_ADD) ||
+           (a == IR_VAL_ADD && b == IR_VAL_SUB) ||
+           (a == IR_VAL_SUB && b == IR_VAL_ADD);
+}
+
+static bool is_arith(IROptype type)
+{
+    return type == IR_PTR_ADD || type == IR_PTR_SUB ||
+           type == IR_VAL_ADD || type == IR_VAL_SUB;
+}
+
 /* this function tries to optimize operations of the same type */
 /* also is some sort of dead code elimination */
+/* the array is rewritten in place with a write cursor; ops[0, w) is the finished
+ * output so an op only ever has to look at ops[w - 1], which also handles
+ * cascades such as >+-< collapsing to nothing in a single linear pass */
 void optimize_combinable(IRProgram* program)
 {
-    if (!program || !program->first)
+    if (!program || program->size == 0)
         return;
 
-    IROperation* current = program->first;
-    while (current && current->next)
+    IROperation* ops = program->ops;
+    size_t w = 0;
+    for (size_t r = 0; r < program->size; r++)
     {
-        IROperation* next = current->next;
+        IROperation next = ops[r];
+        if (next.type == IR_NOP) /* leftover tombstones are dropped on the way */
+            continue;
 
-        /* if the next ops are mergable */
-        if ((current->type == IR_PTR_ADD && next->type == IR_PTR_ADD) ||
-            (current->type == IR_PTR_SUB && next->type == IR_PTR_SUB) ||
-            (current->type == IR_VAL_ADD && next->type == IR_VAL_ADD) ||
-            (current->type == IR_VAL_SUB && next->type == IR_VAL_SUB)) 
+        if (w > 0 && is_arith(next.type) && ops[w - 1].offset == next.offset)
         {
-            current->value += next->value; /* combine by adding values */
-
-            current->next = next->next; /* remove the next operation */
-            if (next == program->last)
-                program->last = current;
+            IROperation* current = &ops[w - 1];
 
-            free(next);
-            program->count--;
-            
-            /* don't advance current since we need to check the new next */
-            continue;
-        }
-        else if ((current->type == IR_PTR_ADD && next->type == IR_PTR_SUB) ||
-                (current->type == IR_PTR_SUB && next->type == IR_PTR_ADD) ||
-                (current->type == IR_VAL_ADD && next->type == IR_VAL_SUB) ||
-                (current->type == IR_VAL_SUB && next->type == IR_VAL_ADD))
-        {
-            int net_value = current->value - next->value;
-            if (net_value == 0) 
+            /* if the next ops are mergable */
+            if (current->type == next.type)
+            {
+                current->value += next.value; /* combine by adding values */
+                continue;
+            }
+            else if (is_inverse(current->type, next.type))
             {
-                /* operations cancel out completely */
-                IROperation* next_next = next->next;
-                
-                /* special case: if removing the first element */
-                if (current == program->first) 
+                int net_value = current->value - next.value;
+                if (net_value == 0) /* operations cancel out completely */
                 {
-                    program->first = next_next;
-                    if (!program->first)
-                        program->last = NULL;
-                } 
-                else
+                    w--;
+                }
+                else if (net_value > 0) /* first operation dominates */
                 {
-                    /* find the previous operation */
-                    IROperation* prev = program->first;
-                    while (prev && prev->next != current) 
-                        prev = prev->next;
-                    
-                    if (prev) 
-                    {
-                        prev->next = next_next;
-                        if (next == program->last)
-                            program->last = prev;
-                    }
+                    current->value = net_value;
                 }
-                
-                free(current);
-                free(next);
-                program->count -= 2;
-                
-                current = (program->first) ? program->first : NULL;
+                else /* second dominates */
+                {
+                    current->type = next.type;
+                    current->value = -net_value;
+                }
+                continue;
             }
-            else if (net_value > 0) /* first operation dominates */
-            {
-                current->value = net_value;
-                current->next = next->next;
-                if (next == program->last)
-                    program->last = current;
+        }
 
-                free(next);
-                program->count--;
-            }
-            else /* second dominates */
-            {
-                current->type = next->type;
-                current->value = -net_value;
-                
-                /* remove next operation */
-                current->next = next->next;
-                if (next == program->last)
-                    program->last = current;
-
-                free(next);
-                program->count--;
-            }
+        ir_move_op(program, r, w++);
+    }
+
+    program->size = w;
+    program->count = w;
+}
+
+/* pointer movement sinking; within a basic block every memory op gets the pending
+ * pointer delta folded into its offset and the delta itself is emitted once, right
+ * before the next loop edge or scan. a pointer move left over at the very end is dead.
+ * every flushed op replaces at least one dropped pointer op, so the write cursor
+ * never overtakes the read cursor */
+void optimize_offsets(IRProgram* program)
+{
+    if (!program || program->size == 0)
+        return;
+
+    IROperation* ops = program->ops;
+    size_t w = 0;
+    int delta = 0; /* virtual pointer minus real pointer */
+    for (size_t r = 0; r < program->size; r++)
+    {
+        IROperation* op = &ops[r];
+        switch (op->type)
+        {
+            case IR_PTR_ADD:
+                delta += op->value;
+                continue;
+
+            case IR_PTR_SUB:
+                delta -= op->value;
+                continue;
+
+            case IR_NOP:
+                continue;
+
+            case IR_ADD_MUL:
+            case IR_MOVE_VAL:
+                op->src += delta;
+                /* fall through */
+            case IR_VAL_ADD:
+            case IR_VAL_SUB:
+            case IR_OUTPUT:
+            case IR_INPUT:
+            case IR_SET_ZERO:
+            case IR_SET_VAL:
+                op->offset += delta;
+                break;
+
+            default: /* loop edges, scans and anything else read the real pointer */
+                if (delta != 0)
+                {
+                    ir_set_op(&ops[w++], delta > 0 ? IR_PTR_ADD : IR_PTR_SUB, abs(delta), 0, -1);
+                    delta = 0;
+                }
+                break;
         }
-        current = current->next;
+
+        ir_move_op(program, r, w++);
     }
+
+    program->size = w;
+    program->count = w;
 }
 
 /* detect and optimize clear cell loops [-]*/
 void optimize_clear_loops(IRProgram* program) 
 {
-    if (!program || !program->first)
+    if (!program)
         return;
     
-    IROperation* current = program->first;
-    while (current && current->next && current->next->next) 
+    IROperation* ops = program->ops;
+    for (size_t id = 0; id < program->loop_count; id++) 
     {
-        if (current->type == IR_LOOP_START &&
-            current->next->type == IR_VAL_SUB && current->next->value == 1 &&
-            current->next->next->type == IR_LOOP_END && 
-            current->next->next->loop_id == current->loop_id) 
+        IRLoop* loop = &program->loops[id];
+        if (loop->live && loop->end == loop->start + 2 &&
+            ops[loop->start + 1].type == IR_VAL_SUB && ops[loop->start + 1].value == 1 &&
+            ops[loop->start + 1].offset == 0) 
         {
-            
             /* replace with SET_ZERO so we can generate more specialized instructions */
-            IROperation* loop_end = current->next->next;
-            IROperation* after_loop = loop_end->next;
-            IROperation* to_free = current->next; // Save pointer to free later
-            
-            current->type = IR_SET_ZERO;
-            current->value = 0;
-            current->next = after_loop;
-            
-            if (loop_end == program->last)
-                program->last = current;
-            
-            /* cleanup */
-            free(to_free);
-            free(loop_end);
-            program->count -= 2;
-        
-            continue; /* don't advance */
+            ir_set_op(&ops[loop->start], IR_SET_ZERO, 0, 0, -1);
+            ir_remove(program, loop->start + 1);
+            ir_remove(program, loop->end);
+            ir_remove_loop(program, id);
         }
-        
-        current = current->next;
     }
+
+    ir_compact(program);
+}
+
+/* known-value propagation. Walking forward, we keep what is known about the cells around the
+ * pointer: a constant, or unknown. At program start every cell is known to be zero, and every
+ * loop exit leaves the tested cell at zero. With that:
+ *   - a loop whose cell is known zero on entry never runs and is deleted, along with the
+ *     comment loop some programs open with
+ *   - a set to the value a cell already holds is dropped, e.g. a redundant [-]
+ *   - an add to a known cell becomes a set, so SET_ZERO; VAL_ADD n is SET_VAL n
+ *   - a set that is overwritten before anything reads it is dropped
+ *   - ADD_MUL/MOVE_VAL from a known source become plain adds, or nothing
+ * loop heads are a merge with the back edge, so nothing is known in a loop body beyond what the
+ * body itself establishes */
+#define KNOWN_CELLS 64
+#define NO_STORE ((size_t)-1)
+
+typedef struct
+{
+    int offset;   /* cell, relative to the pointer */
+    int value;    /* 0-255, or -1 when unknown */
+    size_t store; /* full store to the cell nothing has read yet, or NO_STORE */
+} KnownCell;
+
+typedef struct
+{
+    KnownCell cells[KNOWN_CELLS];
+    int count;
+    bool all_zero; /* cells not in the table are zero, rather than unknown */
+} KnownState;
+
+static KnownCell* known_find(KnownState* state, int offset)
+{
+    for (int i = 0; i < state->count; i++)
+    {
+        if (state->cells[i].offset == offset)
+            return &state->cells[i];
+    }
+    return NULL;
+}
+
+static int known_get(KnownState* state, int offset)
+{
+    KnownCell* cell = known_find(state, offset);
+    if (cell)
+        return cell->value;
+    return state->all_zero ? 0 : -1;
+}
+
+/* everything becomes unknown; pending stores count as read */
+static void known_forget(KnownState* state)
+{
+    state->count = 0;
+    state->all_zero = false;
+}
+
+/* record the new value (-1 = unknown) of a cell; `store` is the op when it overwrote the cell whole */
+static void known_set(KnownState* state, int offset, int value, size_t store)
+{
+    KnownCell* cell = known_find(state, offset);
+    if (!cell)
+    {
+        if (state->count == KNOWN_CELLS) /* out of room; losing precision is always safe */
+            known_forget(state);
+        cell = &state->cells[state->count++];
+        cell->offset = offset;
+    }
+    cell->value = value;
+    cell->store = store;
+}
+
+/* the cell is about to be read, so its pending store is live */
+static void known_read(KnownState* state, int offset)
+{
+    KnownCell* cell = known_find(state, offset);
+    if (cell)
+        cell->store = NO_STORE;
+}
+
+/* op `i` sets cell `offset` to `value` outright; drops it if the cell already holds that, and
+ * the previous store if nothing read it */
+static void known_store(IRProgram* program, KnownState* state, size_t i, int offset, int value)
+{
+    if (known_get(state, offset) == value)
+    {
+        ir_remove(program, i);
+        return;
+    }
+
+    KnownCell* cell = known_find(state, offset);
+    if (cell && cell->store != NO_STORE)
+        ir_remove(program, cell->store);
+
+    ir_set_op(&program->ops[i], value == 0 ? IR_SET_ZERO : IR_SET_VAL, value, offset, -1);
+    known_set(state, offset, value, i);
+}
+
+/* op `i` adds `amount` to cell `offset` */
+static void known_add(IRProgram* program, KnownState* state, size_t i, int offset, int amount)
+{
+    int value = known_get(state, offset);
+    if (value >= 0)
+    {
+        known_store(program, state, i, offset, (value + amount) & 0xFF);
+        return;
+    }
+
+    known_read(state, offset);
+    known_set(state, offset, -1, NO_STORE);
 }
 
+void optimize_known_values(IRProgram* program)
+{
+    if (!program || program->size == 0)
+        return;
+
+    KnownState state;
+    state.count = 0;
+    state.all_zero = true; /* the tape starts out zeroed */
+
+    IROperation* ops = program->ops;
+    for (size_t i = 0; i < program->size; i++)
+    {
+        IROperation* op = &ops[i];
+        switch (op->type)
+        {
+            case IR_PTR_ADD:
+            case IR_PTR_SUB:
+            {
+                int delta = op->type == IR_PTR_ADD ? op->value : -op->value;
+                for (int k = 0; k < state.count; k++)
+                    state.cells[k].offset -= delta;
+                break;
+            }
+
+            case IR_VAL_ADD:
+                known_add(program, &state, i, op->offset, op->value);
+                break;
+
+            case IR_VAL_SUB:
+                known_add(program, &state, i, op->offset, -op->value);
+                break;
+
+            case IR_SET_ZERO:
+            case IR_SET_VAL:
+                known_store(program, &state, i, op->offset, op->type == IR_SET_VAL ? op->value & 0xFF : 0);
+                break;
+
+            case IR_OUTPUT:
+                known_read(&state, op->offset);
+                break;
+
+            case IR_INPUT: /* may leave the old value at end of input, so it reads the cell too */
+                known_read(&state, op->offset);
+                known_set(&state, op->offset, -1, NO_STORE);
+                break;
+
+            case IR_ADD_MUL:
+            case IR_MOVE_VAL:
+            {
+                int source = known_get(&state, op->src);
+                if (source == 0) /* adds nothing, and a zero source needs no clearing */
+                {
+                    ir_remove(program, i);
+                    break;
+                }
+
+                if (source > 0 && op->type == IR_ADD_MUL)
+                {
+                    int amount = (source * op->value) & 0xFF;
+                    if (amount == 0)
+                        ir_remove(program, i);
+                    else
+                    {
+                        ir_set_op(op, IR_VAL_ADD, amount, op->offset, -1);
+                        known_add(program, &state, i, op->offset, amount);
+                    }
+                    break;
+                }
+
+                int target = known_get(&state, op->offset);
+                known_read(&state, op->src);
+                known_read(&state, op->offset);
+                known_set(&state, op->offset, source >= 0 && target >= 0 ? (target + source * op->value) & 0xFF : -1, NO_STORE);
+                if (op->type == IR_MOVE_VAL)
+                    known_set(&state, op->src, 0, NO_STORE);
+                break;
+            }
+
+            case IR_SCAN_ZERO:
+            case IR_SCAN_NONZERO:
+            {
+                int value = known_get(&state, 0);
+                if ((op->type == IR_SCAN_ZERO && value == 0) || (op->type == IR_SCAN_NONZERO && value > 0))
+                {
+                    ir_remove(program, i); /* already there */
+                    break;
+                }
+
+                known_forget(&state);
+                if (op->type == IR_SCAN_ZERO)
+                    known_set(&state, 0, 0, NO_STORE);
+                break;
+            }
+
+            case IR_LOOP_START:
+            {
+                if (known_get(&state, 0) == 0) /* never entered */
+                {
+                    size_t end = program->loops[op->loop_id].end;
+                    for (size_t k = i; k <= end; k++)
+                    {
+                        if (ops[k].type == IR_LOOP_START)
+                            ir_remove_loop(program, ops[k].loop_id);
+                        ir_remove(program, k);
+                    }
+                    i = end;
+                    break;
+                }
+
+                known_forget(&state);
+                break;
+            }
+
+            case IR_LOOP_END:
+                known_forget(&state);
+                known_set(&state, 0, 0, NO_STORE);
+                break;
+
+            case IR_OUTPUT_STR:
+            case IR_NOP:
+                break;
+
+            case IR_CONDITIONAL:
+            case IR_UPDATE_VEC: /* only made by codegen, after every pass */
+                known_forget(&state);
+                break;
+        }
+    }
+
+    ir_compact(program);
+}
 
 IRProgram* optimize1(IRProgram* program)
 {
@@ -148,6 +404,9 @@ IRProgram* optimize1(IRProgram* program)
     /* basic optimization */
     optimize_combinable(program);
     optimize_clear_loops(program);
+    optimize_combinable(program);
+    optimize_known_values(program);
+    optimize_offsets(program);
     optimize_combinable(program); /* final pass */
     return program;
-}
\ No newline at end of file
+}
@@ -1,91 +1,375 @@
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include "bfc.h"
 
 void optimize_move_loops(IRProgram* program) 
 {
-    IROperation* op = program->first;
-    
-    while (op && op->next && op->next->next && op->next->next->next && op->next->next->next->next) 
+    if (!program)
+        return;
+
+    IROperation* ops = program->ops;
+    for (size_t id = 0; id < program->loop_count; id++) 
     {
-        /* check for [->+<] pattern */
-        if (op->type == IR_LOOP_START &&
-            op->next->type == IR_VAL_SUB && op->next->value == 1 &&
-            op->next->next->type == IR_PTR_ADD && 
-            op->next->next->next->type == IR_VAL_ADD && 
-            op->next->next->next->next->type == IR_PTR_SUB &&
-            op->next->next->next->next->next->type == IR_LOOP_END &&
-            op->next->next->next->next->next->loop_id == op->loop_id &&
-            op->next->next->next->next->value == op->next->next->value) 
+        IRLoop* loop = &program->loops[id];
+        if (!loop->live || loop->end != loop->start + 3)
+            continue;
+
+        /* after pointer sinking [->+<] is just two adds on different offsets, in either order */
+        IROperation* dec = &ops[loop->start + 1];
+        IROperation* add = &ops[loop->start + 2];
+        if (add->type == IR_VAL_SUB)
+        {
+            IROperation* tmp = dec;
+            dec = add;
+            add = tmp;
+        }
+
+        if (dec->type == IR_VAL_SUB && dec->value == 1 && dec->offset == 0 &&
+            add->type == IR_VAL_ADD && add->offset != 0) 
         {
-            /* replace with a MOVE_VAL operation */
-            IROperation* loop_end = op->next->next->next->next->next;
-            IROperation* after_loop = loop_end->next;
-            
-            op->type = IR_MOVE_VAL;
-            op->value = op->next->next->next->value; /* save the add amount */
-            op->offset = op->next->next->value; /* save the offset */
-            op->next = after_loop;
-            
-            if (loop_end == program->last)
-                program->last = op;
+            /* replace with a MOVE_VAL operation; save the add amount and the offset */
+            ir_set_op(&ops[loop->start], IR_MOVE_VAL, add->value, add->offset, -1);
                 
             /* clean the replaced operations */
-            free(op->next);
-            free(op->next->next);
-            free(op->next->next->next);
-            free(op->next->next->next->next);
-            free(loop_end);
-            
-            program->count -= 5;
-            continue;
+            for (size_t k = loop->start + 1; k <= loop->end; k++)
+                ir_remove(program, k);
+            ir_remove_loop(program, id);
         }
-        op = op->next;
     }
+
+    ir_compact(program);
 }
 
 void optimize_scan_loops(IRProgram* program) 
 {
-    if (!program || !program->first)
+    if (!program)
         return;
         
-    IROperation* op = program->first;
-    
-    while (op && op->next && op->next->next) 
+    IROperation* ops = program->ops;
+    for (size_t id = 0; id < program->loop_count; id++) 
     {
+        IRLoop* loop = &program->loops[id];
+        if (!loop->live || loop->end != loop->start + 2)
+            continue;
+
+        IROperation* body = &ops[loop->start + 1];
+
         /* check for [>] or [<] pattern */
-        if (op->type == IR_LOOP_START &&
-            (op->next->type == IR_PTR_ADD || op->next->type == IR_PTR_SUB) &&
-            op->next->next->type == IR_LOOP_END && 
-            op->next->next->loop_id == op->loop_id) 
+        if (body->type == IR_PTR_ADD || body->type == IR_PTR_SUB) 
         {
             /* replace with a SCAN_ZERO operation */
-            IROperation* to_free1 = op->next;
-            IROperation* to_free2 = op->next->next;
-            IROperation* after_loop = to_free2->next;
-            
-            /* update type and value before modifying the linked list */
-            op->type = IR_SCAN_ZERO;
-            op->value = (to_free1->type == IR_PTR_ADD) ? to_free1->value : -to_free1->value;
-            
-            /* update the linked list */
-            op->next = after_loop;
-            
-            if (to_free2 == program->last)
-                program->last = op;
-            
-            free(to_free1);
-            free(to_free2);
-            program->count -= 2;
-            continue;
+            int step = (body->type == IR_PTR_ADD) ? body->value : -body->value;
+            ir_set_op(&ops[loop->start], IR_SCAN_ZERO, step, 0, -1);
+            ir_remove(program, loop->start + 1);
+            ir_remove(program, loop->end);
+            ir_remove_loop(program, id);
+        }
+    }
+
+    ir_compact(program);
+}
+
+/* the prefix of a program that runs before its first ',' only ever sees the zeroed tape, so its
+ * output and the tape it leaves behind are known at compile time. We run that prefix here, on a
+ * tape of our own, and replace it with one IR_OUTPUT_STR for everything it printed, an IR_SET_VAL
+ * for every non-zero cell and the final pointer move. Evaluation stops at the first ',', at an
+ * op we cannot evaluate, when the pointer leaves the tape or after FOLD_BUDGET steps; the prefix
+ * is then cut back to the last top-level op boundary, since half a loop cannot be replaced */
+#define FOLD_BUDGET (1 << 20) /* ops executed, scan steps included */
+#define FOLD_MAX_CELLS 1024   /* non-zero cells; past this a loop is smaller than the stores it sets up */
+#define FOLD_TAPE_CELLS (BF_TAPE_SIZE + 2 * BF_TAPE_PAD)
+
+typedef struct
+{
+    size_t index; /* tape cell, BF_TAPE_PAD-biased */
+    uint8_t old;  /* value before the write */
+} FoldUndo;
+
+typedef struct
+{
+    uint8_t tape[FOLD_TAPE_CELLS];
+    long ptr;        /* BF_TAPE_PAD-biased, like index */
+    size_t nonzero;  /* cells that are not zero */
+
+    uint8_t* out;
+    size_t out_size;
+    size_t out_capacity;
+
+    FoldUndo* undo;  /* writes since the last top-level boundary */
+    size_t undo_size;
+    size_t undo_capacity;
+    bool failed;     /* out of memory; give up on the whole fold */
+} FoldState;
+
+/* tape index of cell ptr + offset, or -1 when that is off the tape */
+static long fold_cell(FoldState* fold, int offset)
+{
+    long index = fold->ptr + offset;
+    return index >= 0 && index < FOLD_TAPE_CELLS ? index : -1;
+}
+
+static void fold_store(FoldState* fold, long index, uint8_t value)
+{
+    uint8_t old = fold->tape[index];
+    if (old == value)
+        return;
+
+    if (fold->undo_size == fold->undo_capacity)
+    {
+        size_t capacity = fold->undo_capacity ? fold->undo_capacity * 2 : 256;
+        FoldUndo* undo = realloc(fold->undo, capacity * sizeof(FoldUndo));
+        if (!undo)
+        {
+            fold->failed = true;
+            return;
+        }
+        fold->undo = undo;
+        fold->undo_capacity = capacity;
+    }
+    fold->undo[fold->undo_size++] = (FoldUndo){ (size_t)index, old };
+
+    fold->nonzero += (value != 0) - (old != 0);
+    fold->tape[index] = value;
+}
+
+static void fold_output(FoldState* fold, const uint8_t* bytes, size_t length)
+{
+    if (fold->out_size + length > fold->out_capacity)
+    {
+        size_t capacity = fold->out_capacity ? fold->out_capacity : 256;
+        while (capacity < fold->out_size + length)
+            capacity *= 2;
+
+        uint8_t* out = realloc(fold->out, capacity);
+        if (!out)
+        {
+            fold->failed = true;
+            return;
+        }
+        fold->out = out;
+        fold->out_capacity = capacity;
+    }
+
+    memcpy(fold->out + fold->out_size, bytes, length);
+    fold->out_size += length;
+}
+
+/* run op `i`; returns the next op to run, or program->size + 1 when `i` cannot be evaluated */
+static size_t fold_step(IRProgram* program, FoldState* fold, size_t i, long* budget)
+{
+    IROperation* op = &program->ops[i];
+    size_t stop = program->size + 1;
+    long cell = -1;
+
+    switch (op->type)
+    {
+        case IR_PTR_ADD:
+            fold->ptr += op->value;
+            break;
+
+        case IR_PTR_SUB:
+            fold->ptr -= op->value;
+            break;
+
+        case IR_VAL_ADD:
+        case IR_VAL_SUB:
+        case IR_SET_ZERO:
+        case IR_SET_VAL:
+        {
+            if ((cell = fold_cell(fold, op->offset)) < 0)
+                return stop;
+
+            uint8_t value = fold->tape[cell];
+            if (op->type == IR_VAL_ADD)
+                value += op->value;
+            else if (op->type == IR_VAL_SUB)
+                value -= op->value;
+            else
+                value = op->type == IR_SET_VAL ? op->value : 0;
+            fold_store(fold, cell, value);
+            break;
         }
-        op = op->next;
+
+        case IR_OUTPUT:
+            if ((cell = fold_cell(fold, op->offset)) < 0)
+                return stop;
+            fold_output(fold, &fold->tape[cell], 1);
+            break;
+
+        case IR_OUTPUT_STR:
+            fold_output(fold, program->strings + op->src, op->value);
+            break;
+
+        case IR_ADD_MUL:
+        case IR_MOVE_VAL:
+        {
+            long source = fold_cell(fold, op->src);
+            if (source < 0 || (cell = fold_cell(fold, op->offset)) < 0)
+                return stop;
+
+            uint8_t value = fold->tape[source];
+            fold_store(fold, cell, fold->tape[cell] + value * op->value);
+            if (op->type == IR_MOVE_VAL)
+                fold_store(fold, source, 0);
+            break;
+        }
+
+        case IR_SCAN_ZERO:
+        case IR_SCAN_NONZERO:
+        {
+            bool until_zero = op->type == IR_SCAN_ZERO;
+            for (;;)
+            {
+                if ((cell = fold_cell(fold, 0)) < 0 || --*budget < 0)
+                    return stop;
+                if ((fold->tape[cell] == 0) == until_zero)
+                    break;
+                fold->ptr += op->value;
+            }
+            break;
+        }
+
+        case IR_LOOP_START:
+            if ((cell = fold_cell(fold, 0)) < 0)
+                return stop;
+            if (fold->tape[cell] == 0)
+                return program->loops[op->loop_id].end + 1;
+            break;
+
+        case IR_LOOP_END:
+            if ((cell = fold_cell(fold, 0)) < 0)
+                return stop;
+            if (fold->tape[cell] != 0)
+                return program->loops[op->loop_id].start + 1;
+            break;
+
+        case IR_NOP:
+            break;
+
+        case IR_INPUT: /* the first thing that depends on the outside world */
+        case IR_CONDITIONAL:
+        case IR_UPDATE_VEC: /* only made by codegen, after every pass */
+            return stop;
     }
+
+    return fold->failed ? stop : i + 1;
+}
+
+void optimize_constant_prefix(IRProgram* program)
+{
+    if (!program || program->size == 0)
+        return;
+
+    FoldState* fold = calloc(1, sizeof(FoldState));
+    if (!fold)
+        return;
+    fold->ptr = BF_TAPE_PAD;
+
+    /* the last point between two top-level ops we could cut at, and the state there */
+    size_t cut = 0;
+    long cut_ptr = fold->ptr;
+    size_t cut_out = 0;
+
+    long budget = FOLD_BUDGET;
+    int depth = 0; /* loops we are inside of */
+    size_t i = 0;
+    while (i < program->size)
+    {
+        if (depth == 0)
+        {
+            if (fold->nonzero > FOLD_MAX_CELLS)
+                break;
+            cut = i;
+            cut_ptr = fold->ptr;
+            cut_out = fold->out_size;
+            fold->undo_size = 0;
+        }
+
+        if (--budget < 0)
+            break;
+
+        IROperation* op = &program->ops[i];
+        size_t next = fold_step(program, fold, i, &budget);
+        if (next > program->size)
+            break;
+
+        if (op->type == IR_LOOP_START && next == i + 1)
+            depth++;
+        else if (op->type == IR_LOOP_END && next == i + 1)
+            depth--;
+        i = next;
+    }
+
+    if (i == program->size && depth == 0 && fold->nonzero <= FOLD_MAX_CELLS) /* ran to the end */
+    {
+        cut = i;
+        cut_ptr = fold->ptr;
+        cut_out = fold->out_size;
+        fold->undo_size = 0;
+    }
+
+    /* back to the state at the cut */
+    while (fold->undo_size > 0)
+    {
+        FoldUndo* undo = &fold->undo[--fold->undo_size];
+        fold->nonzero += (undo->old != 0) - (fold->tape[undo->index] != 0);
+        fold->tape[undo->index] = undo->old;
+    }
+
+    if (cut > 0 && !fold->failed)
+    {
+        int string = cut_out > 0 ? ir_add_string(program, fold->out, cut_out) : 0;
+        size_t needed = (cut_out > 0) + fold->nonzero + (cut_ptr != BF_TAPE_PAD);
+        if (string >= 0 && (needed <= cut || ir_reserve(program, program->size + needed - cut) == 0))
+        {
+            /* make room at the front; ir_move_op keeps the loop tree pointing at the right slots */
+            size_t grow = needed > cut ? needed - cut : 0;
+            for (size_t k = program->size; k-- > cut;)
+                ir_move_op(program, k, k + grow);
+            program->size += grow;
+
+            for (size_t k = 0; k < cut; k++)
+            {
+                IROperation* op = &program->ops[k];
+                if (op->type == IR_LOOP_START)
+                    ir_remove_loop(program, op->loop_id);
+            }
+
+            size_t w = 0;
+            if (cut_out > 0)
+            {
+                ir_set_op(&program->ops[w], IR_OUTPUT_STR, (int)cut_out, 0, -1);
+                program->ops[w++].src = string;
+            }
+            for (long k = 0; k < FOLD_TAPE_CELLS; k++) /* the pointer is still at cell 0 here */
+            {
+                if (fold->tape[k] != 0)
+                    ir_set_op(&program->ops[w++], IR_SET_VAL, fold->tape[k], (int)(k - BF_TAPE_PAD), -1);
+            }
+            if (cut_ptr != BF_TAPE_PAD)
+            {
+                long delta = cut_ptr - BF_TAPE_PAD;
+                ir_set_op(&program->ops[w++], delta > 0 ? IR_PTR_ADD : IR_PTR_SUB, (int)(delta > 0 ? delta : -delta), 0, -1);
+            }
+            for (; w < cut + grow; w++)
+                program->ops[w].type = IR_NOP;
+            ir_compact(program);
+        }
+    }
+
+    free(fold->out);
+    free(fold->undo);
+    free(fold);
 }
 
 IRProgram* optimize2(IRProgram* program)
 {
     optimize_scan_loops(program);
     optimize_move_loops(program);
+    optimize_known_values(program);
+    optimize_offsets(program); /* the removed loops were block boundaries */
     optimize_combinable(program);
+    optimize_constant_prefix(program); /* last, so it runs the cheaper IR */
     return program;
-}
\ No newline at end of file
+}
@@ -3,195 +3,143 @@
 #include "bfc.h"
 
 /* NOTE: extra careful because too aggressive = program break */
-/* this is a double pass optimization subroutine */
-/* the idea of this optimization this to detect if the IR instructions
- * are symmetric or not inside a loop that looks like this:
- * [>++<-].
- * the total pointer offset is 0, all pointer movements cancel each other out
- * one cell is incrementing, original is dec by 1
+/* the idea of this optimization is to turn a balanced loop into straight-line code.
+ * a loop like this:
+ * [->+>++>---<<<]
+ * is balanced when, after pointer sinking, its body is nothing but adds and subs
+ * at fixed offsets: no pointer movement left, no I/O, no nested loops, and the
+ * counter cell[ptr] changes by exactly 1 per iteration. the loop then runs
+ * cell[ptr] times (or 256 - cell[ptr] times when counting up) and every other
+ * cell it touches ends up with a fixed multiple of the counter added to it:
+ * cell[ptr+1] += cell[ptr], cell[ptr+2] += 2 * cell[ptr], cell[ptr+3] -= 3 * cell[ptr], cell[ptr] = 0
  */
- typedef struct 
- {
-    int ptr_offset;           /* total pointer movement */
-    int value_multiply;       /* value being multiplied */
-    int decrement_count;      /* how many times the original cell is decremented */
-    bool has_ptr_movement;    /* did we move pointers? */
-    bool has_value_add;       /* did we add a value? */
-    bool is_direct_multiply;  /* is this a confirmed multiplication pattern? */
-} MultiplyLoopAnalysis;
-
-MultiplyLoopAnalysis analyze_multiply_loop(IROperation* loopstart)
+#define MAX_LINEAR_TARGETS 64
+
+typedef struct
 {
-    MultiplyLoopAnalysis analysis = { 0 };
+    int offset; /* cell the loop adds to */
+    int factor; /* net amount added per iteration */
+} LinearTarget;
 
-    if (!loopstart || !loopstart->next)
-        return analysis;
+typedef struct
+{
+    LinearTarget targets[MAX_LINEAR_TARGETS];
+    int target_count;
+    int counter_step;  /* net change of cell[ptr] per iteration */
+    bool is_linear;    /* is this a confirmed balanced loop? */
+} LinearLoopAnalysis;
 
-    IROperation* current = loopstart->next;
+static bool add_to_target(LinearLoopAnalysis* analysis, int offset, int amount)
+{
+    if (offset == 0)
+    {
+        analysis->counter_step += amount;
+        return true;
+    }
 
-    while (current && current->type != IR_LOOP_END) 
+    for (int i = 0; i < analysis->target_count; i++)
     {
+        if (analysis->targets[i].offset == offset)
+        {
+            analysis->targets[i].factor += amount;
+            return true;
+        }
+    }
+
+    if (analysis->target_count == MAX_LINEAR_TARGETS)
+        return false;
+
+    analysis->targets[analysis->target_count].offset = offset;
+    analysis->targets[analysis->target_count].factor = amount;
+    analysis->target_count++;
+    return true;
+}
+
+/* cells are 8-bit so factors only matter mod 256; keep them in [-128, 127] */
+static int wrap_factor(int factor)
+{
+    factor &= 0xFF;
+    return factor >= 128 ? factor - 256 : factor;
+}
+
+LinearLoopAnalysis analyze_linear_loop(const IRProgram* program, const IRLoop* loop)
+{
+    LinearLoopAnalysis analysis = { 0 };
+
+    for (size_t i = loop->start + 1; i < loop->end; i++) 
+    {
+        const IROperation* current = &program->ops[i];
         switch (current->type) 
         {
-            case IR_PTR_ADD:
-                analysis.ptr_offset += current->value;
-                analysis.has_ptr_movement = true;
-                break;
-            case IR_PTR_SUB:
-                analysis.ptr_offset -= current->value;
-                analysis.has_ptr_movement = true;
-                break;
-            case IR_VAL_ADD: /* first value add, or adding to a non-zero offset */
-                if (!analysis.has_value_add || analysis.ptr_offset != 0) 
-                {
-                    analysis.value_multiply = current->value;
-                    analysis.has_value_add = true;
-                }
+            case IR_VAL_ADD:
+                if (!add_to_target(&analysis, current->offset, current->value))
+                    return analysis;
                 break;
             case IR_VAL_SUB:
-                analysis.decrement_count++;
+                if (!add_to_target(&analysis, current->offset, -current->value))
+                    return analysis;
                 break;
-            default: /* reset optimizability if unexpected */
-                analysis.is_direct_multiply = false;
+            case IR_NOP:
                 break;
+            default: /* pointer movement, I/O, clears, anything else: not balanced */
+                return analysis;
         }
-        current = current->next;
     }
 
-    analysis.is_direct_multiply = 
-        (abs(analysis.ptr_offset) <= 1) &&  /* mostly cancel out pointer movements */
-        analysis.has_ptr_movement &&        /* some pointer movement */
-        analysis.has_value_add &&           /* added a value */
-        analysis.decrement_count > 0 &&     /* decremented original cell */
-        analysis.value_multiply > 0;        /* positive multiplication value */
-
+    int step = wrap_factor(analysis.counter_step);
+    analysis.is_linear = (step == -1 || step == 1);
     return analysis;
 }
 
 void optimize_add_mul_loops(IRProgram* program) 
 {
-    if (!program || !program->first)
+    if (!program)
         return;
         
-    IROperation* op = program->first;
-    
-    while (op && op->next) 
+    IROperation* ops = program->ops;
+    for (size_t id = 0; id < program->loop_count; id++) 
     {
-        /* check if this is a loop start */
-        if (op->type == IR_LOOP_START) 
-        {
-            int loop_id = op->loop_id; /* save the loop ID */
-            MultiplyLoopAnalysis analysis = analyze_multiply_loop(op);
-            
-            if (analysis.is_direct_multiply) 
-            {
-                /* find the loop end with matching loop_id */
-                IROperation* loop_end = op->next;
-                int nesting = 1; /* track nesting level to handle nested loops */
-                while (loop_end && nesting > 0) 
-                {
-                    if (loop_end->type == IR_LOOP_START) 
-                    {
-                        nesting++;
-                    } 
-                    else if (loop_end->type == IR_LOOP_END) 
-                    {
-                        nesting--;
-                        if (nesting == 0 && loop_end->loop_id == loop_id) 
-                        {
-                            break; /* found the matching loop end */
-                        }
-                    }
-                    loop_end = loop_end->next;
-                }
-                
-                if (!loop_end) 
-                {
-                    op = op->next;
-                    continue; /* couldn't find matching loop end */
-                }
-                
-                /* save what comes after the loop */
-                IROperation* after_loop = loop_end->next;
-                
-                /* create new IR operations to replace the loop */
-                IROperation* add_mul = create_ir_op(IR_ADD_MUL, 
-                                                   analysis.value_multiply, 
-                                                   analysis.ptr_offset, 
-                                                   -1);
-                                                   
-                IROperation* set_zero = create_ir_op(IR_SET_ZERO, 
-                                                    0, 
-                                                    0, 
-                                                    -1);
-                
-                /* link them together */
-                add_mul->next = set_zero;
-                set_zero->next = after_loop;
-                
-                /* delete all operations between op and after_loop */
-                IROperation* current = op->next;
-                while (current != after_loop) 
-                {
-                    IROperation* to_free = current;
-                    current = current->next;
-                    free(to_free);
-                    program->count--;
-                }
-                
-                /* free the loop start operation and replace it with add_mul */
-                add_mul->next = set_zero;
-                
-                /* update the previous operation to point to our new add_mul */
-                if (op == program->first) 
-                {
-                    program->first = add_mul;
-                } 
-                else 
-                {
-                    IROperation* prev = program->first;
-                    while (prev && prev->next != op) 
-                    {
-                        prev = prev->next;
-                    }
-                    
-                    if (prev) 
-                    {
-                        prev->next = add_mul;
-                    }
-                }
-                
-                /* update the last pointer if needed */
-                if (loop_end == program->last) 
-                {
-                    program->last = set_zero;
-                }
-                
-                /* free the original loop start */
-                free(op);
-                program->count--; /* one less for the freed loop start */
-                
-                /* account for the two new operations */
-                program->count += 2;
-                
-                /* continue from the new set_zero operation */
-                op = set_zero;
-            } 
-            else 
-            {
-                op = op->next;
-            }
-        } 
-        else 
+        /* only innermost loops can be balanced */
+        IRLoop* loop = &program->loops[id];
+        if (!loop->live || loop->children > 0) 
+            continue;
+
+        LinearLoopAnalysis analysis = analyze_linear_loop(program, loop);
+        if (!analysis.is_linear) 
+            continue;
+
+        /* counting up from x takes 256 - x iterations, i.e. -x mod 256 */
+        int sign = wrap_factor(analysis.counter_step) == -1 ? 1 : -1;
+
+        /* the replacement is at most one op per body op plus the clear, so it always
+         * fits in the loop's own slots; whatever is left over becomes a tombstone */
+        size_t slot = loop->start;
+        for (int i = 0; i < analysis.target_count; i++)
         {
-            op = op->next;
+            int factor = wrap_factor(sign * analysis.targets[i].factor);
+            if (factor == 0)
+                continue;
+
+            IROperation* op = &ops[slot++];
+            if (op->type == IR_NOP) /* reviving a tombstone */
+                program->count++;
+            ir_set_op(op, IR_ADD_MUL, factor, analysis.targets[i].offset, -1);
         }
+
+        ir_set_op(&ops[slot++], IR_SET_ZERO, 0, 0, -1);
+        for (size_t k = slot; k <= loop->end; k++) 
+            ir_remove(program, k);
+        ir_remove_loop(program, id);
     }
+
+    ir_compact(program);
 }
 
 IRProgram* optimize3(IRProgram* program)
 {
     optimize_add_mul_loops(program);
+    optimize_known_values(program);
+    optimize_offsets(program);
     optimize_combinable(program);
     return program;
-}
\ No newline at end of file
+}
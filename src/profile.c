@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bfc.h"
+
+/* a profile is a header line, then one line per loop:
+ *     <position of the '[' among the program's commands> <times reached> <iterations>
+ * positions survive any -O level, so a profile taken at one level can be used at another */
+#define PROFILE_HEADER "bfc profile 1"
+#define PROFILE_HOT_SHARE 64  /* hot: at least 1/64 of all iterations... */
+#define PROFILE_HOT_MIN 1000  /* ...and at least this many */
+
+typedef struct
+{
+    size_t pos;
+    uint64_t reached;
+    uint64_t iterations;
+} ProfileRecord;
+
+int profile_write(const char* filename, const IRProgram* program, const uint64_t* counters)
+{
+    FILE* out = fopen(filename, "w");
+    if (!out)
+    {
+        perror("Error opening profile file");
+        return -1;
+    }
+
+    fprintf(out, PROFILE_HEADER "\n");
+    for (size_t id = 0; id < program->loop_count; id++)
+    {
+        const IRLoop* loop = &program->loops[id];
+        if (loop->live) /* never reached ones too; those are the cold loops */
+            fprintf(out, "%zu %llu %llu\n", loop->pos, (unsigned long long)counters[2 * id],
+                    (unsigned long long)counters[2 * id + 1]);
+    }
+
+    if (fclose(out) != 0)
+    {
+        perror("Error writing profile file");
+        return -1;
+    }
+    return 0;
+}
+
+static int compare_records(const void* a, const void* b)
+{
+    const ProfileRecord* x = a;
+    const ProfileRecord* y = b;
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+int profile_apply(const char* filename, IRProgram* program)
+{
+    FILE* in = fopen(filename, "r");
+    if (!in)
+    {
+        perror("Error opening profile file");
+        return -1;
+    }
+
+    char line[128];
+    if (!fgets(line, sizeof(line), in) || strncmp(line, PROFILE_HEADER, strlen(PROFILE_HEADER)) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a bfc profile\n", filename);
+        fclose(in);
+        return -1;
+    }
+
+    size_t count = 0;
+    size_t capacity = 256;
+    ProfileRecord* records = malloc(capacity * sizeof(ProfileRecord));
+    uint64_t total = 0;
+    while (records && fgets(line, sizeof(line), in))
+    {
+        unsigned long long pos, reached, iterations;
+        if (sscanf(line, "%llu %llu %llu", &pos, &reached, &iterations) != 3)
+        {
+            fprintf(stderr, "Error: malformed line in profile %s\n", filename);
+            free(records);
+            fclose(in);
+            return -1;
+        }
+
+        if (count == capacity)
+        {
+            capacity *= 2;
+            ProfileRecord* grown = realloc(records, capacity * sizeof(ProfileRecord));
+            if (!grown)
+            {
+                free(records);
+                records = NULL;
+                break;
+            }
+            records = grown;
+        }
+        records[count++] = (ProfileRecord){ (size_t)pos, reached, iterations };
+        total += iterations;
+    }
+    fclose(in);
+    if (!records)
+    {
+        perror("Memory allocation error");
+        return -1;
+    }
+
+    qsort(records, count, sizeof(ProfileRecord), compare_records);
+    for (size_t id = 0; id < program->loop_count; id++)
+    {
+        IRLoop* loop = &program->loops[id];
+        ProfileRecord key = { loop->pos, 0, 0 };
+        const ProfileRecord* record = count ? bsearch(&key, records, count, sizeof(ProfileRecord), compare_records) : NULL;
+        if (!loop->live || !record)
+            loop->heat = LOOP_UNPROFILED;
+        else if (record->reached == 0)
+            loop->heat = LOOP_COLD;
+        else if (record->iterations >= PROFILE_HOT_MIN && record->iterations >= total / PROFILE_HOT_SHARE)
+            loop->heat = LOOP_HOT;
+        else
+            loop->heat = LOOP_UNPROFILED;
+    }
+
+    free(records);
+    return 0;
+}
@@ -0,0 +1,272 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bfrt.h"
+#include "tier.h"
+
+/* the interpreter starts on the IR straight out of the parser, so nothing but parsing stands
+ * between the source and the first instruction. The IR then goes to the compiler thread, which
+ * runs the -O passes over it and compiles hot loops one at a time as the interpreter asks.
+ * The passes keep loop ids, so a loop the interpreter counts is found again in the optimized IR;
+ * loops the passes rewrote away, and loops that read input (the interpreter owns stdin's
+ * buffer), stay interpreted */
+struct Tier
+{
+    IRProgram* program;     /* the compiler thread's; optimized before anything is compiled */
+    int opt_level;
+    CodegenOptions options; /* for loops: return_ptr set */
+    size_t loop_count;      /* loops of the unoptimized IR */
+    TierLoop* loops;
+    JITContext** code;      /* installed code per loop, unmapped at the end */
+    BFIO* io;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int* queue;          /* loop ids waiting for the compiler; each is queued at most once */
+    size_t queue_head;
+    size_t queue_tail;
+    bool* requested;
+    bool stop;
+};
+
+TierLoop* tier_loops(Tier* tier)
+{
+    return tier->loops;
+}
+
+BFIO* tier_io(Tier* tier)
+{
+    return tier->io;
+}
+
+void tier_request(Tier* tier, int loop_id)
+{
+    pthread_mutex_lock(&tier->lock);
+    if (!tier->requested[loop_id])
+    {
+        tier->requested[loop_id] = true;
+        tier->queue[tier->queue_tail++] = loop_id;
+        pthread_cond_signal(&tier->wake);
+    }
+    pthread_mutex_unlock(&tier->lock);
+}
+
+static bool tier_stopping(Tier* tier)
+{
+    pthread_mutex_lock(&tier->lock);
+    bool stop = tier->stop;
+    pthread_mutex_unlock(&tier->lock);
+    return stop;
+}
+
+/* loop `loop_id` of the optimized IR as a program of its own, with the loops renumbered from 0
+ * and the whole string pool, so string offsets stay put. NULL if it cannot run on its own */
+static IRProgram* extract_loop(const IRProgram* program, int loop_id)
+{
+    if ((size_t)loop_id >= program->loop_count || !program->loops[loop_id].live)
+        return NULL;
+
+    const IRLoop* loop = &program->loops[loop_id];
+    for (size_t i = loop->start; i <= loop->end; i++)
+    {
+        if (program->ops[i].type == IR_INPUT || program->ops[i].type == IR_CONDITIONAL)
+            return NULL;
+    }
+
+    IRProgram* fragment = create_ir_program();
+    int* ids = malloc(program->loop_count * sizeof(int));
+    if (!fragment || !ids ||
+        (program->string_size > 0 && ir_add_string(fragment, program->strings, program->string_size) != 0))
+    {
+        free(ids);
+        free_ir_program(fragment);
+        return NULL;
+    }
+
+    int next_id = 0;
+    int parent = -1;
+    for (size_t i = loop->start; i <= loop->end; i++)
+    {
+        const IROperation* op = &program->ops[i];
+        switch (op->type)
+        {
+            case IR_NOP:
+                break;
+
+            case IR_LOOP_START:
+                ids[op->loop_id] = next_id;
+                if (ir_begin_loop(fragment, next_id, parent, program->loops[op->loop_id].pos) != 0)
+                {
+                    free(ids);
+                    free_ir_program(fragment);
+                    return NULL;
+                }
+                parent = next_id++;
+                break;
+
+            case IR_LOOP_END:
+                ir_end_loop(fragment, ids[op->loop_id]);
+                parent = fragment->loops[ids[op->loop_id]].parent;
+                break;
+
+            default:
+                add_ir_op(fragment, op->type, op->value, op->offset, op->loop_id);
+                fragment->ops[fragment->size - 1].src = op->src;
+                break;
+        }
+    }
+
+    free(ids);
+    return fragment;
+}
+
+static void compile_loop(Tier* tier, int loop_id)
+{
+    IRProgram* fragment = tier->program ? extract_loop(tier->program, loop_id) : NULL;
+    if (!fragment)
+        return;
+
+    CodeBuffer* compiled = codegen(fragment, &tier->options);
+    JITContext* ctx = compiled ? init_jit_code(compiled) : NULL;
+    free_code_buffer(compiled);
+    free_ir_program(fragment);
+    if (!ctx)
+        return;
+
+    tier->code[loop_id] = ctx;
+    atomic_store_explicit(&tier->loops[loop_id].entry, (TierEntry)jit_entry(ctx), memory_order_release);
+}
+
+static void* compiler_thread(void* arg)
+{
+    Tier* tier = arg;
+
+    if (tier->opt_level >= 1 && !tier_stopping(tier))
+        tier->program = optimize1(tier->program);
+    if (tier->opt_level >= 2 && !tier_stopping(tier))
+        tier->program = optimize2(tier->program);
+    if (tier->opt_level >= 3 && !tier_stopping(tier))
+        tier->program = optimize3(tier->program);
+
+    pthread_mutex_lock(&tier->lock);
+    for (;;)
+    {
+        while (!tier->stop && tier->queue_head == tier->queue_tail)
+            pthread_cond_wait(&tier->wake, &tier->lock);
+        if (tier->stop)
+            break;
+
+        int loop_id = tier->queue[tier->queue_head++];
+        pthread_mutex_unlock(&tier->lock);
+        compile_loop(tier, loop_id);
+        pthread_mutex_lock(&tier->lock);
+    }
+    pthread_mutex_unlock(&tier->lock);
+    return NULL;
+}
+
+static void free_tier(Tier* tier)
+{
+    if (!tier)
+        return;
+
+    if (tier->code)
+    {
+        for (size_t i = 0; i < tier->loop_count; i++)
+            free_jit(tier->code[i]);
+    }
+    free_ir_program(tier->program);
+    free(tier->loops);
+    free(tier->code);
+    free(tier->io);
+    free(tier->queue);
+    free(tier->requested);
+    free(tier);
+}
+
+/* takes `program` over, even when it fails */
+static Tier* start_tier(IRProgram* program, int opt_level, const CodegenOptions* options)
+{
+    Tier* tier = calloc(1, sizeof(Tier));
+    if (!tier)
+    {
+        perror("Memory allocation error");
+        free_ir_program(program);
+        return NULL;
+    }
+
+    size_t loop_count = program->loop_count + 1; /* never zero */
+    tier->program = program;
+    tier->opt_level = opt_level;
+    tier->options = *options;
+    tier->options.return_ptr = true;
+    tier->loop_count = loop_count;
+    tier->loops = calloc(loop_count, sizeof(TierLoop));
+    tier->code = calloc(loop_count, sizeof(JITContext*));
+    tier->io = calloc(1, sizeof(BFIO)); /* zeroed, like the JIT's */
+    tier->queue = malloc(loop_count * sizeof(int));
+    tier->requested = calloc(loop_count, sizeof(bool));
+    if (!tier->loops || !tier->code || !tier->io || !tier->queue || !tier->requested)
+    {
+        perror("Memory allocation error");
+        free_tier(tier);
+        return NULL;
+    }
+
+    pthread_mutex_init(&tier->lock, NULL);
+    pthread_cond_init(&tier->wake, NULL);
+    if (pthread_create(&tier->thread, NULL, compiler_thread, tier) != 0)
+    {
+        fprintf(stderr, "Failed to start the compiler thread\n");
+        pthread_cond_destroy(&tier->wake);
+        pthread_mutex_destroy(&tier->lock);
+        free_tier(tier);
+        return NULL;
+    }
+    return tier;
+}
+
+/* the compiler finishes whatever it is on, then everything goes */
+static void stop_tier(Tier* tier)
+{
+    pthread_mutex_lock(&tier->lock);
+    tier->stop = true;
+    pthread_cond_signal(&tier->wake);
+    pthread_mutex_unlock(&tier->lock);
+    pthread_join(tier->thread, NULL);
+
+    pthread_cond_destroy(&tier->wake);
+    pthread_mutex_destroy(&tier->lock);
+    free_tier(tier);
+}
+
+int tier_run(IRProgram* program, int opt_level, const CodegenOptions* options)
+{
+    if (!program || !options)
+    {
+        fprintf(stderr, "Invalid program to run\n");
+        free_ir_program(program);
+        return -1;
+    }
+
+    InterpCode* code = interp_compile_counted(program);
+    if (!code)
+    {
+        free_ir_program(program);
+        return -1;
+    }
+
+    Tier* tier = start_tier(program, opt_level, options);
+    if (!tier)
+    {
+        free_interp(code);
+        return -1;
+    }
+
+    int result = interp_exec_tiered(code, options->eof_mode, tier);
+    stop_tier(tier);
+    free_interp(code);
+    return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "bfc.h"
+
+/* tiered execution, between tier.c and the interpreter. The interpreter counts the entries and
+ * back-edges of every loop, and a loop that reaches TIER_THRESHOLD is queued for the compiler
+ * thread. Its code is published in the loop's entry slot, and the interpreter calls it the next
+ * time it stands at the loop head or takes the back-edge */
+#define TIER_THRESHOLD 1000
+
+typedef uint8_t* (*TierEntry)(uint8_t* ptr, BFIO* io); /* runs the loop from its head; the pointer after it */
+
+typedef struct
+{
+    _Atomic(TierEntry) entry; /* native code for the loop; NULL until it is installed */
+    uint32_t count;           /* entries plus back-edges; the interpreter's alone */
+} TierLoop;
+
+typedef struct Tier Tier;
+
+TierLoop* tier_loops(Tier* tier); /* indexed by the loop_id of the unoptimized IR */
+
+BFIO* tier_io(Tier* tier); /* what native loops get for I/O; they flush their output before returning */
+
+void tier_request(Tier* tier, int loop_id); /* queue a hot loop; returns at once */
+
+/* in interp.c */
+InterpCode* interp_compile_counted(const IRProgram* program); /* loop ops count toward tiering */
+
+int interp_exec_tiered(InterpCode* code, EofMode eof_mode, Tier* tier);
@@ -0,0 +1,734 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bfc.h"
+#include "x86_encoder.h"
+
+/* SysV: the tape pointer arrives in rdi and stays there, so every cell is a [rdi + disp] operand;
+ * x86 can add/sub/store bytes in memory directly, so there is no cell cache here */
+#define REG_TAPE_PTR X86_RDI
+#define REG_TEMP X86_RAX      /* source cell for IR_ADD_MUL; al is added into the target */
+#define REG_SAVED_TAPE X86_R8 /* tape pointer across syscalls; the kernel only clobbers rax, rcx and r11 */
+#define REG_OUT_PTR X86_R12   /* next free byte of BFIO.out; callee-saved like the two below */
+#define REG_OUT_END X86_R13   /* end of BFIO.out */
+#define REG_IO X86_R14        /* the BFIO block, which starts with the output buffer */
+#define REG_IN_PTR X86_R15    /* next unread byte of stdin */
+#define REG_IN_END X86_RBX    /* end of the bytes of stdin we have */
+
+/* what the last instruction left in ZF, so a loop test right after `-` needs no cmp */
+typedef struct
+{
+    bool valid;
+    int offset; /* cell the flags describe */
+} FlagState;
+
+static void emit_align(CodeBuffer* buf, int align)
+{
+    if (align > 1 && buf->size % (size_t)align != 0)
+        x86_nops(buf, (size_t)align - buf->size % (size_t)align);
+}
+
+/* set ZF from cell 0 unless the last arithmetic already did */
+static void emit_test_cell(CodeBuffer* buf, FlagState* flags)
+{
+    if (!flags->valid || flags->offset != 0)
+        x86_cmp_mem8_imm(buf, REG_TAPE_PTR, 0, 0);
+    flags->valid = false;
+}
+
+static void emit_io(CodeBuffer* buf, int is_output, int offset)
+{
+    x86_mov_r64_r64(buf, REG_SAVED_TAPE, REG_TAPE_PTR);
+    x86_lea_r64(buf, X86_RSI, REG_TAPE_PTR, offset); /* rsi = buffer (the addressed cell) */
+    x86_mov_r32_imm(buf, X86_RAX, is_output ? 1 : 0); /* Linux write / read */
+    x86_mov_r32_imm(buf, X86_RDI, is_output ? 1 : 0); /* stdout / stdin */
+    x86_mov_r32_imm(buf, X86_RDX, 1);                 /* length */
+    x86_syscall(buf);
+    x86_mov_r64_r64(buf, REG_TAPE_PTR, REG_SAVED_TAPE);
+}
+
+/* IR_OUTPUT_STR: one write of a constant string, straight from the read-only data behind the
+ * code, looping on partial writes. Returns the position of the lea displacement, which is patched
+ * once the data is placed */
+static size_t emit_output_str(CodeBuffer* buf, int length)
+{
+    x86_mov_r64_r64(buf, REG_SAVED_TAPE, REG_TAPE_PTR);
+    size_t lea = x86_lea_rip(buf, X86_RSI, 0);
+    x86_mov_r32_imm(buf, X86_RDX, (uint32_t)length);
+
+    size_t loop = buf->size;
+    x86_mov_r32_imm(buf, X86_RAX, 1); /* write */
+    x86_mov_r32_imm(buf, X86_RDI, 1); /* stdout */
+    x86_syscall(buf);
+    x86_test_r64_r64(buf, X86_RAX, X86_RAX);
+    size_t error_patch = x86_jcc_rel8(buf, X86_CC_LE, 0);
+    x86_add_r64_r64(buf, X86_RSI, X86_RAX);
+    x86_sub_r64_r64(buf, X86_RDX, X86_RAX);
+    x86_jcc_rel32(buf, X86_CC_NE, x86_rel32_to(buf, loop, 6));
+
+    x86_patch_rel8(buf, error_patch, buf->size);
+    x86_mov_r64_r64(buf, REG_TAPE_PTR, REG_SAVED_TAPE);
+    return lea;
+}
+
+/* load or store the `size` (8 or 16) cells at [base + disp] in an xmm register */
+static void emit_vec_load(CodeBuffer* buf, int xmm, int base, int32_t disp, int size)
+{
+    if (size == 16)
+        x86_movdqu_load(buf, xmm, base, disp);
+    else
+        x86_movq_load(buf, xmm, base, disp);
+}
+
+static void emit_vec_store(CodeBuffer* buf, int base, int32_t disp, int xmm, int size)
+{
+    if (size == 16)
+        x86_movdqu_store(buf, base, disp, xmm);
+    else
+        x86_movq_store(buf, base, disp, xmm);
+}
+
+/* IR_UPDATE_VEC: xmm0 = cells, xmm1 = add, xmm2 = keep, with rax pointing at the constants.
+ * Lanes that are all set skip the load of the cells and lanes that are all added skip the mask.
+ * Returns the position of the lea displacement, patched like the one of emit_output_str */
+static size_t emit_update_vec(CodeBuffer* buf, const IRProgram* program, IROperation* op)
+{
+    int size = op->value;
+    const uint8_t* keep = program->strings + op->src + size;
+    bool keep_all = true, keep_none = true;
+    for (int k = 0; k < size; k++)
+    {
+        keep_all &= keep[k] == 0xFF;
+        keep_none &= keep[k] == 0;
+    }
+
+    size_t lea = x86_lea_rip(buf, REG_TEMP, 0);
+    emit_vec_load(buf, 1, REG_TEMP, 0, size);
+    if (keep_none)
+    {
+        emit_vec_store(buf, REG_TAPE_PTR, op->offset, 1, size);
+        return lea;
+    }
+
+    emit_vec_load(buf, 0, REG_TAPE_PTR, op->offset, size);
+    if (!keep_all)
+    {
+        emit_vec_load(buf, 2, REG_TEMP, size, size);
+        x86_pand(buf, 0, 2);
+    }
+    x86_paddb(buf, 0, 1);
+    emit_vec_store(buf, REG_TAPE_PTR, op->offset, 0, size);
+    return lea;
+}
+
+/* out-of-line flush of BFIO.out, called when the buffer fills, before input and at exit; writes
+ * [REG_IO, REG_OUT_PTR) until done or write fails, then resets REG_OUT_PTR. Everything else it
+ * touches is restored, so callers need not care */
+static void emit_flush_helper(CodeBuffer* buf)
+{
+    static const int saved[] = { X86_RAX, X86_RCX, X86_RDX, X86_RSI, X86_RDI, X86_R11 };
+    const int saved_count = sizeof(saved) / sizeof(saved[0]);
+    for (int i = 0; i < saved_count; i++)
+        x86_push(buf, saved[i]);
+
+    x86_mov_r64_r64(buf, X86_RSI, REG_IO);
+    x86_mov_r64_r64(buf, X86_RDX, REG_OUT_PTR);
+    x86_sub_r64_r64(buf, X86_RDX, REG_IO);
+
+    size_t loop = buf->size;
+    x86_test_r64_r64(buf, X86_RDX, X86_RDX);
+    size_t empty_patch = x86_jcc_rel8(buf, X86_CC_E, 0);
+    x86_mov_r32_imm(buf, X86_RAX, 1); /* write */
+    x86_mov_r32_imm(buf, X86_RDI, 1); /* stdout */
+    x86_syscall(buf);
+    x86_test_r64_r64(buf, X86_RAX, X86_RAX); /* -errno, or 0 which would spin forever */
+    size_t error_patch = x86_jcc_rel8(buf, X86_CC_LE, 0);
+    x86_add_r64_r64(buf, X86_RSI, X86_RAX); /* partial write; go again with the rest */
+    x86_sub_r64_r64(buf, X86_RDX, X86_RAX);
+    x86_jmp_rel32(buf, x86_rel32_to(buf, loop, 5));
+
+    x86_patch_rel8(buf, empty_patch, buf->size);
+    x86_patch_rel8(buf, error_patch, buf->size);
+    x86_mov_r64_r64(buf, REG_OUT_PTR, REG_IO); /* empty again */
+    for (int i = saved_count - 1; i >= 0; i--)
+        x86_pop(buf, saved[i]);
+    x86_ret(buf);
+}
+
+/* --profile-generate: one more on counter `index` of BFIO.profile; clobbers rax and the flags */
+static void emit_count(CodeBuffer* buf, int index)
+{
+    x86_mov_r64_mem(buf, REG_TEMP, REG_IO, offsetof(BFIO, profile));
+    x86_inc_mem64(buf, REG_TEMP, index * 8);
+}
+
+static void emit_helper_call(CodeBuffer* buf, size_t helper)
+{
+    x86_call_rel32(buf, x86_rel32_to(buf, helper, 5));
+}
+
+/* '.' with buffered output: append the byte and only call out when the buffer is full */
+static void emit_buffered_output(CodeBuffer* buf, int offset, size_t flush)
+{
+    x86_movzx_r32_mem8(buf, REG_TEMP, REG_TAPE_PTR, offset);
+    x86_mov_mem8_r8(buf, REG_OUT_PTR, 0, REG_TEMP);
+    x86_add_r64_imm(buf, REG_OUT_PTR, 1);
+    x86_cmp_r64_r64(buf, REG_OUT_PTR, REG_OUT_END);
+    size_t skip = x86_jcc_rel8(buf, X86_CC_NE, 0);
+    emit_helper_call(buf, flush);
+    x86_patch_rel8(buf, skip, buf->size);
+}
+
+/* Linux syscall with up to three arguments; the caller sets r10/r8/r9 for more */
+static void emit_syscall3(CodeBuffer* buf, int nr, uint32_t arg0, uint32_t arg1, uint32_t arg2)
+{
+    x86_mov_r32_imm(buf, X86_RAX, nr);
+    x86_mov_r32_imm(buf, X86_RDI, arg0);
+    x86_mov_r32_imm(buf, X86_RSI, arg1);
+    x86_mov_r32_imm(buf, X86_RDX, arg2);
+    x86_syscall(buf);
+}
+
+/* out-of-line refill of [REG_IN_PTR, REG_IN_END), called when ',' finds it empty. The first call
+ * checks whether stdin is a regular file; if so the whole file is mapped and there is nothing more
+ * to refill until end of input. Otherwise each call reads up to BF_IN_BUFFER bytes. At end of input
+ * the range is pointed at BFIO.eof_cell, which holds the value the EOF mode asks for; for
+ * BF_EOF_UNCHANGED that is the cell's current value, passed in al. Only rax and the range change */
+static void emit_refill_helper(CodeBuffer* buf, EofMode eof_mode, size_t flush, bool has_flush)
+{
+    static const int saved[] = { X86_RCX, X86_RDX, X86_RSI, X86_RDI, X86_R8, X86_R9, X86_R10, X86_R11 };
+    const int saved_count = sizeof(saved) / sizeof(saved[0]);
+    for (int i = 0; i < saved_count; i++)
+        x86_push(buf, saved[i]);
+
+    if (eof_mode == BF_EOF_UNCHANGED)
+        x86_mov_mem8_r8(buf, REG_IO, offsetof(BFIO, eof_cell), X86_RAX);
+    if (has_flush) /* we may be about to block, so pending output (e.g. a prompt) goes first */
+        emit_helper_call(buf, flush);
+
+    /* first call only: is stdin a regular file with bytes left past the current offset? */
+    x86_cmp_mem8_imm(buf, REG_IO, offsetof(BFIO, in_probed), 0);
+    size_t probed = x86_jcc_rel32(buf, X86_CC_NE, 0);
+    x86_mov_mem8_imm(buf, REG_IO, offsetof(BFIO, in_probed), 1);
+
+    emit_syscall3(buf, 8, 0, 0, 1); /* lseek(0, 0, SEEK_CUR); fails for pipes and terminals */
+    x86_test_r64_r64(buf, X86_RAX, X86_RAX);
+    size_t no_seek = x86_jcc_rel32(buf, X86_CC_S, 0);
+    x86_mov_r64_r64(buf, REG_IN_PTR, X86_RAX); /* offset */
+
+    emit_syscall3(buf, 8, 0, 0, 2); /* lseek(0, 0, SEEK_END) */
+    x86_test_r64_r64(buf, X86_RAX, X86_RAX);
+    size_t no_end = x86_jcc_rel32(buf, X86_CC_S, 0);
+    x86_cmp_r64_r64(buf, X86_RAX, REG_IN_PTR);
+    size_t nothing_left = x86_jcc_rel32(buf, X86_CC_LE, 0); /* also catches size-0 files like those in /proc */
+    x86_mov_r64_r64(buf, REG_IN_END, X86_RAX); /* size */
+
+    x86_mov_r32_imm(buf, X86_R10, 2); /* mmap(NULL, size, PROT_READ, MAP_PRIVATE, 0, 0) */
+    x86_xor_r32_r32(buf, X86_R8, X86_R8);
+    x86_xor_r32_r32(buf, X86_R9, X86_R9);
+    x86_mov_r32_imm(buf, X86_RAX, 9);
+    x86_xor_r32_r32(buf, X86_RDI, X86_RDI);
+    x86_mov_r64_r64(buf, X86_RSI, REG_IN_END);
+    x86_mov_r32_imm(buf, X86_RDX, 1);
+    x86_syscall(buf);
+    x86_test_r64_r64(buf, X86_RAX, X86_RAX);
+    size_t no_map = x86_jcc_rel32(buf, X86_CC_S, 0);
+    x86_add_r64_r64(buf, REG_IN_PTR, X86_RAX); /* the mapping is the whole file */
+    x86_add_r64_r64(buf, REG_IN_END, X86_RAX);
+    size_t mapped = x86_jmp_rel32(buf, 0);
+
+    /* no mapping after all; put the file offset back where we found it and read instead */
+    x86_patch_rel32(buf, nothing_left, buf->size);
+    x86_patch_rel32(buf, no_map, buf->size);
+    x86_mov_r32_imm(buf, X86_RAX, 8);
+    x86_xor_r32_r32(buf, X86_RDI, X86_RDI);
+    x86_mov_r64_r64(buf, X86_RSI, REG_IN_PTR);
+    x86_xor_r32_r32(buf, X86_RDX, X86_RDX); /* SEEK_SET */
+    x86_syscall(buf);
+
+    x86_patch_rel32(buf, probed, buf->size);
+    x86_patch_rel32(buf, no_seek, buf->size);
+    x86_patch_rel32(buf, no_end, buf->size);
+    x86_xor_r32_r32(buf, X86_RAX, X86_RAX); /* read(0, io->in, BF_IN_BUFFER) */
+    x86_xor_r32_r32(buf, X86_RDI, X86_RDI);
+    x86_lea_r64(buf, X86_RSI, REG_IO, offsetof(BFIO, in));
+    x86_mov_r32_imm(buf, X86_RDX, BF_IN_BUFFER);
+    x86_syscall(buf);
+    x86_test_r64_r64(buf, X86_RAX, X86_RAX);
+    size_t eof = x86_jcc_rel32(buf, X86_CC_LE, 0);
+    x86_lea_r64(buf, REG_IN_PTR, REG_IO, offsetof(BFIO, in));
+    x86_lea_r64(buf, REG_IN_END, REG_IO, offsetof(BFIO, in));
+    x86_add_r64_r64(buf, REG_IN_END, X86_RAX);
+    size_t filled = x86_jmp_rel32(buf, 0);
+
+    x86_patch_rel32(buf, eof, buf->size);
+    if (eof_mode != BF_EOF_UNCHANGED)
+        x86_mov_mem8_imm(buf, REG_IO, offsetof(BFIO, eof_cell), eof_mode == BF_EOF_ZERO ? 0 : 0xFF);
+    x86_lea_r64(buf, REG_IN_PTR, REG_IO, offsetof(BFIO, eof_cell));
+    x86_lea_r64(buf, REG_IN_END, REG_IO, offsetof(BFIO, eof_cell) + 1);
+
+    x86_patch_rel32(buf, mapped, buf->size);
+    x86_patch_rel32(buf, filled, buf->size);
+    for (int i = saved_count - 1; i >= 0; i--)
+        x86_pop(buf, saved[i]);
+    x86_ret(buf);
+}
+
+/* hosted_io: the helpers hand the ranges to the C functions in BFIO.host instead of making
+ * syscalls. A C call may clobber every caller-saved register, so all of them are kept; nine
+ * pushes on top of the return address leave rsp 16-byte aligned for the call */
+static const int hosted_saved[] = { X86_RAX, X86_RCX, X86_RDX, X86_RSI, X86_RDI, X86_R8, X86_R9, X86_R10, X86_R11 };
+#define HOSTED_SAVED_COUNT (int)(sizeof(hosted_saved) / sizeof(hosted_saved[0]))
+
+static void emit_host_call(CodeBuffer* buf, size_t callback)
+{
+    x86_mov_mem64_r64(buf, REG_IO, offsetof(BFIO, host.out_ptr), REG_OUT_PTR);
+    x86_mov_r64_r64(buf, X86_RDI, REG_IO);
+    x86_call_mem64(buf, REG_IO, (int32_t)callback);
+    x86_mov_r64_mem(buf, REG_OUT_PTR, REG_IO, offsetof(BFIO, host.out_ptr));
+    x86_mov_r64_mem(buf, REG_OUT_END, REG_IO, offsetof(BFIO, host.out_end));
+}
+
+static void emit_hosted_flush_helper(CodeBuffer* buf)
+{
+    for (int i = 0; i < HOSTED_SAVED_COUNT; i++)
+        x86_push(buf, hosted_saved[i]);
+    emit_host_call(buf, offsetof(BFIO, host.flush));
+    for (int i = HOSTED_SAVED_COUNT - 1; i >= 0; i--)
+        x86_pop(buf, hosted_saved[i]);
+    x86_ret(buf);
+}
+
+/* like emit_refill_helper, the old cell value comes in al for BF_EOF_UNCHANGED; the host flushes
+ * pending output itself before it waits for input */
+static void emit_hosted_refill_helper(CodeBuffer* buf, EofMode eof_mode)
+{
+    for (int i = 0; i < HOSTED_SAVED_COUNT; i++)
+        x86_push(buf, hosted_saved[i]);
+    if (eof_mode == BF_EOF_UNCHANGED)
+        x86_mov_mem8_r8(buf, REG_IO, offsetof(BFIO, eof_cell), X86_RAX);
+    emit_host_call(buf, offsetof(BFIO, host.refill));
+    x86_mov_r64_mem(buf, REG_IN_PTR, REG_IO, offsetof(BFIO, host.in_ptr));
+    x86_mov_r64_mem(buf, REG_IN_END, REG_IO, offsetof(BFIO, host.in_end));
+    for (int i = HOSTED_SAVED_COUNT - 1; i >= 0; i--)
+        x86_pop(buf, hosted_saved[i]);
+    x86_ret(buf);
+}
+
+/* IR_OUTPUT_STR with hosted_io: the string is copied into the output range like so many '.'s,
+ * which leave it with room for one more. Returns the position of the lea displacement, as
+ * emit_output_str does */
+static size_t emit_hosted_output_str(CodeBuffer* buf, int length, size_t flush)
+{
+    size_t lea = x86_lea_rip(buf, X86_RSI, 0);
+    x86_mov_r32_imm(buf, X86_RDX, (uint32_t)length);
+
+    size_t loop = buf->size;
+    x86_movzx_r32_mem8(buf, REG_TEMP, X86_RSI, 0);
+    x86_mov_mem8_r8(buf, REG_OUT_PTR, 0, REG_TEMP);
+    x86_add_r64_imm(buf, REG_OUT_PTR, 1);
+    x86_cmp_r64_r64(buf, REG_OUT_PTR, REG_OUT_END);
+    size_t room = x86_jcc_rel8(buf, X86_CC_NE, 0);
+    emit_helper_call(buf, flush);
+    x86_patch_rel8(buf, room, buf->size);
+    x86_add_r64_imm(buf, X86_RSI, 1);
+    x86_add_r64_imm(buf, X86_RDX, -1);
+    x86_jcc_rel32(buf, X86_CC_NE, x86_rel32_to(buf, loop, 6));
+    return lea;
+}
+
+/* ',' with buffered input: a byte load from the input cursor, and a call out only when it runs dry */
+static void emit_buffered_input(CodeBuffer* buf, int offset, EofMode eof_mode, size_t refill)
+{
+    x86_cmp_r64_r64(buf, REG_IN_PTR, REG_IN_END);
+    size_t skip = x86_jcc_rel8(buf, X86_CC_NE, 0);
+    if (eof_mode == BF_EOF_UNCHANGED) /* the refill helper hands the old value back at EOF */
+        x86_movzx_r32_mem8(buf, REG_TEMP, REG_TAPE_PTR, offset);
+    emit_helper_call(buf, refill);
+    x86_patch_rel8(buf, skip, buf->size);
+    x86_movzx_r32_mem8(buf, REG_TEMP, REG_IN_PTR, 0);
+    x86_add_r64_imm(buf, REG_IN_PTR, 1);
+    x86_mov_mem8_r8(buf, REG_TAPE_PTR, offset, REG_TEMP);
+}
+
+/* strides the vector scan handles; they all divide 16, so every step of 16 cells lines up with the stride */
+static bool scan_vectorizable(int step)
+{
+    return step == 1 || step == 2 || step == 4 || step == 8 ||
+           step == -1 || step == -2 || step == -4 || step == -8;
+}
+
+/* cells tested one at a time before the vector loop. Most scans stop within a few cells, and a
+ * 16-byte load of cells that were just stored one byte at a time waits for the stores to retire */
+#define SCAN_PROBES 4
+
+/* SSE2 scan: 16 cells per step. pcmpeqb against zero and pmovmskb give a bit per zero cell, the
+ * cells the stride does not visit are masked out and bsf (forward) or bsr (backward) finds where
+ * the scan stops. Backward steps load the 16 cells ending at the pointer. Loads reach up to 15
+ * cells past where the scan stops, which the BF_TAPE_PAD zeroes on either side of the tape cover.
+ * `tested` says the current cell is already known not to stop the scan */
+static void emit_vector_scan(CodeBuffer* buf, IROperation* op, int align, bool tested)
+{
+    bool until_zero = op->type == IR_SCAN_ZERO;
+    int step = op->value;
+    bool forward = step > 0;
+    int stride = forward ? step : -step;
+
+    /* bits of the cells at 0, stride, 2 * stride, ...; from the top for backward scans */
+    uint32_t lanes = stride == 1 ? 0xFFFF : stride == 2 ? 0x5555 : stride == 4 ? 0x1111 : 0x0101;
+    if (!forward)
+        lanes <<= stride - 1;
+
+    size_t probes[SCAN_PROBES];
+    for (int i = 0; i < SCAN_PROBES; i++)
+    {
+        if (tested || i > 0)
+            x86_add_r64_imm(buf, REG_TAPE_PTR, step);
+        x86_cmp_mem8_imm(buf, REG_TAPE_PTR, 0, 0);
+        probes[i] = x86_jcc_rel32(buf, until_zero ? X86_CC_E : X86_CC_NE, 0);
+    }
+
+    x86_pxor(buf, 1, 1);
+    x86_add_r64_imm(buf, REG_TAPE_PTR, forward ? -16 : 16); /* the loop steps first */
+    emit_align(buf, align);
+    size_t head = buf->size;
+    x86_add_r64_imm(buf, REG_TAPE_PTR, forward ? 16 : -16);
+    x86_movdqu_load(buf, 0, REG_TAPE_PTR, forward ? 0 : -15);
+    x86_pcmpeqb(buf, 0, 1);
+    x86_pmovmskb(buf, REG_TEMP, 0);
+    x86_and_r32_imm(buf, REG_TEMP, lanes);
+    if (!until_zero) /* the cells that are not zero */
+        x86_xor_r32_imm(buf, REG_TEMP, lanes);
+    x86_jcc_rel8(buf, X86_CC_E, (int8_t)((int64_t)head - (int64_t)(buf->size + 2)));
+
+    if (forward)
+    {
+        x86_bsf_r32(buf, REG_TEMP, REG_TEMP);
+        x86_add_r64_r64(buf, REG_TAPE_PTR, REG_TEMP);
+    }
+    else
+    {
+        x86_bsr_r32(buf, REG_TEMP, REG_TEMP);
+        x86_add_r64_r64(buf, REG_TAPE_PTR, REG_TEMP);
+        x86_add_r64_imm(buf, REG_TAPE_PTR, -15);
+    }
+    for (int i = 0; i < SCAN_PROBES; i++)
+        x86_patch_rel32(buf, probes[i], buf->size);
+}
+
+/* cell[rdi + op->offset] += cell[rdi + op->src] * op->value; factors are taken mod 256 as signed */
+static void emit_add_mul(CodeBuffer* buf, IROperation* op)
+{
+    int factor = op->value & 0xFF;
+    if (factor >= 128)
+        factor -= 256;
+    if (factor == 0)
+        return;
+
+    int magnitude = factor < 0 ? -factor : factor;
+    x86_movzx_r32_mem8(buf, REG_TEMP, REG_TAPE_PTR, op->src);
+    if ((magnitude & (magnitude - 1)) == 0)
+    {
+        if (magnitude > 1)
+            x86_shl_r32_imm(buf, REG_TEMP, (uint8_t)__builtin_ctz(magnitude));
+    }
+    else
+    {
+        x86_imul_r32_imm(buf, REG_TEMP, REG_TEMP, magnitude);
+    }
+
+    if (factor > 0)
+        x86_add_mem8_r8(buf, REG_TAPE_PTR, op->offset, REG_TEMP);
+    else
+        x86_sub_mem8_r8(buf, REG_TAPE_PTR, op->offset, REG_TEMP);
+}
+
+CodeBuffer* codegen_x86_64(IRProgram* program, const CodegenOptions* options)
+{
+    if (!program)
+    {
+        fprintf(stderr, "Empty program to compile\n");
+        return NULL;
+    }
+
+    CodeBuffer* buf = create_code_buffer(16384);
+    if (!buf)
+    {
+        fprintf(stderr, "Failed to create code buffer\n");
+        return NULL;
+    }
+
+    /* open loops never share a depth so one slot per nesting level is enough; rel32 reaches
+     * +/-2 GB, so unlike arm64 there is nothing to relax */
+    size_t open_slots = (size_t)program->max_depth + 1;
+    size_t* loop_heads = malloc(open_slots * sizeof(size_t));
+    size_t* loop_exit_patches = malloc(open_slots * sizeof(size_t));
+
+    size_t string_count = 0; /* ops that read the string pool */
+    for (size_t i = 0; i < program->size; i++)
+        string_count += program->ops[i].type == IR_OUTPUT_STR || program->ops[i].type == IR_UPDATE_VEC;
+    size_t* string_leas = malloc((string_count + 1) * sizeof(size_t)); /* lea displacements, in program order */
+    size_t string_index = 0;
+
+    if (!loop_heads || !loop_exit_patches || !string_leas)
+    {
+        fprintf(stderr, "Memory allocation error\n");
+        free_code_buffer(buf);
+        free(loop_heads);
+        free(loop_exit_patches);
+        free(string_leas);
+        return NULL;
+    }
+
+    /* buffered I/O: the BFIO block arrives in rsi. The runtime helpers go first, behind a jump,
+     * so every call to one has a known target */
+    static const int runtime_regs[] = { REG_OUT_PTR, REG_OUT_END, REG_IO, REG_IN_PTR, REG_IN_END };
+    const int runtime_reg_count = sizeof(runtime_regs) / sizeof(runtime_regs[0]);
+    bool buffered_io = options->buffered_output || options->buffered_input || options->profile; /* counters are found through REG_IO */
+    size_t flush = 0;
+    size_t refill = 0;
+    if (buffered_io)
+    {
+        size_t skip = x86_jmp_rel32(buf, 0);
+        if (options->hosted_io)
+        {
+            flush = buf->size;
+            emit_hosted_flush_helper(buf);
+            refill = buf->size;
+            emit_hosted_refill_helper(buf, options->eof_mode);
+        }
+        else
+        {
+            if (options->buffered_output)
+            {
+                flush = buf->size;
+                emit_flush_helper(buf);
+            }
+            if (options->buffered_input)
+            {
+                refill = buf->size;
+                emit_refill_helper(buf, options->eof_mode, flush, options->buffered_output);
+            }
+        }
+        x86_patch_rel32(buf, skip, buf->size);
+
+        for (int i = 0; i < runtime_reg_count; i++)
+            x86_push(buf, runtime_regs[i]);
+        x86_mov_r64_r64(buf, REG_IO, X86_RSI);
+        if (options->hosted_io) /* the host has set both ranges up */
+        {
+            x86_mov_r64_mem(buf, REG_OUT_PTR, X86_RSI, offsetof(BFIO, host.out_ptr));
+            x86_mov_r64_mem(buf, REG_OUT_END, X86_RSI, offsetof(BFIO, host.out_end));
+            x86_mov_r64_mem(buf, REG_IN_PTR, X86_RSI, offsetof(BFIO, host.in_ptr));
+            x86_mov_r64_mem(buf, REG_IN_END, X86_RSI, offsetof(BFIO, host.in_end));
+        }
+        else
+        {
+            x86_mov_r64_r64(buf, REG_OUT_PTR, X86_RSI);
+            x86_lea_r64(buf, REG_OUT_END, X86_RSI, BF_OUT_BUFFER);
+            x86_xor_r32_r32(buf, REG_IN_PTR, REG_IN_PTR); /* empty, so the first ',' refills */
+            x86_xor_r32_r32(buf, REG_IN_END, REG_IN_END);
+        }
+    }
+
+    FlagState flags = { false, 0 };
+    int loop_id = -1; /* innermost loop around the op */
+    for (size_t i = 0; i < program->size; i++)
+    {
+        IROperation* op = &program->ops[i];
+        bool sets_flags = false;
+        int align = loop_align_for(program, loop_id, options); /* for scans */
+        switch (op->type)
+        {
+            case IR_PTR_ADD:
+                x86_add_r64_imm(buf, REG_TAPE_PTR, op->value);
+                break;
+
+            case IR_PTR_SUB:
+                x86_add_r64_imm(buf, REG_TAPE_PTR, -op->value);
+                break;
+
+            case IR_VAL_ADD:
+                x86_add_mem8_imm(buf, REG_TAPE_PTR, op->offset, op->value & 0xFF); /* cells wrap at 256 */
+                sets_flags = true;
+                break;
+
+            case IR_VAL_SUB:
+                x86_sub_mem8_imm(buf, REG_TAPE_PTR, op->offset, op->value & 0xFF);
+                sets_flags = true;
+                break;
+
+            case IR_OUTPUT:
+                if (options->buffered_output)
+                    emit_buffered_output(buf, op->offset, flush);
+                else
+                    emit_io(buf, 1, op->offset);
+                break;
+
+            case IR_OUTPUT_STR:
+                if (options->hosted_io)
+                {
+                    string_leas[string_index++] = emit_hosted_output_str(buf, op->value, flush);
+                    break;
+                }
+                if (options->buffered_output) /* whatever is buffered goes out first */
+                    emit_helper_call(buf, flush);
+                string_leas[string_index++] = emit_output_str(buf, op->value);
+                break;
+
+            case IR_UPDATE_VEC:
+                string_leas[string_index++] = emit_update_vec(buf, program, op);
+                break;
+
+            case IR_INPUT:
+                if (options->buffered_input)
+                {
+                    emit_buffered_input(buf, op->offset, options->eof_mode, refill);
+                    break;
+                }
+                if (options->buffered_output) /* prompts must be out before we block on a read */
+                    emit_helper_call(buf, flush);
+                emit_io(buf, 0, op->offset);
+                break;
+
+            case IR_LOOP_START:
+            {
+                int depth = program->loops[op->loop_id].depth;
+                loop_id = op->loop_id;
+                align = loop_align_for(program, loop_id, options);
+                if (options->profile)
+                {
+                    emit_count(buf, 2 * loop_id); /* reached */
+                    flags.valid = false;
+                }
+                if (options->rotate_loops)
+                {
+                    /* guard, then the body; the test lives at the bottom */
+                    emit_test_cell(buf, &flags);
+                    loop_exit_patches[depth] = x86_jcc_rel32(buf, X86_CC_E, 0);
+                    emit_align(buf, align);
+                    loop_heads[depth] = buf->size;
+                    if (options->profile)
+                        emit_count(buf, 2 * loop_id + 1); /* one more iteration */
+                    break;
+                }
+
+                emit_align(buf, align);
+                loop_heads[depth] = buf->size;
+                flags.valid = false; /* the back-edge lands here as well */
+                emit_test_cell(buf, &flags);
+                loop_exit_patches[depth] = x86_jcc_rel32(buf, X86_CC_E, 0);
+                if (options->profile)
+                    emit_count(buf, 2 * loop_id + 1);
+                break;
+            }
+
+            case IR_LOOP_END:
+            {
+                int depth = program->loops[op->loop_id].depth;
+                loop_id = program->loops[op->loop_id].parent;
+                emit_test_cell(buf, &flags);
+                x86_jcc_rel32(buf, X86_CC_NE, x86_rel32_to(buf, loop_heads[depth], 6));
+                x86_patch_rel32(buf, loop_exit_patches[depth], buf->size);
+                break;
+            }
+
+            case IR_SET_ZERO:
+                x86_mov_mem8_imm(buf, REG_TAPE_PTR, op->offset, 0);
+                break;
+
+            case IR_SET_VAL:
+                x86_mov_mem8_imm(buf, REG_TAPE_PTR, op->offset, op->value & 0xFF);
+                break;
+
+            case IR_ADD_MUL: /* cell[ptr+offset] += cell[ptr+src] * factor */
+                emit_add_mul(buf, op);
+                break;
+
+            case IR_MOVE_VAL: /* same, then cell[ptr+src] = 0 */
+                emit_add_mul(buf, op);
+                x86_mov_mem8_imm(buf, REG_TAPE_PTR, op->src, 0);
+                break;
+
+            case IR_SCAN_ZERO: /* while (*ptr) ptr += step */
+            case IR_SCAN_NONZERO: /* while (!*ptr) ptr += step */
+            {
+                int exit_cc = op->type == IR_SCAN_ZERO ? X86_CC_E : X86_CC_NE;
+                int stay_cc = op->type == IR_SCAN_ZERO ? X86_CC_NE : X86_CC_E;
+                if (options->vector_scans && !loop_is_cold(program, loop_id) && scan_vectorizable(op->value))
+                {
+                    size_t guard = 0;
+                    if (options->rotate_loops) /* runs of length 0 skip the vector setup */
+                    {
+                        emit_test_cell(buf, &flags);
+                        guard = x86_jcc_rel32(buf, exit_cc, 0);
+                    }
+                    emit_vector_scan(buf, op, align, options->rotate_loops);
+                    if (options->rotate_loops)
+                        x86_patch_rel32(buf, guard, buf->size);
+                    break;
+                }
+
+                if (options->rotate_loops)
+                {
+                    emit_test_cell(buf, &flags);
+                    size_t guard = x86_jcc_rel32(buf, exit_cc, 0);
+                    emit_align(buf, align);
+                    size_t head = buf->size;
+                    x86_add_r64_imm(buf, REG_TAPE_PTR, op->value);
+                    x86_cmp_mem8_imm(buf, REG_TAPE_PTR, 0, 0);
+                    x86_jcc_rel32(buf, stay_cc, x86_rel32_to(buf, head, 6));
+                    x86_patch_rel32(buf, guard, buf->size);
+                    break;
+                }
+
+                emit_align(buf, align);
+                size_t head = buf->size;
+                x86_cmp_mem8_imm(buf, REG_TAPE_PTR, 0, 0);
+                size_t exit_patch = x86_jcc_rel32(buf, exit_cc, 0);
+                x86_add_r64_imm(buf, REG_TAPE_PTR, op->value);
+                x86_jmp_rel32(buf, x86_rel32_to(buf, head, 5));
+                x86_patch_rel32(buf, exit_patch, buf->size);
+                break;
+            }
+
+            case IR_CONDITIONAL:
+                fprintf(stderr, "Warning: IR_CONDITIONAL is yet to be implemented\n");
+                break;
+
+            case IR_NOP:
+                continue; /* emits nothing, so the flags survive */
+        }
+
+        flags.valid = sets_flags;
+        flags.offset = op->offset;
+    }
+
+    if (options->buffered_output)
+        emit_helper_call(buf, flush);
+    if (buffered_io)
+    {
+        for (int i = runtime_reg_count - 1; i >= 0; i--)
+            x86_pop(buf, runtime_regs[i]);
+    }
+    if (options->return_ptr)
+        x86_mov_r64_r64(buf, X86_RAX, REG_TAPE_PTR);
+    else
+        x86_xor_r32_r32(buf, X86_RAX, X86_RAX); /* return 0 */
+    x86_ret(buf);
+    finish_code_buffer(buf);
+
+    /* the string pool goes behind the code as read-only data */
+    emit_bytes(buf, program->strings, program->string_size);
+    string_index = 0;
+    for (size_t i = 0; i < program->size; i++)
+    {
+        if (program->ops[i].type == IR_OUTPUT_STR || program->ops[i].type == IR_UPDATE_VEC)
+            x86_patch_rel32(buf, string_leas[string_index++], buf->text_size + program->ops[i].src);
+    }
+
+    free(loop_heads);
+    free(loop_exit_patches);
+    free(string_leas);
+    return buf;
+}
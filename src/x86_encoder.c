@@ -0,0 +1,437 @@
+#include "x86_encoder.h"
+
+/* REX prefix; only emitted when it carries something */
+static void emit_rex(CodeBuffer* buf, int w, int reg, int base)
+{
+    uint8_t rex = 0x40 |
+                  (w << 3) |              /* 64-bit operand size */
+                  (((reg >> 3) & 1) << 2) | /* REX.R extends ModRM.reg */
+                  ((base >> 3) & 1);      /* REX.B extends ModRM.rm */
+    if (rex != 0x40)
+        emit_byte(buf, rex);
+}
+
+/* ModRM (+ SIB) + displacement for [base + disp]; picks the shortest displacement */
+static void emit_mem(CodeBuffer* buf, int reg, int base, int32_t disp)
+{
+    int rm = base & 7;
+    int mod;
+    if (disp == 0 && rm != X86_RBP) /* [rbp]/[r13] with mod 0 means rip-relative, so they need a disp8 */
+        mod = 0;
+    else if (disp >= -128 && disp <= 127)
+        mod = 1;
+    else
+        mod = 2;
+
+    emit_byte(buf, (mod << 6) | ((reg & 7) << 3) | rm);
+    if (rm == X86_RSP) /* [rsp]/[r12] always go through a SIB byte */
+        emit_byte(buf, 0x24);
+
+    if (mod == 1)
+        emit_byte(buf, (uint8_t)disp);
+    else if (mod == 2)
+        emit_u32(buf, (uint32_t)disp);
+}
+
+/* register-direct ModRM */
+static void emit_modrm_reg(CodeBuffer* buf, int reg, int rm)
+{
+    emit_byte(buf, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* group 1 byte op on memory: 80 /ext ib */
+static void emit_group1_mem8(CodeBuffer* buf, int ext, int base, int32_t disp, uint8_t imm)
+{
+    emit_rex(buf, 0, 0, base);
+    emit_byte(buf, 0x80);
+    emit_mem(buf, ext, base, disp);
+    emit_byte(buf, imm);
+}
+
+void x86_add_mem8_imm(CodeBuffer* buf, int base, int32_t disp, uint8_t imm)
+{
+    emit_group1_mem8(buf, 0, base, disp, imm); /* /0 = add */
+}
+
+void x86_sub_mem8_imm(CodeBuffer* buf, int base, int32_t disp, uint8_t imm)
+{
+    emit_group1_mem8(buf, 5, base, disp, imm); /* /5 = sub */
+}
+
+void x86_cmp_mem8_imm(CodeBuffer* buf, int base, int32_t disp, uint8_t imm)
+{
+    emit_group1_mem8(buf, 7, base, disp, imm); /* /7 = cmp */
+}
+
+void x86_mov_mem8_imm(CodeBuffer* buf, int base, int32_t disp, uint8_t imm)
+{
+    emit_rex(buf, 0, 0, base);
+    emit_byte(buf, 0xC6); /* mov r/m8, imm8 */
+    emit_mem(buf, 0, base, disp);
+    emit_byte(buf, imm);
+}
+
+void x86_add_mem8_r8(CodeBuffer* buf, int base, int32_t disp, int reg)
+{
+    emit_rex(buf, 0, reg, base);
+    emit_byte(buf, 0x00); /* add r/m8, r8 */
+    emit_mem(buf, reg, base, disp);
+}
+
+void x86_sub_mem8_r8(CodeBuffer* buf, int base, int32_t disp, int reg)
+{
+    emit_rex(buf, 0, reg, base);
+    emit_byte(buf, 0x28); /* sub r/m8, r8 */
+    emit_mem(buf, reg, base, disp);
+}
+
+void x86_movzx_r32_mem8(CodeBuffer* buf, int reg, int base, int32_t disp)
+{
+    emit_rex(buf, 0, reg, base);
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, 0xB6); /* movzx r32, r/m8 */
+    emit_mem(buf, reg, base, disp);
+}
+
+void x86_imul_r32_imm(CodeBuffer* buf, int dst, int src, int32_t imm)
+{
+    emit_rex(buf, 0, dst, src);
+    if (imm >= -128 && imm <= 127)
+    {
+        emit_byte(buf, 0x6B); /* imul r32, r/m32, imm8 */
+        emit_modrm_reg(buf, dst, src);
+        emit_byte(buf, (uint8_t)imm);
+    }
+    else
+    {
+        emit_byte(buf, 0x69); /* imul r32, r/m32, imm32 */
+        emit_modrm_reg(buf, dst, src);
+        emit_u32(buf, (uint32_t)imm);
+    }
+}
+
+void x86_shl_r32_imm(CodeBuffer* buf, int reg, uint8_t shift)
+{
+    emit_rex(buf, 0, 0, reg);
+    emit_byte(buf, 0xC1); /* group 2 r/m32, imm8 */
+    emit_modrm_reg(buf, 4, reg); /* /4 = shl */
+    emit_byte(buf, shift);
+}
+
+void x86_add_r64_imm(CodeBuffer* buf, int reg, int32_t imm)
+{
+    int ext = 0; /* /0 = add */
+    if (imm < 0 && imm != INT32_MIN)
+    {
+        ext = 5; /* /5 = sub, so the disassembly reads naturally */
+        imm = -imm;
+    }
+
+    emit_rex(buf, 1, 0, reg);
+    if (imm >= -128 && imm <= 127)
+    {
+        emit_byte(buf, 0x83); /* group 1 r/m64, imm8 */
+        emit_modrm_reg(buf, ext, reg);
+        emit_byte(buf, (uint8_t)imm);
+    }
+    else
+    {
+        emit_byte(buf, 0x81); /* group 1 r/m64, imm32 */
+        emit_modrm_reg(buf, ext, reg);
+        emit_u32(buf, (uint32_t)imm);
+    }
+}
+
+void x86_lea_r64(CodeBuffer* buf, int dst, int base, int32_t disp)
+{
+    emit_rex(buf, 1, dst, base);
+    emit_byte(buf, 0x8D);
+    emit_mem(buf, dst, base, disp);
+}
+
+void x86_mov_r64_mem(CodeBuffer* buf, int dst, int base, int32_t disp)
+{
+    emit_rex(buf, 1, dst, base);
+    emit_byte(buf, 0x8B); /* mov r64, r/m64 */
+    emit_mem(buf, dst, base, disp);
+}
+
+void x86_mov_mem64_r64(CodeBuffer* buf, int base, int32_t disp, int src)
+{
+    emit_rex(buf, 1, src, base);
+    emit_byte(buf, 0x89); /* mov r/m64, r64 */
+    emit_mem(buf, src, base, disp);
+}
+
+void x86_call_mem64(CodeBuffer* buf, int base, int32_t disp)
+{
+    emit_rex(buf, 0, 0, base); /* 64-bit operand by default */
+    emit_byte(buf, 0xFF); /* FF /2 = call r/m64 */
+    emit_mem(buf, 2, base, disp);
+}
+
+void x86_inc_mem64(CodeBuffer* buf, int base, int32_t disp)
+{
+    emit_rex(buf, 1, 0, base);
+    emit_byte(buf, 0xFF); /* FF /0 = inc r/m64 */
+    emit_mem(buf, 0, base, disp);
+}
+
+size_t x86_lea_rip(CodeBuffer* buf, int dst, int32_t disp)
+{
+    emit_rex(buf, 1, dst, 0);
+    emit_byte(buf, 0x8D);
+    emit_byte(buf, ((dst & 7) << 3) | 5); /* mod 0, rm 101: rip-relative */
+    size_t pos = buf->size;
+    emit_u32(buf, (uint32_t)disp);
+    return pos;
+}
+
+void x86_mov_r64_r64(CodeBuffer* buf, int dst, int src)
+{
+    emit_rex(buf, 1, src, dst);
+    emit_byte(buf, 0x89); /* mov r/m64, r64 */
+    emit_modrm_reg(buf, src, dst);
+}
+
+void x86_mov_r32_imm(CodeBuffer* buf, int reg, uint32_t imm)
+{
+    emit_rex(buf, 0, 0, reg);
+    emit_byte(buf, 0xB8 + (reg & 7)); /* mov r32, imm32 */
+    emit_u32(buf, imm);
+}
+
+void x86_xor_r32_r32(CodeBuffer* buf, int dst, int src)
+{
+    emit_rex(buf, 0, src, dst);
+    emit_byte(buf, 0x31); /* xor r/m32, r32 */
+    emit_modrm_reg(buf, src, dst);
+}
+
+void x86_mov_mem8_r8(CodeBuffer* buf, int base, int32_t disp, int reg)
+{
+    emit_rex(buf, 0, reg, base);
+    emit_byte(buf, 0x88); /* mov r/m8, r8 */
+    emit_mem(buf, reg, base, disp);
+}
+
+/* op r/m64, r64 for the classic two-operand ALU ops */
+static void emit_alu_r64(CodeBuffer* buf, uint8_t opcode, int dst, int src)
+{
+    emit_rex(buf, 1, src, dst);
+    emit_byte(buf, opcode);
+    emit_modrm_reg(buf, src, dst);
+}
+
+void x86_add_r64_r64(CodeBuffer* buf, int dst, int src)
+{
+    emit_alu_r64(buf, 0x01, dst, src);
+}
+
+void x86_sub_r64_r64(CodeBuffer* buf, int dst, int src)
+{
+    emit_alu_r64(buf, 0x29, dst, src);
+}
+
+void x86_cmp_r64_r64(CodeBuffer* buf, int a, int b)
+{
+    emit_alu_r64(buf, 0x39, a, b);
+}
+
+void x86_test_r64_r64(CodeBuffer* buf, int a, int b)
+{
+    emit_alu_r64(buf, 0x85, a, b);
+}
+
+void x86_push(CodeBuffer* buf, int reg)
+{
+    emit_rex(buf, 0, 0, reg);
+    emit_byte(buf, 0x50 + (reg & 7));
+}
+
+void x86_pop(CodeBuffer* buf, int reg)
+{
+    emit_rex(buf, 0, 0, reg);
+    emit_byte(buf, 0x58 + (reg & 7));
+}
+
+size_t x86_call_rel32(CodeBuffer* buf, int32_t rel)
+{
+    emit_byte(buf, 0xE8);
+    size_t pos = buf->size;
+    emit_u32(buf, (uint32_t)rel);
+    return pos;
+}
+
+size_t x86_jcc_rel8(CodeBuffer* buf, int cc, int8_t rel)
+{
+    emit_byte(buf, 0x70 | cc);
+    emit_byte(buf, (uint8_t)rel);
+    return buf->size - 1;
+}
+
+size_t x86_jcc_rel32(CodeBuffer* buf, int cc, int32_t rel)
+{
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, 0x80 | cc);
+    size_t pos = buf->size;
+    emit_u32(buf, (uint32_t)rel);
+    return pos;
+}
+
+size_t x86_jmp_rel32(CodeBuffer* buf, int32_t rel)
+{
+    emit_byte(buf, 0xE9);
+    size_t pos = buf->size;
+    emit_u32(buf, (uint32_t)rel);
+    return pos;
+}
+
+/* rel32 is relative to the end of the instruction, which is where the field ends */
+void x86_patch_rel32(CodeBuffer* buf, size_t pos, size_t target)
+{
+    write_u32(buf, pos, (uint32_t)(int32_t)((int64_t)target - (int64_t)(pos + 4)));
+}
+
+void x86_patch_rel8(CodeBuffer* buf, size_t pos, size_t target)
+{
+    buf->code[pos] = (uint8_t)(int8_t)((int64_t)target - (int64_t)(pos + 1));
+}
+
+int32_t x86_rel32_to(CodeBuffer* buf, size_t target, size_t length)
+{
+    return (int32_t)((int64_t)target - (int64_t)(buf->size + length));
+}
+
+/* group 1 op r32, imm32: 81 /ext id */
+static void emit_group1_r32(CodeBuffer* buf, int ext, int reg, uint32_t imm)
+{
+    emit_rex(buf, 0, 0, reg);
+    emit_byte(buf, 0x81);
+    emit_modrm_reg(buf, ext, reg);
+    emit_u32(buf, imm);
+}
+
+void x86_and_r32_imm(CodeBuffer* buf, int reg, uint32_t imm)
+{
+    emit_group1_r32(buf, 4, reg, imm); /* /4 = and */
+}
+
+void x86_xor_r32_imm(CodeBuffer* buf, int reg, uint32_t imm)
+{
+    emit_group1_r32(buf, 6, reg, imm); /* /6 = xor */
+}
+
+void x86_bsf_r32(CodeBuffer* buf, int dst, int src)
+{
+    emit_rex(buf, 0, dst, src);
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, 0xBC);
+    emit_modrm_reg(buf, dst, src);
+}
+
+void x86_bsr_r32(CodeBuffer* buf, int dst, int src)
+{
+    emit_rex(buf, 0, dst, src);
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, 0xBD);
+    emit_modrm_reg(buf, dst, src);
+}
+
+/* prefix 0F op /r with an xmm register and a [base+disp] operand */
+static void emit_sse_mem(CodeBuffer* buf, uint8_t prefix, uint8_t opcode, int xmm, int base, int32_t disp)
+{
+    emit_byte(buf, prefix); /* mandatory prefix; goes before REX */
+    emit_rex(buf, 0, xmm, base);
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, opcode);
+    emit_mem(buf, xmm, base, disp);
+}
+
+void x86_movdqu_load(CodeBuffer* buf, int xmm, int base, int32_t disp)
+{
+    emit_sse_mem(buf, 0xF3, 0x6F, xmm, base, disp);
+}
+
+void x86_movdqu_store(CodeBuffer* buf, int base, int32_t disp, int xmm)
+{
+    emit_sse_mem(buf, 0xF3, 0x7F, xmm, base, disp);
+}
+
+void x86_movq_load(CodeBuffer* buf, int xmm, int base, int32_t disp)
+{
+    emit_sse_mem(buf, 0xF3, 0x7E, xmm, base, disp);
+}
+
+void x86_movq_store(CodeBuffer* buf, int base, int32_t disp, int xmm)
+{
+    emit_sse_mem(buf, 0x66, 0xD6, xmm, base, disp);
+}
+
+/* 66 0F op /r between two xmm registers, or an r32 and an xmm for pmovmskb */
+static void emit_sse_rr(CodeBuffer* buf, uint8_t opcode, int reg, int rm)
+{
+    emit_byte(buf, 0x66);
+    emit_rex(buf, 0, reg, rm);
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, opcode);
+    emit_modrm_reg(buf, reg, rm);
+}
+
+void x86_pxor(CodeBuffer* buf, int dst, int src)
+{
+    emit_sse_rr(buf, 0xEF, dst, src);
+}
+
+void x86_pcmpeqb(CodeBuffer* buf, int dst, int src)
+{
+    emit_sse_rr(buf, 0x74, dst, src);
+}
+
+void x86_pmovmskb(CodeBuffer* buf, int reg, int xmm)
+{
+    emit_sse_rr(buf, 0xD7, reg, xmm);
+}
+
+void x86_pand(CodeBuffer* buf, int dst, int src)
+{
+    emit_sse_rr(buf, 0xDB, dst, src);
+}
+
+void x86_paddb(CodeBuffer* buf, int dst, int src)
+{
+    emit_sse_rr(buf, 0xFC, dst, src);
+}
+
+void x86_syscall(CodeBuffer* buf)
+{
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, 0x05);
+}
+
+void x86_ret(CodeBuffer* buf)
+{
+    emit_byte(buf, 0xC3);
+}
+
+void x86_nops(CodeBuffer* buf, size_t count)
+{
+    /* the recommended multi-byte nop sequences, 1 to 8 bytes */
+    static const uint8_t nops[8][8] = {
+        { 0x90 },
+        { 0x66, 0x90 },
+        { 0x0F, 0x1F, 0x00 },
+        { 0x0F, 0x1F, 0x40, 0x00 },
+        { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    };
+
+    while (count > 0)
+    {
+        size_t n = count > 8 ? 8 : count;
+        emit_bytes(buf, nops[n - 1], n);
+        count -= n;
+    }
+}
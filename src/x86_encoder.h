@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include "bfc.h"
+
+/* x86-64 instruction encoder; in x86_encoder.c. Instructions are variable length, so unlike the
+ * arm64 encoder these append straight to the code buffer. Memory operands are always [base + disp] */
+enum
+{
+    X86_RAX = 0, X86_RCX, X86_RDX, X86_RBX, X86_RSP, X86_RBP, X86_RSI, X86_RDI,
+    X86_R8, X86_R9, X86_R10, X86_R11, X86_R12, X86_R13, X86_R14, X86_R15,
+};
+
+/* condition codes for jcc */
+#define X86_CC_E 0x4  /* equal / zero */
+#define X86_CC_NE 0x5 /* not equal / not zero */
+#define X86_CC_S 0x8  /* sign */
+#define X86_CC_LE 0xE /* signed less or equal */
+
+void x86_add_mem8_imm(CodeBuffer* buf, int base, int32_t disp, uint8_t imm); /* add byte [base+disp], imm8 */
+
+void x86_sub_mem8_imm(CodeBuffer* buf, int base, int32_t disp, uint8_t imm); /* sub byte [base+disp], imm8 */
+
+void x86_mov_mem8_imm(CodeBuffer* buf, int base, int32_t disp, uint8_t imm); /* mov byte [base+disp], imm8 */
+
+void x86_cmp_mem8_imm(CodeBuffer* buf, int base, int32_t disp, uint8_t imm); /* cmp byte [base+disp], imm8 */
+
+void x86_add_mem8_r8(CodeBuffer* buf, int base, int32_t disp, int reg); /* add byte [base+disp], r8; al..bl only */
+
+void x86_sub_mem8_r8(CodeBuffer* buf, int base, int32_t disp, int reg); /* sub byte [base+disp], r8; al..bl only */
+
+void x86_movzx_r32_mem8(CodeBuffer* buf, int reg, int base, int32_t disp); /* movzx r32, byte [base+disp] */
+
+void x86_imul_r32_imm(CodeBuffer* buf, int dst, int src, int32_t imm); /* imul r32, r32, imm */
+
+void x86_shl_r32_imm(CodeBuffer* buf, int reg, uint8_t shift); /* shl r32, imm8 */
+
+void x86_add_r64_imm(CodeBuffer* buf, int reg, int32_t imm); /* add r64, imm; sub when imm is negative */
+
+void x86_lea_r64(CodeBuffer* buf, int dst, int base, int32_t disp); /* lea r64, [base+disp] */
+
+void x86_mov_r64_mem(CodeBuffer* buf, int dst, int base, int32_t disp); /* mov r64, qword [base+disp] */
+
+void x86_mov_mem64_r64(CodeBuffer* buf, int base, int32_t disp, int src); /* mov qword [base+disp], r64 */
+
+void x86_inc_mem64(CodeBuffer* buf, int base, int32_t disp); /* inc qword [base+disp] */
+
+size_t x86_lea_rip(CodeBuffer* buf, int dst, int32_t disp); /* lea r64, [rip+disp32]; returns the position of disp32 */
+
+void x86_mov_r64_r64(CodeBuffer* buf, int dst, int src); /* mov r64, r64 */
+
+void x86_mov_r32_imm(CodeBuffer* buf, int reg, uint32_t imm); /* mov r32, imm32; zero-extends */
+
+void x86_xor_r32_r32(CodeBuffer* buf, int dst, int src); /* xor r32, r32 */
+
+void x86_mov_mem8_r8(CodeBuffer* buf, int base, int32_t disp, int reg); /* mov byte [base+disp], r8; al..bl only */
+
+void x86_add_r64_r64(CodeBuffer* buf, int dst, int src); /* add r64, r64 */
+
+void x86_sub_r64_r64(CodeBuffer* buf, int dst, int src); /* sub r64, r64 */
+
+void x86_cmp_r64_r64(CodeBuffer* buf, int a, int b); /* cmp r64, r64 */
+
+void x86_test_r64_r64(CodeBuffer* buf, int a, int b); /* test r64, r64 */
+
+void x86_push(CodeBuffer* buf, int reg);
+
+void x86_pop(CodeBuffer* buf, int reg);
+
+size_t x86_call_rel32(CodeBuffer* buf, int32_t rel); /* call rel32; returns the position of rel32 */
+
+void x86_call_mem64(CodeBuffer* buf, int base, int32_t disp); /* call qword [base+disp] */
+
+size_t x86_jcc_rel8(CodeBuffer* buf, int cc, int8_t rel); /* jcc rel8; returns the position of rel8 */
+
+size_t x86_jcc_rel32(CodeBuffer* buf, int cc, int32_t rel); /* jcc rel32; returns the position of rel32 */
+
+size_t x86_jmp_rel32(CodeBuffer* buf, int32_t rel); /* jmp rel32; returns the position of rel32 */
+
+void x86_patch_rel32(CodeBuffer* buf, size_t pos, size_t target); /* point the rel32 at pos to target */
+
+void x86_patch_rel8(CodeBuffer* buf, size_t pos, size_t target); /* same for a rel8; target must be within 127 bytes */
+
+int32_t x86_rel32_to(CodeBuffer* buf, size_t target, size_t length); /* rel32 for an instruction of `length` bytes emitted next */
+
+void x86_and_r32_imm(CodeBuffer* buf, int reg, uint32_t imm); /* and r32, imm32 */
+
+void x86_xor_r32_imm(CodeBuffer* buf, int reg, uint32_t imm); /* xor r32, imm32 */
+
+void x86_bsf_r32(CodeBuffer* buf, int dst, int src); /* index of the lowest set bit */
+
+void x86_bsr_r32(CodeBuffer* buf, int dst, int src); /* index of the highest set bit */
+
+/* SSE2; xmm registers are numbered 0-15 like the general ones */
+void x86_movdqu_load(CodeBuffer* buf, int xmm, int base, int32_t disp); /* movdqu xmm, [base+disp] */
+
+void x86_movdqu_store(CodeBuffer* buf, int base, int32_t disp, int xmm); /* movdqu [base+disp], xmm */
+
+void x86_movq_load(CodeBuffer* buf, int xmm, int base, int32_t disp); /* movq xmm, [base+disp]; clears the upper half */
+
+void x86_movq_store(CodeBuffer* buf, int base, int32_t disp, int xmm); /* movq [base+disp], xmm; the low 8 bytes */
+
+void x86_pxor(CodeBuffer* buf, int dst, int src); /* pxor xmm, xmm */
+
+void x86_pcmpeqb(CodeBuffer* buf, int dst, int src); /* pcmpeqb xmm, xmm */
+
+void x86_pmovmskb(CodeBuffer* buf, int reg, int xmm); /* r32 = the top bit of each byte of xmm */
+
+void x86_pand(CodeBuffer* buf, int dst, int src); /* pand xmm, xmm */
+
+void x86_paddb(CodeBuffer* buf, int dst, int src); /* paddb xmm, xmm; per byte, wrapping */
+
+void x86_syscall(CodeBuffer* buf);
+
+void x86_ret(CodeBuffer* buf);
+
+void x86_nops(CodeBuffer* buf, size_t count); /* count bytes of padding using the long nop forms */
@@ -0,0 +1,11 @@
+prompt then echo: the prompt is built with a loop before any input is read
+so it can be printed at compile time; then one line of input is echoed
+
+++++++++[>++++++++++>++++++++++++>++++<<<-]
+>--.                  N
+>+.                   a
+++++++++++++.         m
+--------.             e
+<---------------.     question mark
+>>.                   space
+>,----------[++++++++++.,----------]++++++++++.
@@ -0,0 +1,3 @@
+multi target linearization; the input byte is read and cleared first so that none of this is folded
+at compile time; prints bytes 5 10 241 after the first loop then 241 0 253 0
+,[-]+++++[->+>++>---<<<]>.>.>.[-<<<+>>>]++[-<+>]<<[+>+++<]<.>.>.>.
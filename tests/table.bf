@@ -0,0 +1,9 @@
+cell table: after the input is read a loop fills five neighbouring cells
+then straight line adds and sets touch them all at once so they can be
+updated together as one vector
+
+,>++++++++++[>++++++++++>++++++++++>++++++++++>+++>+<<<<<-]
+>-->++>->+++          b f c bang
+<<<<<.>>.>.>.>.>.     input then the table and a newline
+<<<<[-]>+++++++++>++++++++>[-]++++++++++>[-]+
+<<<.>.>.              o k newline